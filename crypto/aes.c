@@ -35,7 +35,7 @@
     #define RCON(C) rcon[(C)]
 #endif
 
-#define KEY(R, C) aes->k[p + R + (C<<2) ]
+#define KEY(R, C) k[R + (C<<2) ]
 #define STATE(R, C) s[R + (C<<2) ]
 #define GALOIS_MUL2(B) (((B) & 0x80) ? (((B) << 1) ^ 0x1b ) : ((B) << 1))
 
@@ -101,6 +101,8 @@ int aes_init(aes_ctxt *aes, const uint8_t *k, int k_size)
         return -1;
     }
     
+    AES_STAT_ADD(key_expansions, 1);
+
     MEMCPY(aes->k, k, k_size);
     key = aes->k; 
 
@@ -139,78 +141,352 @@ int aes_init(aes_ctxt *aes, const uint8_t *k, int k_size)
     return 0;
 }
 
+/* add round key, sbox and shiftrows for one state */
+inline static void encr_round(const uint8_t *k, uint8_t *s)
+{
+    uint8_t a, b;
+
+    /* row 1 */
+    STATE(0, 0) = SBOX( STATE(0, 0) ^ KEY(0,0) );
+    STATE(0, 1) = SBOX( STATE(0, 1) ^ KEY(0,1) );
+    STATE(0, 2) = SBOX( STATE(0, 2) ^ KEY(0,2) );
+    STATE(0, 3) = SBOX( STATE(0, 3) ^ KEY(0,3) );
+
+    /* row 2, left shift 1 */
+    a = SBOX( STATE(1, 0) ^ KEY(1,0) );
+    STATE(1, 0) = SBOX( STATE(1, 1) ^ KEY(1,1) );
+    STATE(1, 1) = SBOX( STATE(1, 2) ^ KEY(1,2) );
+    STATE(1, 2) = SBOX( STATE(1, 3) ^ KEY(1,3) );
+    STATE(1, 3) = a;
+
+    /* row 3, left shift 2 */
+    a = SBOX( STATE(2, 0) ^ KEY(2, 0) );
+    b = SBOX( STATE(2, 1) ^ KEY(2, 1) );
+    STATE(2, 0) = SBOX( STATE(2, 2) ^ KEY(2, 2) );
+    STATE(2, 1) = SBOX( STATE(2, 3) ^ KEY(2, 3) );
+    STATE(2, 2) = a;
+    STATE(2, 3) = b;
+
+    /* row 4, left shift 3 */
+    a = SBOX( STATE(3, 3) ^ KEY(3, 3) );
+    STATE(3, 3) = SBOX( STATE(3, 2) ^ KEY(3, 2) );
+    STATE(3, 2) = SBOX( STATE(3, 1) ^ KEY(3, 1) );
+    STATE(3, 1) = SBOX( STATE(3, 0) ^ KEY(3, 0) );
+    STATE(3, 0) = a;
+}
+
+/* mix columns for one state */
+inline static void mix_columns(uint8_t *s)
+{
+    int i;
+    uint8_t a, b, c, d;
+
+    for(i=0; i < 16; i += 4){
+
+        a = s[i + 0];
+        b = s[i + 1];
+        c = s[i + 2];
+        d = s[i + 3];
+
+        /* 2a + 3b + 1c + 1d 
+         * 1a + 2b + 3c + 1d
+         * 1a + 1b + 2c + 3d
+         * 3a + 1b + 1c + 2d
+         *
+         * */
+        s[i + 0] ^= (a ^ b ^ c ^ d) ^ GALOIS_MUL2( (a ^ b) );
+        s[i + 1] ^= (a ^ b ^ c ^ d) ^ GALOIS_MUL2( (b ^ c) );
+        s[i + 2] ^= (a ^ b ^ c ^ d) ^ GALOIS_MUL2( (c ^ d) );
+        s[i + 3] ^= (a ^ b ^ c ^ d) ^ GALOIS_MUL2( (d ^ a) );
+    }
+}
+
+/* final add round key for one state */
+inline static void add_round_key(const uint8_t *k, uint8_t *s)
+{
+    int i;
+
+    for(i=0; i < 16; i++)
+        s[i] ^= k[i];
+}
+
+#ifdef AES_TUNE
+
+/* aes_encr() backends selectable by aes_tune() */
+static void encr_byte(const aes_ctxt *aes, uint8_t *s);
+static void encr_table(const aes_ctxt *aes, uint8_t *s);
+
+static void (*encr_backend)(const aes_ctxt *aes, uint8_t *s) = encr_byte;
+
+void aes_encr(const aes_ctxt *aes, uint8_t *s)
+{
+    AES_STAT_ADD(blocks_enciphered, 1);
+
+    __atomic_load_n(&encr_backend, __ATOMIC_ACQUIRE)(aes, s);
+}
+
+static void encr_byte(const aes_ctxt *aes, uint8_t *s)
+#else
 void aes_encr(const aes_ctxt *aes, uint8_t *s)
+#endif
+{
+    int r;
+    const uint8_t *k;
+
+#ifndef AES_TUNE
+    AES_STAT_ADD(blocks_enciphered, 1);
+#endif
+
+    for(r = 1, k = aes->k; r < aes->r; r++, k += 16){
+
+        encr_round(k, s);
+        mix_columns(s);
+    }
+
+    encr_round(k, s);
+    add_round_key(k + 16, s);
+}
+
+#ifdef AES_TUNE
+
+/* sbox, shiftrows and mixcolumns of row 0 as one lookup (row r of a
+ * column is bits 8r..8r+7); filled by tables_init() */
+static uint32_t te0[256];
+static int te0_ready;
+
+#define ROTL(W, N) (((W) << (N)) | ((W) >> (32 - (N))))
+#define LOAD32(P) ((uint32_t)(P)[0] | ((uint32_t)(P)[1] << 8) | ((uint32_t)(P)[2] << 16) | ((uint32_t)(P)[3] << 24))
+#define TE(A, B, C, D) (te0[(A) & 0xff] ^ ROTL(te0[((B) >> 8) & 0xff], 8) ^ ROTL(te0[((C) >> 16) & 0xff], 16) ^ ROTL(te0[(D) >> 24], 24))
+
+static void tables_init(void)
+{
+    uint32_t i;
+    uint8_t x, x2;
+
+    if(__atomic_load_n(&te0_ready, __ATOMIC_ACQUIRE))
+        return;
+
+    /* concurrent callers write the same values */
+    for(i=0; i < 256; i++){
+
+        x = SBOX(i);
+        x2 = GALOIS_MUL2(x);
+
+        te0[i] = (uint32_t)x2 | ((uint32_t)x << 8) | ((uint32_t)x << 16) | ((uint32_t)(x2 ^ x) << 24);
+    }
+
+    __atomic_store_n(&te0_ready, 1, __ATOMIC_RELEASE);
+}
+
+/* aes_encr() with 32bit table lookups (not constant time: the lookups
+ * depend on key and data, and leak through the cache) */
+static void encr_table(const aes_ctxt *aes, uint8_t *s)
 {
     int r, i;
-    uint16_t p;
-    uint8_t a, b, c, d;
+    const uint8_t *k;
+    uint32_t c0, c1, c2, c3, t0, t1, t2, t3;
+
+    c0 = LOAD32(s);
+    c1 = LOAD32(s + 4);
+    c2 = LOAD32(s + 8);
+    c3 = LOAD32(s + 12);
+
+    for(r = 1, k = aes->k; r < aes->r; r++, k += 16){
+
+        t0 = c0 ^ LOAD32(k);
+        t1 = c1 ^ LOAD32(k + 4);
+        t2 = c2 ^ LOAD32(k + 8);
+        t3 = c3 ^ LOAD32(k + 12);
+
+        c0 = TE(t0, t1, t2, t3);
+        c1 = TE(t1, t2, t3, t0);
+        c2 = TE(t2, t3, t0, t1);
+        c3 = TE(t3, t0, t1, t2);
+    }
+
+    for(i=0; i < 4; i++){
+
+        s[i] = c0 >> (i << 3);
+        s[i + 4] = c1 >> (i << 3);
+        s[i + 8] = c2 >> (i << 3);
+        s[i + 12] = c3 >> (i << 3);
+    }
+
+    encr_round(k, s);
+    add_round_key(k + 16, s);
+}
+
+#undef ROTL
+#undef LOAD32
+#undef TE
+
+#endif
+
+void aes_encr_blocks(const aes_ctxt *aes, uint8_t *s, uint32_t n)
+{
+    int r;
+    uint32_t i;
+    const uint8_t *k;
 
-    /* add round key, sbox and shiftrows */
-    for(r = 0, p = 0; r < aes->r; r++, p += 16){
-
-        /* add round key, sbox, left shift row */
-
-        /* row 1 */
-        STATE(0, 0) = SBOX( STATE(0, 0) ^ KEY(0,0) );
-        STATE(0, 1) = SBOX( STATE(0, 1) ^ KEY(0,1) );
-        STATE(0, 2) = SBOX( STATE(0, 2) ^ KEY(0,2) );
-        STATE(0, 3) = SBOX( STATE(0, 3) ^ KEY(0,3) );
-
-        /* row 2, left shift 1 */
-        a = SBOX( STATE(1, 0) ^ KEY(1,0) );
-        STATE(1, 0) = SBOX( STATE(1, 1) ^ KEY(1,1) );
-        STATE(1, 1) = SBOX( STATE(1, 2) ^ KEY(1,2) );
-        STATE(1, 2) = SBOX( STATE(1, 3) ^ KEY(1,3) );
-        STATE(1, 3) = a;
-
-        /* row 3, left shift 2 */
-        a = SBOX( STATE(2, 0) ^ KEY(2, 0) );
-        b = SBOX( STATE(2, 1) ^ KEY(2, 1) );
-        STATE(2, 0) = SBOX( STATE(2, 2) ^ KEY(2, 2) );
-        STATE(2, 1) = SBOX( STATE(2, 3) ^ KEY(2, 3) );
-        STATE(2, 2) = a;
-        STATE(2, 3) = b;
-
-        /* row 4, left shift 3 */
-        a = SBOX( STATE(3, 3) ^ KEY(3, 3) );
-        STATE(3, 3) = SBOX( STATE(3, 2) ^ KEY(3, 2) );
-        STATE(3, 2) = SBOX( STATE(3, 1) ^ KEY(3, 1) );
-        STATE(3, 1) = SBOX( STATE(3, 0) ^ KEY(3, 0) );
-        STATE(3, 0) = a;
-
-        if((r+1) == aes->r){
-
-            p += 16;
-
-            /* final add round key */
-            for(i=0; i < 16; i++)
-                s[i] ^= aes->k[p+i];
-            
-            return;
+    AES_STAT_ADD(blocks_enciphered, n);
+
+    /* each round is applied to every state before moving to the next so
+     * that the table lookups of independent states can overlap */
+    for(r = 1, k = aes->k; r < aes->r; r++, k += 16){
+
+        for(i=0; i < n; i++){
+
+            encr_round(k, s + (i << 4));
+            mix_columns(s + (i << 4));
         }
-         
-        /* mix columns */
-        for(i=0; i < 16; i += 4){
-
-            a = s[i + 0];
-            b = s[i + 1];
-            c = s[i + 2];
-            d = s[i + 3];
-
-            /* 2a + 3b + 1c + 1d 
-             * 1a + 2b + 3c + 1d
-             * 1a + 1b + 2c + 3d
-             * 3a + 1b + 1c + 2d
-             *
-             * */
-            s[i + 0] ^= (a ^ b ^ c ^ d) ^ GALOIS_MUL2( (a ^ b) );
-            s[i + 1] ^= (a ^ b ^ c ^ d) ^ GALOIS_MUL2( (b ^ c) );
-            s[i + 2] ^= (a ^ b ^ c ^ d) ^ GALOIS_MUL2( (c ^ d) );
-            s[i + 3] ^= (a ^ b ^ c ^ d) ^ GALOIS_MUL2( (d ^ a) );
+    }
+
+    for(i=0; i < n; i++){
+
+        encr_round(k, s + (i << 4));
+        add_round_key(k + 16, s + (i << 4));
+    }
+}
+
+void aes_encr_multi(const aes_ctxt *const *aes, uint8_t *s, uint32_t n)
+{
+    int r, rounds = 0;
+    uint32_t i;
+    const uint8_t *k;
+
+    AES_STAT_ADD(blocks_enciphered, n);
+
+    for(i=0; i < n; i++)
+        rounds = (aes[i]->r > rounds) ? aes[i]->r : rounds;
+
+    /* as aes_encr_blocks() but each state finishes on its own last round */
+    for(r = 1; r <= rounds; r++){
+
+        for(i=0; i < n; i++){
+
+            k = aes[i]->k + ((r - 1) << 4);
+
+            if(r < aes[i]->r){
+
+                encr_round(k, s + (i << 4));
+                mix_columns(s + (i << 4));
+            }
+            else if(r == aes[i]->r){
+
+                encr_round(k, s + (i << 4));
+                add_round_key(k + 16, s + (i << 4));
+            }
         }
-    }   
+    }
 }
 
+#ifdef AES_OTF
+
+/* word i of the schedule in a buffer of the last nk words
+ *
+ * The slot of word i holds word i - nk and becomes word i. As the slot is
+ * updated by XOR with a function of word i - 1 the same call also takes
+ * the slot of word i back to word i - nk.
+ *
+ * */
+static void otf_word(uint8_t *w, int nk, int i)
+{
+    uint8_t *cur = w + ((i % nk) << 2);
+    const uint8_t *prev = w + (((i - 1) % nk) << 2);
+    uint8_t swap;
+
+    if(!(i % nk)){
+
+        swap = prev[0];
+        cur[0] ^= SBOX( prev[1] ) ^ RCON(i / nk);
+        cur[1] ^= SBOX( prev[2] );
+        cur[2] ^= SBOX( prev[3] );
+        cur[3] ^= SBOX( swap );
+    }
+    else if((nk > 6) && ((i % nk) == 4)){
+
+        cur[0] ^= SBOX( prev[0] );
+        cur[1] ^= SBOX( prev[1] );
+        cur[2] ^= SBOX( prev[2] );
+        cur[3] ^= SBOX( prev[3] );
+    }
+    else{
+
+        cur[0] ^= prev[0];
+        cur[1] ^= prev[1];
+        cur[2] ^= prev[2];
+        cur[3] ^= prev[3];
+    }
+}
+
+/* round key r from a buffer holding words 4r to 4r + 3; *k is only
+ * used when the words wrap around the buffer (AES192) */
+static const uint8_t *otf_round_key(const uint8_t *w, int nk, int r, uint8_t *k)
+{
+    int j = (r << 2) % nk;
+
+    if((j + 4) <= nk)
+        return w + (j << 2);
+
+    MEMCPY(k, w + (j << 2), (nk - j) << 2);
+    MEMCPY(k + ((nk - j) << 2), w, (4 - (nk - j)) << 2);
+
+    return k;
+}
+
+int aes_otf_init(aes_otf_ctxt *aes, const uint8_t *k, int k_size)
+{
+    int i, nk = k_size >> 2;
+
+    if((k_size != AES128_KEY_SIZE) && (k_size != AES192_KEY_SIZE) && (k_size != AES256_KEY_SIZE))
+        return -1;
+
+    AES_STAT_ADD(key_expansions, 1);
+
+    MEMSET(aes, 0x0, sizeof(*aes));
+    MEMCPY(aes->k, k, k_size);
+    MEMCPY(aes->dk, k, k_size);
+
+    aes->nk = nk;
+
+    /* 4 * (rounds + 1) words */
+    for(i = nk; i < ((nk + 7) << 2); i++)
+        otf_word(aes->dk, nk, i);
+
+    return 0;
+}
+
+void aes_otf_encr(const aes_otf_ctxt *aes, uint8_t *s)
+{
+    uint8_t w[AES256_KEY_SIZE], k[AES_BLOCK_SIZE];
+    int r, i, nk = aes->nk, rounds = nk + 6;
+
+    AES_STAT_ADD(blocks_enciphered, 1);
+
+    MEMCPY(w, aes->k, sizeof(w));
+
+    for(r = 0, i = nk; r < rounds; r++){
+
+        for(; i < ((r + 1) << 2); i++)
+            otf_word(w, nk, i);
+
+        encr_round(otf_round_key(w, nk, r, k), s);
+
+        if(r < (rounds - 1))
+            mix_columns(s);
+    }
+
+    for(; i < ((r + 1) << 2); i++)
+        otf_word(w, nk, i);
+
+    add_round_key(otf_round_key(w, nk, r, k), s);
+
+    MEMSET(w, 0x0, sizeof(w));
+    MEMSET(k, 0x0, sizeof(k));
+}
+
+#endif
+
 #ifdef AES_DECR
 
 static const uint8_t rsbox[] AES_CONST = {
@@ -248,87 +524,154 @@ static const uint8_t rsbox[] AES_CONST = {
     0xe1, 0x69, 0x14, 0x63, 0x55, 0x21, 0x0c, 0x7d
 };
 
-void aes_decr(const aes_ctxt *aes, uint8_t *s)
+/* inverse mix columns for one state */
+inline static void inv_mix_columns(uint8_t *s)
 {
-    int r, i;
-    uint16_t p;
+    int i;
     uint8_t a, b, c, d, e, x, y;
 
-    p = (((uint16_t)aes->r) << 4);
-    r = aes->r;
+    for(i=0; i < 16; i += 4){
+
+        a = s[i + 0];
+        b = s[i + 1];
+        c = s[i + 2];
+        d = s[i + 3];
+
+        /* 2a + 2b + 2c + 2d */
+        e = GALOIS_MUL2( (a ^ b ^ c ^ d) );
+
+        /* 13a + 9b + 13c + 9d */
+        x = GALOIS_MUL2( (e ^ a ^ c) );                
+        x = (a ^ b ^ c ^ d) ^ GALOIS_MUL2( x );
+
+        /* 9a + 13b + 9c + 13d */
+        y = GALOIS_MUL2( (e ^ b ^ d) );                
+        y = (a ^ b ^ c ^ d) ^ GALOIS_MUL2( y );
+        
+        
+        /* 14a + 11b + 13c + 9d
+         * 9a + 14b + 11c + 13d
+         * 13a + 9b + 14c + 11d
+         * 11a + 13b + 9c + 14d
+         *
+         * */
+        s[i + 0] ^= x ^ GALOIS_MUL2( (a ^ b) );
+        s[i + 1] ^= y ^ GALOIS_MUL2( (b ^ c) );
+        s[i + 2] ^= x ^ GALOIS_MUL2( (c ^ d) );
+        s[i + 3] ^= y ^ GALOIS_MUL2( (d ^ a) );
+    }
+}
 
-    /* add round key */
-    for(i=0; i < 16; i++)
-        s[i] ^= aes->k[p+i];
-
-    /* add round key, sbox and shiftrows */
-    for(p -= 16; r; r--, p -= 16){
-
-        if(r < aes->r){
-
-            /* inverse mix columns */
-            for(i=0; i < 16; i += 4){
-
-                a = s[i + 0];
-                b = s[i + 1];
-                c = s[i + 2];
-                d = s[i + 3];
-
-                /* 2a + 2b + 2c + 2d */
-                e = GALOIS_MUL2( (a ^ b ^ c ^ d) );
-
-                /* 13a + 9b + 13c + 9d */
-                x = GALOIS_MUL2( (e ^ a ^ c) );                
-                x = (a ^ b ^ c ^ d) ^ GALOIS_MUL2( x );
-
-                /* 9a + 13b + 9c + 13d */
-                y = GALOIS_MUL2( (e ^ b ^ d) );                
-                y = (a ^ b ^ c ^ d) ^ GALOIS_MUL2( y );
-                
-                
-                /* 14a + 11b + 13c + 9d
-                 * 9a + 14b + 11c + 13d
-                 * 13a + 9b + 14c + 11d
-                 * 11a + 13b + 9c + 14d
-                 *
-                 * */
-                s[i + 0] ^= x ^ GALOIS_MUL2( (a ^ b) );
-                s[i + 1] ^= y ^ GALOIS_MUL2( (b ^ c) );
-                s[i + 2] ^= x ^ GALOIS_MUL2( (c ^ d) );
-                s[i + 3] ^= y ^ GALOIS_MUL2( (d ^ a) );
-            }
-        }
+/* right shift row, reverse-sbox, add round key for one state */
+inline static void decr_round(const uint8_t *k, uint8_t *s)
+{
+    uint8_t a, b;
+
+    /* row 1 */
+    STATE(0, 0) = RSBOX( STATE(0, 0) ) ^ KEY(0,0);
+    STATE(0, 1) = RSBOX( STATE(0, 1) ) ^ KEY(0,1);
+    STATE(0, 2) = RSBOX( STATE(0, 2) ) ^ KEY(0,2);
+    STATE(0, 3) = RSBOX( STATE(0, 3) ) ^ KEY(0,3);
+
+    /* row 2, right shift 1 */
+    a = RSBOX( STATE(1, 3) ) ^ KEY(1,0);
+    STATE(1, 3) = RSBOX( STATE(1, 2) ) ^ KEY(1,3);
+    STATE(1, 2) = RSBOX( STATE(1, 1) ) ^ KEY(1,2);
+    STATE(1, 1) = RSBOX( STATE(1, 0) ) ^ KEY(1,1);
+    STATE(1, 0) = a;
+
+    /* row 3, right shift 2 */
+    a = RSBOX( STATE(2, 0) ) ^ KEY(2, 2);
+    b = RSBOX( STATE(2, 1) ) ^ KEY(2, 3);
+    STATE(2, 0) = RSBOX( STATE(2, 2) ) ^ KEY(2, 0);
+    STATE(2, 1) = RSBOX( STATE(2, 3) ) ^ KEY(2, 1);
+    STATE(2, 2) = a;
+    STATE(2, 3) = b;
+
+    /* row 4, right shift 3 */
+    a = RSBOX( STATE(3, 0) ) ^ KEY(3, 3) ;
+    STATE(3, 0) = RSBOX( STATE(3, 1) ) ^ KEY(3, 0);
+    STATE(3, 1) = RSBOX( STATE(3, 2) ) ^ KEY(3, 1);
+    STATE(3, 2) = RSBOX( STATE(3, 3) ) ^ KEY(3, 2);
+    STATE(3, 3) = a;
+}
+
+void aes_decr(const aes_ctxt *aes, uint8_t *s)
+{
+    int r;
+    const uint8_t *k;
 
-        /* right shift row, reverse-sbox, add round key */
-
-        /* row 1 */
-        STATE(0, 0) = RSBOX( STATE(0, 0) ) ^ KEY(0,0);
-        STATE(0, 1) = RSBOX( STATE(0, 1) ) ^ KEY(0,1);
-        STATE(0, 2) = RSBOX( STATE(0, 2) ) ^ KEY(0,2);
-        STATE(0, 3) = RSBOX( STATE(0, 3) ) ^ KEY(0,3);
-
-        /* row 2, right shift 1 */
-        a = RSBOX( STATE(1, 3) ) ^ KEY(1,0);
-        STATE(1, 3) = RSBOX( STATE(1, 2) ) ^ KEY(1,3);
-        STATE(1, 2) = RSBOX( STATE(1, 1) ) ^ KEY(1,2);
-        STATE(1, 1) = RSBOX( STATE(1, 0) ) ^ KEY(1,1);
-        STATE(1, 0) = a;
-
-        /* row 3, right shift 2 */
-        a = RSBOX( STATE(2, 0) ) ^ KEY(2, 2);
-        b = RSBOX( STATE(2, 1) ) ^ KEY(2, 3);
-        STATE(2, 0) = RSBOX( STATE(2, 2) ) ^ KEY(2, 0);
-        STATE(2, 1) = RSBOX( STATE(2, 3) ) ^ KEY(2, 1);
-        STATE(2, 2) = a;
-        STATE(2, 3) = b;
-
-        /* row 4, right shift 3 */
-        a = RSBOX( STATE(3, 0) ) ^ KEY(3, 3) ;
-        STATE(3, 0) = RSBOX( STATE(3, 1) ) ^ KEY(3, 0);
-        STATE(3, 1) = RSBOX( STATE(3, 2) ) ^ KEY(3, 1);
-        STATE(3, 2) = RSBOX( STATE(3, 3) ) ^ KEY(3, 2);
-        STATE(3, 3) = a;
+    AES_STAT_ADD(blocks_deciphered, 1);
+
+    k = aes->k + (aes->r << 4);
+
+    add_round_key(k, s);
+
+    for(r = 1, k -= 16; r < aes->r; r++, k -= 16){
+
+        decr_round(k, s);
+        inv_mix_columns(s);
     }
+
+    decr_round(k, s);
+}
+
+#ifdef AES_OTF
+
+void aes_otf_decr(const aes_otf_ctxt *aes, uint8_t *s)
+{
+    uint8_t w[AES256_KEY_SIZE], k[AES_BLOCK_SIZE];
+    int r, nk = aes->nk, rounds = nk + 6;
+    int lo = ((rounds + 1) << 2) - nk;   /* first word in w */
+
+    AES_STAT_ADD(blocks_deciphered, 1);
+
+    MEMCPY(w, aes->dk, sizeof(w));
+
+    add_round_key(otf_round_key(w, nk, rounds, k), s);
+
+    for(r = rounds - 1; r >= 0; r--){
+
+        /* back to word 4r */
+        for(; lo > (r << 2); lo--)
+            otf_word(w, nk, lo - 1 + nk);
+
+        decr_round(otf_round_key(w, nk, r, k), s);
+
+        if(r)
+            inv_mix_columns(s);
+    }
+
+    MEMSET(w, 0x0, sizeof(w));
+    MEMSET(k, 0x0, sizeof(k));
+}
+
+#endif
+
+void aes_decr_blocks(const aes_ctxt *aes, uint8_t *s, uint32_t n)
+{
+    int r;
+    uint32_t i;
+    const uint8_t *k;
+
+    AES_STAT_ADD(blocks_deciphered, n);
+
+    k = aes->k + (aes->r << 4);
+
+    for(i=0; i < n; i++)
+        add_round_key(k, s + (i << 4));
+
+    for(r = 1, k -= 16; r < aes->r; r++, k -= 16){
+
+        for(i=0; i < n; i++){
+
+            decr_round(k, s + (i << 4));
+            inv_mix_columns(s + (i << 4));
+        }
+    }
+
+    for(i=0; i < n; i++)
+        decr_round(k, s + (i << 4));
 }
 
 #endif
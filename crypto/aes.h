@@ -32,6 +32,7 @@
 #define AES_H
 
 #include <stdint.h>
+#include <stddef.h>
 
 #define AES_BLOCK_SIZE  16      /**< cipher block size (same for all k_size) */
 
@@ -72,7 +73,160 @@ void aes_encr(const aes_ctxt *aes, uint8_t *s);
  * */
 void aes_decr(const aes_ctxt *aes, uint8_t *s);
 
+/** encrypt n consecutive states of AES_BLOCK_SIZE bytes
+ *
+ * Each round is applied to all states before moving to the next so that
+ * independent states can overlap in the pipeline.
+ *
+ * @param *aes aes context
+ * @param *s (n * AES_BLOCK_SIZE) bytes of state
+ * @param n number of states
+ *
+ * */
+void aes_encr_blocks(const aes_ctxt *aes, uint8_t *s, uint32_t n);
+
+/** encrypt n consecutive states of AES_BLOCK_SIZE bytes, each under its
+ * own key
+ *
+ * Multi-buffer form of aes_encr_blocks() for states gathered from
+ * unrelated requests. Key sizes may be mixed.
+ *
+ * @param **aes n aes contexts; aes[i] is used for state i
+ * @param *s (n * AES_BLOCK_SIZE) bytes of state
+ * @param n number of states
+ *
+ * */
+void aes_encr_multi(const aes_ctxt *const *aes, uint8_t *s, uint32_t n);
+
+/** decrypt n consecutive states of AES_BLOCK_SIZE bytes
+ *
+ * @param *aes aes context
+ * @param *s (n * AES_BLOCK_SIZE) bytes of state
+ * @param n number of states
+ *
+ * */
+void aes_decr_blocks(const aes_ctxt *aes, uint8_t *s, uint32_t n);
+
+/** compact AES context (AES_OTF)
+ *
+ * Holds the cipher key instead of the expanded schedule; round keys are
+ * computed as each block is ciphered. dk is the end of the schedule from
+ * which decryption runs the schedule backwards.
+ *
+ * */
+typedef struct {
+
+    uint8_t k[AES256_KEY_SIZE];     /**< cipher key */
+    uint8_t dk[AES256_KEY_SIZE];    /**< last k_size bytes of the schedule */
+    uint8_t nk;                     /**< key size in words */
+
+} aes_otf_ctxt;
+
+/** initialise aes_otf_ctxt
+ *
+ * @param *aes compact context
+ * @param *k pointer to key
+ * @param k_size size of *k in bytes
+ *
+ * @return 0 on success; -1 if k_size is not valid
+ *
+ * */
+int aes_otf_init(aes_otf_ctxt *aes, const uint8_t *k, int k_size);
+
+/** encrypt state of AES_BLOCK_SIZE bytes with round keys computed inline
+ *
+ * Same result as aes_encr() with a context from aes_init().
+ *
+ * @param *aes compact context
+ * @param *s AES_BLOCK_SIZE bytes of state
+ *
+ * */
+void aes_otf_encr(const aes_otf_ctxt *aes, uint8_t *s);
+
+/** decrypt state of AES_BLOCK_SIZE bytes with round keys computed inline
+ *
+ * @param *aes compact context
+ * @param *s AES_BLOCK_SIZE bytes of state
+ *
+ * */
+void aes_otf_decr(const aes_otf_ctxt *aes, uint8_t *s);
+
+
+
+/** @defgroup mAES/aes/pool Thread pool
+ *
+ * Work-stealing thread pool used by the parallel mode functions.
+ *
+ * - work is divided into chunks; each participant starts on its own
+ *   contiguous range of chunks and idle participants steal the top half
+ *   of a busy participant's range
+ * - the caller of aes_pool_for() takes part in the work
+ * - parallel mode functions produce the same output as their serial
+ *   equivalents
+ *
+ * @{ */
+
+/** default number of blocks in each unit of work for parallel modes */
+#ifndef AES_POOL_GRAIN
+#define AES_POOL_GRAIN  1024
+#endif
+
+/** aes_pool_create() flag: pin each worker thread to its own CPU */
+#define AES_POOL_AFFINITY   0x1
+
+/** opaque thread pool */
+typedef struct aes_pool aes_pool;
+
+/** parallel for body
+ *
+ * @param *arg argument passed to aes_pool_for()
+ * @param first index of first item
+ * @param count number of items
+ *
+ * */
+typedef void (*aes_pool_fn)(void *arg, uint32_t first, uint32_t count);
+
+/** create a thread pool
+ *
+ * @param threads number of participants including the calling thread
+ *        (0 for one per online CPU)
+ * @param flags AES_POOL_AFFINITY or 0
+ *
+ * @return pool; NULL on failure
+ *
+ * */
+aes_pool *aes_pool_create(int threads, int flags);
+
+/** stop worker threads and free the pool
+ *
+ * @param *pool thread pool (may be NULL)
+ *
+ * */
+void aes_pool_destroy(aes_pool *pool);
 
+/** number of participants
+ *
+ * @param *pool thread pool (may be NULL)
+ *
+ * @return number of participants including the calling thread
+ *
+ * */
+int aes_pool_threads(const aes_pool *pool);
+
+/** call fn for every chunk of grain items in [0, n) and wait for completion
+ *
+ * Calls from different threads are serialised.
+ *
+ * @param *pool thread pool (NULL runs fn in the calling thread)
+ * @param n number of items
+ * @param grain items per chunk
+ * @param fn function to call for each chunk
+ * @param *arg argument for fn
+ *
+ * */
+void aes_pool_for(aes_pool *pool, uint32_t n, uint32_t grain, aes_pool_fn fn, void *arg);
+
+/** @} */
 
 /** @defgroup mAES/aes/ecb AES ECB
  *
@@ -113,6 +267,45 @@ void aes_ecb_encipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t s
  * */
 void aes_ecb_decipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t size);
 
+/** size of a QUIC header protection mask (octets) */
+#define AES_HP_MASK_SIZE    5
+
+/** QUIC header protection masks of many packets
+ *
+ * mask[i] is the first AES_HP_MASK_SIZE octets of the encipherment of
+ * sample[i] (RFC 9001 5.4.3). Samples are gathered AES_ECB_CHUNK at a
+ * time so that their block cipher rounds are applied together.
+ *
+ * @param *aes AES context of the header protection key
+ * @param **sample n pointers to AES_BLOCK_SIZE octet samples
+ * @param *mask output of (n * AES_HP_MASK_SIZE) octets
+ * @param n number of packets
+ *
+ * */
+void aes_ecb_hp_masks(const aes_ctxt *aes, const uint8_t *const *sample, uint8_t *mask, uint32_t n);
+
+/** AES ECB encipher using a thread pool (AES_POOL)
+ *
+ * @param *pool thread pool (may be NULL)
+ * @param *aes AES context
+ * @param *out output buffer
+ * @param *in buffer (may be aligned with *out)
+ * @param size size of *in (octets)
+ *
+ * */
+void aes_ecb_encipher_par(aes_pool *pool, aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t size);
+
+/** AES ECB decipher using a thread pool (AES_POOL)
+ *
+ * @param *pool thread pool (may be NULL)
+ * @param *aes AES context
+ * @param *out output buffer
+ * @param *in buffer (may be aligned with *out)
+ * @param size size of *in (octets)
+ *
+ * */
+void aes_ecb_decipher_par(aes_pool *pool, aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t size);
+
 /** @} */
 
 /** @defgroup mAES/aes/gcm AES GCM
@@ -233,61 +426,1409 @@ void aes_gcm_encipher(
     uint8_t *T,
     int T_size);
 
-/** @} */
+/** AES GCM Decipher after checking the tag
+ *
+ * GHASH over aad and ciphertext is computed and the tag compared before
+ * any deciphering, so rejecting a forged message costs GHASH and two
+ * block cipher calls, and *out is only written for an authentic message.
+ * Costs slightly more than aes_gcm_decipher() for an authentic message as
+ * the ciphertext is read twice.
+ *
+ * Parameters and the return value are the same as aes_gcm_decipher().
+ * *out is unchanged when -1 is returned.
+ *
+ * */
+int aes_gcm_decipher_verified(
 
-/** @defgroup mAES/aes/wrap AES key wrap
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    const uint8_t *T,
+    int T_size);
+
+/** AES GCM Encipher using a thread pool (AES_POOL)
  *
- * Implementation of the NIST AES key wrap specification.
- * 
- * @{ */
+ * Counter mode and GHASH over whole blocks are shared between the pool
+ * participants. Inputs shorter than two units of work are processed by
+ * aes_gcm_encipher().
+ *
+ * @param *pool thread pool (may be NULL)
+ *
+ * Other parameters are the same as aes_gcm_encipher().
+ *
+ * */
+void aes_gcm_encipher_par(
 
-/** Call to initialise AES context prior to using key wrap function
+    aes_pool *pool,
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    uint8_t *T,
+    int T_size);
+
+/** AES GCM Decipher using a thread pool (AES_POOL)
  *
- * @param *aes returned AES key schedule context
- * @param *k key to expand
- * @param k_size size of *k in octets (expected 16, 24 or 32)
+ * @param *pool thread pool (may be NULL)
  *
- * @return 0 success; -1 failure
+ * Other parameters and the return value are the same as
+ * aes_gcm_decipher().
  *
  * */
-int aes_wrap_init(aes_ctxt *aes, const uint8_t *k, int k_size);
+int aes_gcm_decipher_par(
 
+    aes_pool *pool,
+    const aes_ctxt *aes,
 
-/** Wrap input
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    const uint8_t *T,
+    int T_size);
+
+/** GCM multi-buffer request
  *
- * - input must be a multiple of 8 bytes and at least 8 bytes
- * - output buffer must be large enough to accommodate (in_size + 8) bytes
- * - output may be the same memory address as input
- * - iv may be NULL to use the default IV
+ * Fields have the same meaning as the aes_gcm_encipher() and
+ * aes_gcm_decipher() parameters. T is an input when deciphering.
+ *
+ * */
+typedef struct {
+
+    const aes_ctxt *aes;    /**< initialised AES context */
+
+    const uint8_t *IV;      /**< initialisation vector */
+    uint32_t IV_size;       /**< size of *IV (octets) */
+
+    uint8_t *out;           /**< output buffer */
+    const uint8_t *in;      /**< input buffer (may be aligned with *out) */
+    uint32_t size;          /**< size of *in (octets) */
+
+    const uint8_t *aad;     /**< additional authenticated data */
+    uint32_t aad_size;      /**< size of *aad (octets) */
+
+    uint8_t *T;             /**< authentication tag */
+    int T_size;             /**< size of *T (octets) */
+
+    int ret;                /**< returned result: 0 success; -1 failure */
+
+} aes_gcm_req;
+
+/** AES GCM Encipher several independent requests
+ *
+ * Requests are advanced in lockstep so that the block cipher calls of
+ * different requests (which may use different keys) are made together by
+ * aes_encr_multi(). Intended for many short messages.
+ *
+ * @param *req array of requests
+ * @param n number of requests
+ *
+ * */
+void aes_gcm_encipher_multi(aes_gcm_req *req, uint32_t n);
+
+/** AES GCM Decipher several independent requests
+ *
+ * The result of each request is returned in req[i].ret.
+ *
+ * @param *req array of requests
+ * @param n number of requests
+ *
+ * @return 0 all requests succeeded; -1 one or more requests failed
+ *
+ * */
+int aes_gcm_decipher_multi(aes_gcm_req *req, uint32_t n);
+
+/** segment of a scattered buffer (as struct iovec) */
+typedef struct {
+
+    uint8_t *base;          /**< first octet */
+    uint32_t size;          /**< size of segment (octets) */
+
+} aes_iovec;
+
+/** AES GCM Encipher scattered buffers
+ *
+ * The same as aes_gcm_encipher() with in, out and aad each given as a
+ * list of segments of any size. Blocks within a segment are processed in
+ * place; only blocks split between segments are copied. in and out may be
+ * the same list.
+ *
+ * @param *out output segments (at least as many octets as *in)
+ * @param out_n number of output segments
+ * @param *in input segments
+ * @param in_n number of input segments
+ * @param *aad additional authenticated data segments (may be NULL)
+ * @param aad_n number of aad segments
  *
+ * Other parameters are the same as aes_gcm_encipher().
+ *
+ * @return 0 success; -1 out is smaller than in
+ *
+ * */
+int aes_gcm_encipher_iov(
+
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    const aes_iovec *out,
+    uint32_t out_n,
+    const aes_iovec *in,
+    uint32_t in_n,
+
+    const aes_iovec *aad,
+    uint32_t aad_n,
+
+    uint8_t *T,
+    int T_size);
+
+/** AES GCM Decipher scattered buffers
+ *
+ * Parameters are the same as aes_gcm_encipher_iov() and
+ * aes_gcm_decipher().
+ *
+ * @return 0 success; -1 authentication failure, invalid T_size or out is
+ *         smaller than in
+ *
+ * */
+int aes_gcm_decipher_iov(
+
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    const aes_iovec *out,
+    uint32_t out_n,
+    const aes_iovec *in,
+    uint32_t in_n,
+
+    const aes_iovec *aad,
+    uint32_t aad_n,
+
+    const uint8_t *T,
+    int T_size);
+
+/** GHASH state after a constant aad prefix
+ *
+ * Computed once per key and prefix by aes_gcm_prefix_init(); only valid
+ * with the context it was computed with.
+ *
+ * */
+typedef struct {
+
+    uint8_t X[AES_BLOCK_SIZE];  /**< GHASH state */
+    uint32_t size;              /**< size of the prefix (octets) */
+
+} aes_gcm_prefix;
+
+/** Hash a constant aad prefix
+ *
+ * aes_gcm_encipher_prefix() and aes_gcm_decipher_prefix() then give the
+ * same results as aes_gcm_encipher() and aes_gcm_decipher() with the
+ * prefix and their aad concatenated, without hashing the prefix again.
+ *
+ * @param *prefix returned GHASH state
  * @param *aes AES context
- * @param *out output buffer
- * @param *in input buffer
- * @param in_size size of *in (bytes)
- * @param *iv 8 byte IV field (NULL for default)
+ * @param *aad constant leading aad
+ * @param aad_size size of *aad (a multiple of AES_BLOCK_SIZE octets)
+ *
+ * @return 0 success; -1 aad_size is not a multiple of AES_BLOCK_SIZE
  *
- * @return 0 success; -1 failure
- * 
  * */
-int aes_wrap_encipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint16_t in_size, const uint8_t *iv);
+int aes_gcm_prefix_init(aes_gcm_prefix *prefix, const aes_ctxt *aes, const uint8_t *aad, uint32_t aad_size);
 
-/** Unwrap input
- * 
- * - input must be a multiple of 8 bytes and at least 16 bytes
- * - output buffer must be large enough to accommodate (in_size - 8) bytes
- * - output may be the same memory address as input
- * - iv may be NULL to use the default IV
+/** AES GCM Encipher after a hashed aad prefix
  *
  * @param *aes AES context
- * @param *out output buffer
- * @param *in input buffer
- * @param in_size size of *in (bytes)
- * @param *iv 8 byte IV field (NULL for default)
+ * @param *prefix state from aes_gcm_prefix_init() with the same *aes
  *
- * @return 0 success; -1 failure
+ * @param *aad additional data following the prefix
+ * @param aad_size size of *aad (octets)
+ *
+ * Other parameters are the same as aes_gcm_encipher().
  *
  * */
-int aes_wrap_decipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t in_size, const uint8_t *iv);
+void aes_gcm_encipher_prefix(
+
+    const aes_ctxt *aes,
+    const aes_gcm_prefix *prefix,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    uint8_t *T,
+    int T_size);
+
+/** AES GCM Decipher after a hashed aad prefix
+ *
+ * @param *aes AES context
+ * @param *prefix state from aes_gcm_prefix_init() with the same *aes
+ *
+ * @param *aad additional data following the prefix
+ * @param aad_size size of *aad (octets)
+ *
+ * Other parameters and the return value are the same as
+ * aes_gcm_decipher().
+ *
+ * */
+int aes_gcm_decipher_prefix(
+
+    const aes_ctxt *aes,
+    const aes_gcm_prefix *prefix,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    const uint8_t *T,
+    int T_size);
+
+/** AES GCM update part of a sealed message in place
+ *
+ * Replaces the ciphertext of octets offset..(offset + n - 1) of a
+ * message sealed by aes_gcm_encipher() and updates its tag. GHASH is
+ * linear, so only the changed blocks are enciphered and hashed; the cost
+ * does not depend on size or on the aad (which is unchanged).
+ *
+ * WARNING: the new message is sealed with the same IV as the old one.
+ * An adversary who sees two versions of the message learns the XOR of
+ * their plaintexts and can recover the hash subkey and forge messages
+ * for this key. Use only where at most one version of a message can ever
+ * be observed (the old ciphertext and tag are overwritten and never
+ * stored, sent or backed up elsewhere). Otherwise seal the message again
+ * with a new IV.
+ *
+ * @param *aes AES context
+ *
+ * @param *IV initialisation vector the message was sealed with
+ * @param *IV_size size of initialisation vector (octets)
+ *
+ * @param *out ciphertext of the range (replaced with the new ciphertext)
+ * @param *in new plaintext of the range
+ * @param offset position of the range in the message (octets)
+ * @param n size of the range (octets)
+ * @param size size of the whole message (octets)
+ *
+ * @param *T authentication tag of the message (updated)
+ * @param T_size size of *T (0..GCM_TAG_SIZE octets)
+ *
+ * @return 0 success; -1 the range is outside the message or invalid
+ *         T_size
+ *
+ * */
+int aes_gcm_update(
+
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t offset,
+    uint32_t n,
+    uint32_t size,
+
+    uint8_t *T,
+    int T_size);
+
+/** GMAC context
+ *
+ * Key schedule and hash subkey of a GMAC key (GCM with no plaintext).
+ *
+ * */
+typedef struct {
+
+    aes_ctxt aes;               /**< key schedule */
+    uint8_t H[AES_BLOCK_SIZE];  /**< hash subkey (GHASH operand order) */
+
+} aes_gmac_ctxt;
+
+/** Call to initialise a GMAC context
+ *
+ * @param *gmac returned GMAC context
+ * @param *k key to expand
+ * @param k_size size of *k in octets (expected 16, 24 or 32)
+ *
+ * @return 0 success; -1 failure
+ *
+ * */
+int aes_gmac_init(aes_gmac_ctxt *gmac, const uint8_t *k, int k_size);
+
+/** GMAC tag
+ *
+ * The same tag as aes_gcm_encipher() with *in as aad and no plaintext,
+ * without deriving the hash subkey again.
+ *
+ * @param *gmac GMAC context
+ *
+ * @param *IV initialisation vector
+ * @param *IV_size size of initialisation vector (octets)
+ *
+ * @param *in data to authenticate
+ * @param size size of *in (octets)
+ *
+ * @param *T authentication tag output buffer
+ * @param T_size size of *T (0..GCM_TAG_SIZE octets)
+ *
+ * */
+void aes_gmac_tag(
+
+    const aes_gmac_ctxt *gmac,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    const uint8_t *in,
+    uint32_t size,
+
+    uint8_t *T,
+    int T_size);
+
+/** GMAC verify
+ *
+ * @param *gmac GMAC context
+ *
+ * @param *IV initialisation vector
+ * @param *IV_size size of initialisation vector (octets)
+ *
+ * @param *in authenticated data
+ * @param size size of *in (octets)
+ *
+ * @param *T authentication tag input buffer
+ * @param T_size size of *T (0..GCM_TAG_SIZE octets)
+ *
+ * @return 0 tag matches; -1 tag does not match or invalid T_size
+ *
+ * */
+int aes_gmac_verify(
+
+    const aes_gmac_ctxt *gmac,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *T,
+    int T_size);
+
+/** @} */
+
+/** @defgroup mAES/aes/tls TLS 1.3 record protection
+ *
+ * AES-GCM record protection as RFC 8446 section 5.2.
+ *
+ * - each direction keeps its key schedule, hash subkey, static IV and
+ *   sequence number; the per-record nonce is the static IV XOR the
+ *   sequence number
+ * - the additional data is the record header, which is written (seal)
+ *   and checked (open) in the record buffer itself
+ * - records are sealed and opened in place; open checks the tag before
+ *   deciphering
+ * - a key must be replaced (aes_tls_key_init()) before its sequence
+ *   number reaches 2^64 - 1
+ *
+ * A record buffer holds the AES_TLS_HEADER octet header, the content at
+ * offset AES_TLS_HEADER, and then room for the content type, padding and
+ * tag (AES_TLS_OVERHEAD octets in total with the header, plus padding).
+ *
+ * @{ */
+
+/** size of the record header (octets) */
+#define AES_TLS_HEADER          5
+
+/** header, content type and tag (octets) */
+#define AES_TLS_OVERHEAD        (AES_TLS_HEADER + 1 + GCM_TAG_SIZE)
+
+/** largest content and padding of one record (octets) */
+#define AES_TLS_MAX_PLAINTEXT   16384
+
+/** traffic key of one direction */
+typedef struct {
+
+    aes_gmac_ctxt gcm;          /**< key schedule and hash subkey */
+    uint8_t iv[GCM_IV_SIZE];    /**< static IV */
+    uint64_t seq;               /**< sequence number of the next record */
+
+} aes_tls_key;
+
+/** traffic keys of a connection */
+typedef struct {
+
+    aes_tls_key write;          /**< used by aes_tls_seal() */
+    aes_tls_key read;           /**< used by aes_tls_open() */
+
+} aes_tls_ctxt;
+
+/** one record of aes_tls_seal_records() or aes_tls_open_records() */
+typedef struct {
+
+    uint8_t *rec;               /**< record buffer */
+    uint32_t size;              /**< seal: content size; open: record size */
+    uint32_t pad;               /**< seal: padding size */
+    uint8_t type;               /**< content type (returned by open) */
+    int ret;                    /**< returned result of seal or open */
+
+} aes_tls_record;
+
+/** set a traffic key and start its sequence number at zero
+ *
+ * @param *key key of one direction
+ * @param *k traffic key
+ * @param k_size size of *k (16, 24 or 32 octets)
+ * @param *iv static IV (GCM_IV_SIZE octets)
+ *
+ * @return 0 success; -1 invalid k_size
+ *
+ * */
+int aes_tls_key_init(aes_tls_key *key, const uint8_t *k, int k_size, const uint8_t *iv);
+
+/** seal a record in place with the write key
+ *
+ * @param *tls connection
+ * @param *rec record buffer with size octets of content at
+ *        rec + AES_TLS_HEADER and room for (size + pad + AES_TLS_OVERHEAD)
+ *        octets in total
+ * @param size size of content (octets)
+ * @param type content type
+ * @param pad number of zero padding octets
+ *
+ * @return size of the record (octets); -1 if size + pad exceeds
+ *         AES_TLS_MAX_PLAINTEXT or the sequence number is exhausted
+ *
+ * */
+int aes_tls_seal(aes_tls_ctxt *tls, uint8_t *rec, uint32_t size, uint8_t type, uint32_t pad);
+
+/** open a record in place with the read key
+ *
+ * @param *tls connection
+ * @param *rec record (content is returned at rec + AES_TLS_HEADER)
+ * @param rec_size size of *rec (octets)
+ * @param *type returned content type
+ *
+ * @return size of content (octets); -1 if the header, tag or padding is
+ *         invalid (the connection must then be closed)
+ *
+ * */
+int aes_tls_open(aes_tls_ctxt *tls, uint8_t *rec, uint32_t rec_size, uint8_t *type);
+
+/** seal records in order with consecutive sequence numbers
+ *
+ * Stops at the first record which cannot be sealed.
+ *
+ * @param *tls connection
+ * @param *r records (result of each in r[i].ret)
+ * @param n number of records
+ *
+ * @return number of records sealed
+ *
+ * */
+uint32_t aes_tls_seal_records(aes_tls_ctxt *tls, aes_tls_record *r, uint32_t n);
+
+/** open records in order
+ *
+ * Stops at the first record which fails to open.
+ *
+ * @param *tls connection
+ * @param *r records (result of each in r[i].ret)
+ * @param n number of records
+ *
+ * @return number of records opened
+ *
+ * */
+uint32_t aes_tls_open_records(aes_tls_ctxt *tls, aes_tls_record *r, uint32_t n);
+
+/** @} */
+
+/** @defgroup mAES/aes/async Asynchronous jobs
+ *
+ * Offload of mode functions to worker threads.
+ *
+ * - jobs are submitted to a lock-free bounded ring from any thread
+ * - a job with a callback is completed by calling it from a worker thread
+ * - a job without a callback is returned by aes_async_poll() after the
+ *   descriptor from aes_async_fd() becomes readable
+ * - the job and every buffer it refers to must remain valid until it
+ *   completes
+ *
+ * @{ */
+
+/** aes_job operations */
+#define AES_JOB_GCM_ENCIPHER    0   /**< aes_gcm_encipher() */
+#define AES_JOB_GCM_DECIPHER    1   /**< aes_gcm_decipher() */
+#define AES_JOB_ECB_ENCIPHER    2   /**< aes_ecb_encipher() */
+#define AES_JOB_ECB_DECIPHER    3   /**< aes_ecb_decipher() */
+#define AES_JOB_WRAP_ENCIPHER   4   /**< aes_wrap_encipher() */
+#define AES_JOB_WRAP_DECIPHER   5   /**< aes_wrap_decipher() */
+
+/** opaque job engine */
+typedef struct aes_async aes_async;
+
+typedef struct aes_job aes_job;
+
+/** job completion callback */
+typedef void (*aes_job_cb)(aes_job *job);
+
+/** asynchronous job
+ *
+ * Fields not used by op are ignored. Key wrap uses IV as the 8 byte IV
+ * field (NULL for default). T is an input for AES_JOB_GCM_DECIPHER.
+ *
+ * */
+struct aes_job {
+
+    int op;                 /**< AES_JOB_* */
+    aes_ctxt *aes;          /**< initialised AES context */
+
+    const uint8_t *IV;      /**< initialisation vector */
+    uint32_t IV_size;       /**< size of *IV (octets) */
+
+    uint8_t *out;           /**< output buffer */
+    const uint8_t *in;      /**< input buffer (may be aligned with *out) */
+    uint32_t size;          /**< size of *in (octets) */
+
+    const uint8_t *aad;     /**< additional authenticated data */
+    uint32_t aad_size;      /**< size of *aad (octets) */
+
+    uint8_t *T;             /**< authentication tag */
+    int T_size;             /**< size of *T (octets) */
+
+    aes_job_cb cb;          /**< completion callback (NULL to poll) */
+    void *user;             /**< caller data */
+
+    int ret;                /**< returned result of op */
+
+    aes_job *next;          /**< internal */
+};
+
+/** create a job engine
+ *
+ * @param depth submission ring size (rounded up to a power of two)
+ * @param threads number of worker threads (0 for one per online CPU)
+ *
+ * @return job engine; NULL on failure
+ *
+ * */
+aes_async *aes_async_create(uint32_t depth, int threads);
+
+/** stop worker threads and free the engine
+ *
+ * Jobs already submitted are run before the workers stop. Must not be
+ * called while other threads are submitting.
+ *
+ * @param *async job engine (may be NULL)
+ *
+ * */
+void aes_async_destroy(aes_async *async);
+
+/** submit a job
+ *
+ * Never blocks. May be called from any thread.
+ *
+ * @param *async job engine
+ * @param *job job
+ *
+ * @return 0 success; -1 ring is full
+ *
+ * */
+int aes_async_submit(aes_async *async, aes_job *job);
+
+/** descriptor which is readable while completed jobs are waiting
+ *
+ * @param *async job engine
+ *
+ * @return file descriptor (eventfd on Linux)
+ *
+ * */
+int aes_async_fd(const aes_async *async);
+
+/** return completed jobs without callbacks in completion order
+ *
+ * Must only be called from one thread at a time.
+ *
+ * @param *async job engine
+ * @param **jobs returned jobs
+ * @param max size of *jobs
+ *
+ * @return number of jobs returned
+ *
+ * */
+uint32_t aes_async_poll(aes_async *async, aes_job **jobs, uint32_t max);
+
+/** @} */
+
+/** @defgroup mAES/aes/coalesce Request coalescing
+ *
+ * Gathers small requests from many threads and dispatches them together
+ * through the multi-buffer functions.
+ *
+ * - the first caller to arrive collects requests until AES_COALESCE_MAX
+ *   (or the configured maximum) have arrived or the wait budget expires,
+ *   then runs the batch for every caller in it
+ * - other callers block until their request has been run
+ * - the number of requests in each dispatched batch is counted so that
+ *   the budget can be tuned from aes_coalesce_histogram()
+ *
+ * @{ */
+
+/** largest number of requests in one batch */
+#ifndef AES_COALESCE_MAX
+#define AES_COALESCE_MAX    64
+#endif
+
+/** opaque request coalescer */
+typedef struct aes_coalesce aes_coalesce;
+
+/** create a request coalescer
+ *
+ * @param max dispatch when this many requests are waiting
+ *        (1..AES_COALESCE_MAX)
+ * @param wait_us dispatch when the first request has waited this long
+ *        (microseconds)
+ *
+ * @return coalescer; NULL on failure
+ *
+ * */
+aes_coalesce *aes_coalesce_create(uint32_t max, uint32_t wait_us);
+
+/** free a request coalescer
+ *
+ * Must not be called while other threads are using it.
+ *
+ * @param *co coalescer (may be NULL)
+ *
+ * */
+void aes_coalesce_destroy(aes_coalesce *co);
+
+/** encrypt state of AES_BLOCK_SIZE bytes as part of a batch
+ *
+ * Blocks until the batch has been run. Same result as aes_encr().
+ *
+ * @param *co coalescer
+ * @param *aes aes context
+ * @param *s AES_BLOCK_SIZE bytes of state
+ *
+ * */
+void aes_coalesce_encr(aes_coalesce *co, const aes_ctxt *aes, uint8_t *s);
+
+/** AES GCM Encipher as part of a batch
+ *
+ * Blocks until the batch has been run. Parameters are the same as
+ * aes_gcm_encipher().
+ *
+ * */
+void aes_coalesce_gcm_encipher(
+
+    aes_coalesce *co,
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    uint8_t *T,
+    int T_size);
+
+/** AES GCM Decipher as part of a batch
+ *
+ * Blocks until the batch has been run. Parameters and the return value are
+ * the same as aes_gcm_decipher().
+ *
+ * */
+int aes_coalesce_gcm_decipher(
+
+    aes_coalesce *co,
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    const uint8_t *T,
+    int T_size);
+
+/** batch size distribution
+ *
+ * hist[i] is the number of batches dispatched with i requests.
+ *
+ * @param *co coalescer
+ * @param *hist returned (AES_COALESCE_MAX + 1) counters
+ * @param reset non-zero to clear the counters after reading
+ *
+ * */
+void aes_coalesce_histogram(aes_coalesce *co, uint64_t *hist, int reset);
+
+/** @} */
+
+/** @defgroup mAES/aes/stats Statistics
+ *
+ * Counters of library activity, compiled in with AES_STATS.
+ *
+ * - each thread updates its own counters without locked instructions
+ * - counters of threads which have exited are kept
+ * - without AES_STATS the counters compile to nothing and these
+ *   functions are not available
+ *
+ * @{ */
+
+/** statistics snapshot (all counters are totals since start or reset) */
+typedef struct {
+
+    uint64_t blocks_enciphered;     /**< block cipher encryptions */
+    uint64_t blocks_deciphered;     /**< block cipher decryptions */
+    uint64_t ghash_multiplications; /**< GHASH field multiplications */
+    uint64_t key_expansions;        /**< aes_init() calls */
+    uint64_t gcm_tag_failures;      /**< GCM authentication failures */
+    uint64_t wrap_failures;         /**< key unwrap integrity failures */
+    uint64_t ecb_bytes;             /**< octets through ECB */
+    uint64_t gcm_bytes;             /**< octets ciphered by GCM */
+    uint64_t wrap_bytes;            /**< octets into key wrap/unwrap */
+    uint64_t coalesce_batches;      /**< batches dispatched by aes_coalesce */
+    uint64_t coalesce_requests;     /**< requests in those batches */
+
+} aes_stats;
+
+/** take a snapshot of the counters
+ *
+ * @param *stats returned counters
+ * @param reset non-zero to count from zero again after this snapshot
+ *
+ * */
+void aes_stats_snapshot(aes_stats *stats, int reset);
+
+/** render a snapshot in the Prometheus text exposition format
+ *
+ * @param *stats counters
+ * @param *buf output buffer (may be NULL if size is 0)
+ * @param size size of *buf
+ *
+ * @return length of the complete text (excluding the terminator); the
+ *         output is truncated if this is not less than size
+ *
+ * */
+size_t aes_stats_prometheus(const aes_stats *stats, char *buf, size_t size);
+
+/** @} */
+
+/** @defgroup mAES/aes/tune Backend selection
+ *
+ * Times each compiled in implementation of aes_encr() and the GHASH
+ * multiplication used by the GCM functions, and binds the fastest (in the
+ * manner of the Linux RAID6 algorithm selection). Compiled in with
+ * AES_TUNE.
+ *
+ * - aes_encr(): "byte" (default) and "table" (1KiB of 32bit lookups)
+ * - GHASH: "shift" (default, table-less) and "ctmul" (integer multiplies)
+ * - "table" is NOT constant time: its lookups are indexed by key and data
+ *   across 16 cache lines, so an attacker sharing the cache can recover
+ *   the key from timing. Once bound it is used by every aes_encr() caller
+ *   in the process, GCM included. aes_tune() only binds it when compiled
+ *   with AES_TUNE_VARTIME; aes_tune_select() binds it on request
+ * - the multiple block and multi-buffer functions keep the byte oriented
+ *   rounds
+ * - backends are measured without being bound; every backend gives the
+ *   same results so a binding may change while other threads are
+ *   ciphering
+ *
+ * @{ */
+
+/** time spent measuring each backend (microseconds) */
+#ifndef AES_TUNE_US
+#define AES_TUNE_US     60
+#endif
+
+/** aes_tune operations */
+#define AES_TUNE_ENCR   0   /**< aes_encr() */
+#define AES_TUNE_GHASH  1   /**< GHASH multiplication */
+
+/** a backend of one operation */
+typedef struct {
+
+    const char *name;       /**< backend name */
+    uint64_t rate;          /**< octets per second (0 if not measured) */
+    int selected;           /**< non-zero if bound */
+    int vartime;            /**< non-zero if timing depends on key or data */
+
+} aes_tune_result;
+
+/** measure every backend and bind the fastest constant time backend of
+ * each operation (or the fastest of any with AES_TUNE_VARTIME)
+ *
+ * @param budget_us time spent measuring each backend (microseconds);
+ *        0 for AES_TUNE_US
+ *
+ * */
+void aes_tune(uint32_t budget_us);
+
+/** list the backends of an operation
+ *
+ * @param op AES_TUNE_*
+ * @param *res returned backends (in order of preference when equal)
+ * @param max size of *res
+ *
+ * @return number of backends of op (may be more than max)
+ *
+ * */
+uint32_t aes_tune_results(int op, aes_tune_result *res, uint32_t max);
+
+/** bind a backend by name
+ *
+ * @param op AES_TUNE_*
+ * @param *name backend name
+ *
+ * @return 0 on success; -1 if op has no such backend
+ *
+ * */
+int aes_tune_select(int op, const char *name);
+
+/** @} */
+
+/** @defgroup mAES/aes/arena Context arena
+ *
+ * Allocator of cache line aligned context slots.
+ *
+ * - each slot starts on an AES_ARENA_LINE boundary and is padded to a
+ *   multiple of it so contexts never share a line with other data
+ * - each thread allocates from and frees to its own list of slots without
+ *   locking; slabs are only taken from the arena under a lock
+ * - a new slab is zeroed by the thread that takes it, so with first touch
+ *   placement its pages are on that thread's NUMA node
+ * - slots are zeroed when freed, so a slot is zero when allocated
+ * - slots freed by a thread that exits go back to the arena
+ *
+ * @{ */
+
+/** slot alignment and padding (cache line size) */
+#ifndef AES_ARENA_LINE
+#define AES_ARENA_LINE  64
+#endif
+
+/** default number of slots in a slab */
+#ifndef AES_ARENA_SLAB
+#define AES_ARENA_SLAB  64
+#endif
+
+/** opaque context arena */
+typedef struct aes_arena aes_arena;
+
+/** create a context arena
+ *
+ * @param slot_size size of each slot (octets); 0 for sizeof(aes_ctxt)
+ * @param slab_slots slots taken from the system at a time;
+ *        0 for AES_ARENA_SLAB
+ *
+ * @return arena; NULL on failure
+ *
+ * */
+aes_arena *aes_arena_create(size_t slot_size, uint32_t slab_slots);
+
+/** free a context arena and every slot in it
+ *
+ * Must not be called while other threads are using it.
+ *
+ * @param *arena arena (may be NULL)
+ *
+ * */
+void aes_arena_destroy(aes_arena *arena);
+
+/** allocate a zeroed slot
+ *
+ * @param *arena arena
+ *
+ * @return slot; NULL if out of memory
+ *
+ * */
+void *aes_arena_alloc(aes_arena *arena);
+
+/** clear and free a slot
+ *
+ * May be called from any thread.
+ *
+ * @param *arena arena the slot came from
+ * @param *slot slot (may be NULL)
+ *
+ * */
+void aes_arena_free(aes_arena *arena, void *slot);
+
+/** @} */
+
+/** @defgroup mAES/aes/store Context store
+ *
+ * Expanded contexts written to a file once and mapped read-only at start
+ * up, so that contexts are used from the mapping without aes_init().
+ *
+ * File format (version AES_STORE_VERSION, host byte order):
+ *
+ * - 64 octet header: magic "mAESstr", version, byte order mark,
+ *   sizeof(aes_ctxt), record stride, record count and a CRC-32 of the
+ *   header
+ * - count records sorted by id, each an aes_ctxt, a CRC-32 of the
+ *   context and id, and the 64bit id, padded to a multiple of 64 octets
+ *
+ * A file is only accepted by a build with the same aes_ctxt layout and
+ * byte order. Each record is checked the first time it is looked up; the
+ * whole file can be checked when it is opened instead.
+ *
+ * @{ */
+
+/** file format version */
+#define AES_STORE_VERSION   1
+
+/** aes_store_open() flags */
+#define AES_STORE_VERIFY    1   /**< check every record when opening */
+
+/** a key to precompute */
+typedef struct {
+
+    uint64_t id;            /**< caller's identifier (unique) */
+    const uint8_t *k;       /**< key */
+    int k_size;             /**< size of key (octets) */
+
+} aes_store_key;
+
+/** opaque mapped store */
+typedef struct aes_store aes_store;
+
+/** expand keys and write them to a store file
+ *
+ * The file is written to a temporary file beside path (mode 0600), synced
+ * and renamed into place, and the directory is then synced.
+ *
+ * @param *path file name
+ * @param *keys keys to expand
+ * @param n number of keys
+ *
+ * @return 0 on success; -1 on failure (including a repeated id or
+ *         invalid k_size)
+ *
+ * */
+int aes_store_write(const char *path, const aes_store_key *keys, uint32_t n);
+
+/** map a store file read-only
+ *
+ * @param *path file name
+ * @param flags AES_STORE_*
+ *
+ * @return store; NULL if the file cannot be mapped or fails a check
+ *
+ * */
+aes_store *aes_store_open(const char *path, int flags);
+
+/** unmap a store
+ *
+ * Contexts from the store must no longer be used.
+ *
+ * @param *store store (may be NULL)
+ *
+ * */
+void aes_store_close(aes_store *store);
+
+/** number of contexts in a store */
+uint32_t aes_store_count(const aes_store *store);
+
+/** find the context of an id
+ *
+ * @param *store store
+ * @param id identifier given to aes_store_write()
+ *
+ * @return context in the mapping; NULL if id is not present or its
+ *         record fails the check
+ *
+ * */
+const aes_ctxt *aes_store_get(const aes_store *store, uint64_t id);
+
+/** @} */
+
+/** @defgroup mAES/aes/keycache Key schedule cache
+ *
+ * Sessions keep only their raw key (aes_key) and borrow an expanded
+ * aes_ctxt from a bounded cache when they need one.
+ *
+ * - the cache is split into shards with their own lock, hash table and
+ *   least recently used list
+ * - a borrowed context is pinned until it is returned with
+ *   aes_keycache_put() and is not evicted while pinned
+ * - schedules are cleared when the cache is destroyed
+ * - the GCM hash subkey is derived per call from the context so there is
+ *   nothing else to cache
+ *
+ * @{ */
+
+/** default number of shards */
+#ifndef AES_KEYCACHE_SHARDS
+#define AES_KEYCACHE_SHARDS 16
+#endif
+
+/** compact key of a session (33 octets instead of sizeof(aes_ctxt)) */
+typedef struct {
+
+    uint8_t k[AES256_KEY_SIZE]; /**< raw key */
+    uint8_t k_size;             /**< size of key (octets) */
+
+} aes_key;
+
+/** opaque key schedule cache */
+typedef struct aes_keycache aes_keycache;
+
+/** cache counters */
+typedef struct {
+
+    uint64_t hits;          /**< aes_keycache_get() found the schedule */
+    uint64_t misses;        /**< aes_keycache_get() expanded the schedule */
+    uint64_t evictions;     /**< schedules dropped to make room */
+    uint64_t full;          /**< aes_keycache_get() failed as all were pinned */
+    uint32_t entries;       /**< schedules held now */
+    uint32_t capacity;      /**< schedules the cache can hold */
+
+} aes_keycache_stats;
+
+/** initialise a compact key
+ *
+ * @param *key key
+ * @param *k pointer to key
+ * @param k_size size of *k in bytes (16, 24 or 32)
+ *
+ * @return 0 on success; -1 if k_size is not valid
+ *
+ * */
+int aes_key_init(aes_key *key, const uint8_t *k, int k_size);
+
+/** create a key schedule cache
+ *
+ * @param entries schedules to hold (shared evenly between the shards)
+ * @param shards number of shards (rounded up to a power of two);
+ *        0 for AES_KEYCACHE_SHARDS
+ *
+ * @return cache; NULL on failure
+ *
+ * */
+aes_keycache *aes_keycache_create(uint32_t entries, uint32_t shards);
+
+/** free a key schedule cache
+ *
+ * Must not be called while contexts are borrowed.
+ *
+ * @param *kc cache (may be NULL)
+ *
+ * */
+void aes_keycache_destroy(aes_keycache *kc);
+
+/** borrow the expanded context of a key
+ *
+ * @param *kc cache
+ * @param *key key
+ *
+ * @return context valid until aes_keycache_put(); NULL if every
+ *         schedule in the shard of key is pinned
+ *
+ * */
+const aes_ctxt *aes_keycache_get(aes_keycache *kc, const aes_key *key);
+
+/** return a borrowed context
+ *
+ * @param *kc cache
+ * @param *aes context from aes_keycache_get()
+ *
+ * */
+void aes_keycache_put(aes_keycache *kc, const aes_ctxt *aes);
+
+/** read the cache counters
+ *
+ * @param *kc cache
+ * @param *stats returned counters
+ * @param reset non-zero to clear the event counters after reading
+ *
+ * */
+void aes_keycache_stats_get(aes_keycache *kc, aes_keycache_stats *stats, int reset);
+
+/** @} */
+
+/** @defgroup mAES/aes/rotate Key rotation
+ *
+ * A key which can be replaced while other threads are using it.
+ *
+ * - readers bracket their use of the context with aes_rotate_enter() and
+ *   aes_rotate_exit(), which take no lock and never wait
+ * - aes_rotate_key() expands the new key into the spare of two contexts
+ *   and publishes it with an atomic pointer store
+ * - the replaced context becomes the spare once every reader that could
+ *   have seen it has left (epoch based reclamation)
+ *
+ * @{ */
+
+/** aes_rotate_key() flags */
+#define AES_ROTATE_NOWAIT   1   /**< fail instead of waiting for readers */
+
+/** opaque rotating key */
+typedef struct aes_rotate aes_rotate;
+
+/** create a rotating key
+ *
+ * @param *k pointer to first key
+ * @param k_size size of *k in bytes (16, 24 or 32)
+ *
+ * @return rotating key; NULL on failure
+ *
+ * */
+aes_rotate *aes_rotate_create(const uint8_t *k, int k_size);
+
+/** free a rotating key and clear both contexts
+ *
+ * Must not be called while there are readers.
+ *
+ * @param *rot rotating key (may be NULL)
+ *
+ * */
+void aes_rotate_destroy(aes_rotate *rot);
+
+/** start using the current context
+ *
+ * Calls may be nested; the context returned stays valid until the
+ * outermost aes_rotate_exit() of this thread.
+ *
+ * @param *rot rotating key
+ *
+ * @return current context; NULL if the thread could not be registered
+ *
+ * */
+const aes_ctxt *aes_rotate_enter(aes_rotate *rot);
+
+/** stop using the context returned by aes_rotate_enter()
+ *
+ * @param *rot rotating key
+ *
+ * */
+void aes_rotate_exit(aes_rotate *rot);
+
+/** replace the key
+ *
+ * Waits (yielding) until readers of the context replaced by the previous
+ * call have left, unless AES_ROTATE_NOWAIT is given. Must not be called
+ * between aes_rotate_enter() and aes_rotate_exit() on the same thread.
+ *
+ * @param *rot rotating key
+ * @param *k pointer to new key
+ * @param k_size size of *k in bytes (16, 24 or 32)
+ * @param flags AES_ROTATE_*
+ *
+ * @return 0 on success; -1 if k_size is not valid or (with
+ *         AES_ROTATE_NOWAIT) the spare context still has readers
+ *
+ * */
+int aes_rotate_key(aes_rotate *rot, const uint8_t *k, int k_size, int flags);
+
+/** @} */
+
+/** @defgroup mAES/aes/wrap AES key wrap
+ *
+ * Implementation of the NIST AES key wrap specification (RFC 3394) and
+ * key wrap with padding (RFC 5649).
+ *
+ * Batch functions advance several independent wraps under the same key
+ * in lockstep so that their block cipher calls can be interleaved.
+ * 
+ * @{ */
+
+/** key wrap batch request */
+typedef struct {
+
+    uint8_t *out;           /**< output buffer */
+    const uint8_t *in;      /**< input buffer (may be the same as *out) */
+    uint32_t in_size;       /**< size of *in (bytes) */
+    uint32_t out_size;      /**< returned size of *out (bytes) */
+    int ret;                /**< returned result: 0 success; -1 failure */
+
+} aes_wrap_req;
+
+/** Call to initialise AES context prior to using key wrap function
+ *
+ * @param *aes returned AES key schedule context
+ * @param *k key to expand
+ * @param k_size size of *k in octets (expected 16, 24 or 32)
+ *
+ * @return 0 success; -1 failure
+ *
+ * */
+int aes_wrap_init(aes_ctxt *aes, const uint8_t *k, int k_size);
+
+
+/** Wrap input
+ *
+ * - input must be a multiple of 8 bytes and at least 8 bytes
+ * - output buffer must be large enough to accommodate (in_size + 8) bytes
+ * - output may be the same memory address as input
+ * - iv may be NULL to use the default IV
+ *
+ * @param *aes AES context
+ * @param *out output buffer
+ * @param *in input buffer
+ * @param in_size size of *in (bytes)
+ * @param *iv 8 byte IV field (NULL for default)
+ *
+ * @return 0 success; -1 failure
+ * 
+ * */
+int aes_wrap_encipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t in_size, const uint8_t *iv);
+
+/** Unwrap input
+ * 
+ * - input must be a multiple of 8 bytes and at least 16 bytes
+ * - output buffer must be large enough to accommodate (in_size - 8) bytes
+ * - output may be the same memory address as input
+ * - iv may be NULL to use the default IV
+ *
+ * @param *aes AES context
+ * @param *out output buffer
+ * @param *in input buffer
+ * @param in_size size of *in (bytes)
+ * @param *iv 8 byte IV field (NULL for default)
+ *
+ * @return 0 success; -1 failure
+ *
+ * */
+int aes_wrap_decipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t in_size, const uint8_t *iv);
+
+/** Wrap a batch of inputs under the same key
+ *
+ * Each request follows the rules of aes_wrap_encipher(). The result of
+ * each request is returned in req[i].ret and req[i].out_size.
+ *
+ * @param *aes AES context
+ * @param *req array of requests
+ * @param n number of requests
+ * @param *iv 8 byte IV field (NULL for default)
+ *
+ * @return 0 all requests succeeded; -1 one or more requests failed
+ *
+ * */
+int aes_wrap_encipher_batch(aes_ctxt *aes, aes_wrap_req *req, uint32_t n, const uint8_t *iv);
+
+/** Unwrap a batch of inputs under the same key
+ *
+ * Each request follows the rules of aes_wrap_decipher(). The result of
+ * each request is returned in req[i].ret and req[i].out_size.
+ *
+ * @param *aes AES context
+ * @param *req array of requests
+ * @param n number of requests
+ * @param *iv 8 byte IV field (NULL for default)
+ *
+ * @return 0 all requests succeeded; -1 one or more requests failed
+ *
+ * */
+int aes_wrap_decipher_batch(aes_ctxt *aes, aes_wrap_req *req, uint32_t n, const uint8_t *iv);
+
+/** Wrap input with padding (RFC 5649)
+ *
+ * - input may be any size of at least 1 byte
+ * - output buffer must be large enough to accommodate (in_size + 8) bytes
+ *   rounded up to a multiple of 8 bytes
+ * - output may be the same memory address as input
+ *
+ * @param *aes AES context
+ * @param *out output buffer
+ * @param *in input buffer
+ * @param in_size size of *in (bytes)
+ *
+ * @return 0 success; -1 failure
+ *
+ * */
+int aes_kwp_encipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t in_size);
+
+/** Unwrap input with padding (RFC 5649)
+ *
+ * - input must be a multiple of 8 bytes and at least 16 bytes
+ * - output buffer must be large enough to accommodate (in_size - 8) bytes
+ * - output may be the same memory address as input
+ *
+ * @param *aes AES context
+ * @param *out output buffer
+ * @param *in input buffer
+ * @param in_size size of *in (bytes)
+ * @param *out_size returned size of unpadded *out (bytes); may be NULL
+ *
+ * @return 0 success; -1 failure
+ *
+ * */
+int aes_kwp_decipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t in_size, uint32_t *out_size);
+
+/** Wrap a batch of inputs with padding under the same key
+ *
+ * Each request follows the rules of aes_kwp_encipher().
+ *
+ * @param *aes AES context
+ * @param *req array of requests
+ * @param n number of requests
+ *
+ * @return 0 all requests succeeded; -1 one or more requests failed
+ *
+ * */
+int aes_kwp_encipher_batch(aes_ctxt *aes, aes_wrap_req *req, uint32_t n);
+
+/** Unwrap a batch of inputs with padding under the same key
+ *
+ * Each request follows the rules of aes_kwp_decipher().
+ *
+ * @param *aes AES context
+ * @param *req array of requests
+ * @param n number of requests
+ *
+ * @return 0 all requests succeeded; -1 one or more requests failed
+ *
+ * */
+int aes_kwp_decipher_batch(aes_ctxt *aes, aes_wrap_req *req, uint32_t n);
 
 /** @} */
 
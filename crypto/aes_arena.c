@@ -0,0 +1,299 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+#include "aes.h"
+#include "common.c"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+/* free slot; the link is in the slot itself */
+typedef struct arena_slot {
+
+    struct arena_slot *next;
+
+} arena_slot;
+
+/* slab header, in a separate allocation so that slots stay aligned */
+typedef struct arena_slab {
+
+    struct arena_slab *next;
+    void *mem;
+
+} arena_slab;
+
+/* slots owned by one thread */
+typedef struct arena_heap {
+
+    aes_arena *arena;
+    arena_slot *free;
+
+    struct arena_heap *next;
+    struct arena_heap *prev;
+
+} arena_heap;
+
+struct aes_arena {
+
+    size_t slot_size;       /* multiple of AES_ARENA_LINE */
+    uint32_t slab_slots;
+    size_t page;
+
+    pthread_key_t key;      /* this thread's arena_heap */
+
+    pthread_mutex_t mutex;  /* protects the fields below */
+    arena_slab *slabs;
+    arena_heap *heaps;      /* heaps of live threads */
+    arena_slot *free;       /* slots left by threads which have exited */
+};
+
+/* link a list of free slots into the arena */
+static void arena_release(aes_arena *arena, arena_slot *list)
+{
+    arena_slot *last;
+
+    if(!list)
+        return;
+
+    for(last = list; last->next; last = last->next);
+
+    last->next = arena->free;
+    arena->free = list;
+}
+
+/* thread exit */
+static void arena_heap_exit(void *arg)
+{
+    arena_heap *heap = (arena_heap *)arg;
+    aes_arena *arena = heap->arena;
+
+    pthread_mutex_lock(&arena->mutex);
+
+    arena_release(arena, heap->free);
+
+    if(heap->prev)
+        heap->prev->next = heap->next;
+    else
+        arena->heaps = heap->next;
+
+    if(heap->next)
+        heap->next->prev = heap->prev;
+
+    pthread_mutex_unlock(&arena->mutex);
+
+    free(heap);
+}
+
+static arena_heap *arena_heap_get(aes_arena *arena)
+{
+    arena_heap *heap;
+
+    if((heap = (arena_heap *)pthread_getspecific(arena->key)))
+        return heap;
+
+    if(!(heap = calloc(1, sizeof(*heap))))
+        return NULL;
+
+    heap->arena = arena;
+
+    if(pthread_setspecific(arena->key, heap)){
+
+        free(heap);
+        return NULL;
+    }
+
+    pthread_mutex_lock(&arena->mutex);
+
+    heap->next = arena->heaps;
+
+    if(arena->heaps)
+        arena->heaps->prev = heap;
+
+    arena->heaps = heap;
+
+    pthread_mutex_unlock(&arena->mutex);
+
+    return heap;
+}
+
+/* refill an empty heap from the arena or a new slab */
+static int arena_refill(aes_arena *arena, arena_heap *heap)
+{
+    arena_slab *slab;
+    arena_slot *slot;
+    uint8_t *p;
+    size_t size = arena->slot_size * arena->slab_slots;
+    void *mem;
+    uint32_t i;
+
+    pthread_mutex_lock(&arena->mutex);
+
+    if(arena->free){
+
+        heap->free = arena->free;
+        arena->free = NULL;
+
+        pthread_mutex_unlock(&arena->mutex);
+
+        return 0;
+    }
+
+    pthread_mutex_unlock(&arena->mutex);
+
+    /* whole pages so that slabs of different threads do not share one */
+    size = ((size + arena->page - 1) / arena->page) * arena->page;
+
+    if(!(slab = malloc(sizeof(*slab))))
+        return -1;
+
+    if(posix_memalign(&mem, arena->page, size)){
+
+        free(slab);
+        return -1;
+    }
+
+    /* first touch by this thread */
+    MEMSET(mem, 0x0, size);
+
+    for(i = arena->slab_slots, p = (uint8_t *)mem + (arena->slot_size * (i - 1)); i; i--, p -= arena->slot_size){
+
+        slot = (arena_slot *)p;
+        slot->next = heap->free;
+        heap->free = slot;
+    }
+
+    slab->mem = mem;
+
+    pthread_mutex_lock(&arena->mutex);
+
+    slab->next = arena->slabs;
+    arena->slabs = slab;
+
+    pthread_mutex_unlock(&arena->mutex);
+
+    return 0;
+}
+
+aes_arena *aes_arena_create(size_t slot_size, uint32_t slab_slots)
+{
+    aes_arena *arena;
+    long page;
+
+    if(!slot_size)
+        slot_size = sizeof(aes_ctxt);
+
+    if(!slab_slots)
+        slab_slots = AES_ARENA_SLAB;
+
+    if(!(arena = calloc(1, sizeof(*arena))))
+        return NULL;
+
+    if(pthread_key_create(&arena->key, arena_heap_exit)){
+
+        free(arena);
+        return NULL;
+    }
+
+    page = sysconf(_SC_PAGESIZE);
+
+    arena->slot_size = ((slot_size + AES_ARENA_LINE - 1) / AES_ARENA_LINE) * AES_ARENA_LINE;
+    arena->slab_slots = slab_slots;
+    arena->page = (page >= AES_ARENA_LINE) ? page : AES_ARENA_LINE;
+
+    pthread_mutex_init(&arena->mutex, NULL);
+
+    return arena;
+}
+
+void aes_arena_destroy(aes_arena *arena)
+{
+    arena_slab *slab;
+    arena_heap *heap;
+
+    if(!arena)
+        return;
+
+    pthread_key_delete(arena->key);
+
+    while((heap = arena->heaps)){
+
+        arena->heaps = heap->next;
+        free(heap);
+    }
+
+    while((slab = arena->slabs)){
+
+        arena->slabs = slab->next;
+
+        MEMSET(slab->mem, 0x0, arena->slot_size * arena->slab_slots);
+        free(slab->mem);
+        free(slab);
+    }
+
+    pthread_mutex_destroy(&arena->mutex);
+    free(arena);
+}
+
+void *aes_arena_alloc(aes_arena *arena)
+{
+    arena_heap *heap;
+    arena_slot *slot;
+
+    if(!(heap = arena_heap_get(arena)))
+        return NULL;
+
+    if(!heap->free && arena_refill(arena, heap))
+        return NULL;
+
+    slot = heap->free;
+    heap->free = slot->next;
+    slot->next = NULL;
+
+    return slot;
+}
+
+void aes_arena_free(aes_arena *arena, void *slot)
+{
+    arena_heap *heap;
+    arena_slot *s = (arena_slot *)slot;
+
+    if(!slot)
+        return;
+
+    MEMSET(slot, 0x0, arena->slot_size);
+
+    /* without a heap the slot goes straight back to the arena */
+    if(!(heap = arena_heap_get(arena))){
+
+        pthread_mutex_lock(&arena->mutex);
+
+        s->next = arena->free;
+        arena->free = s;
+
+        pthread_mutex_unlock(&arena->mutex);
+
+        return;
+    }
+
+    s->next = heap->free;
+    heap->free = s;
+}
@@ -0,0 +1,405 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+#include "aes.h"
+#include "common.c"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sched.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#ifdef __linux__
+#include <sys/eventfd.h>
+#endif
+
+/* cache line size assumed for padding */
+#ifndef AES_ASYNC_LINE
+#define AES_ASYNC_LINE 64
+#endif
+
+/* submission ring cell
+ *
+ * seq == position: free for the producer claiming position
+ * seq == position + 1: holds a job for the consumer claiming position
+ *
+ * */
+typedef struct {
+
+    uint64_t seq;
+    aes_job *job;
+
+} async_cell;
+
+struct aes_async {
+
+    /* producer position */
+    uint64_t head;
+    uint8_t pad0[AES_ASYNC_LINE - sizeof(uint64_t)];
+
+    /* consumer position */
+    uint64_t tail;
+    uint8_t pad1[AES_ASYNC_LINE - sizeof(uint64_t)];
+
+    /* completed jobs waiting for aes_async_poll() (newest first) */
+    aes_job *done;
+    uint8_t pad2[AES_ASYNC_LINE - sizeof(aes_job *)];
+
+    async_cell *ring;
+    uint64_t mask;
+
+    /* completed jobs taken from done but not yet returned (oldest first) */
+    aes_job *reaped;
+
+    sem_t work;         /* one count per submitted job */
+    int stop;
+
+    int fd[2];          /* completion notification (read, write) */
+
+    int threads;
+    pthread_t *thread;
+};
+
+/* claim a slot and publish job; -1 if the ring is full */
+static int async_push(aes_async *async, aes_job *job)
+{
+    async_cell *cell;
+    uint64_t pos, seq;
+    int64_t diff;
+
+    pos = __atomic_load_n(&async->head, __ATOMIC_RELAXED);
+
+    while(1){
+
+        cell = &async->ring[pos & async->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        diff = (int64_t)(seq - pos);
+
+        if(!diff){
+
+            if(__atomic_compare_exchange_n(&async->head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if(diff < 0){
+
+            return -1;
+        }
+        else{
+
+            pos = __atomic_load_n(&async->head, __ATOMIC_RELAXED);
+        }
+    }
+
+    cell->job = job;
+    __atomic_store_n(&cell->seq, pos + 1, __ATOMIC_RELEASE);
+
+    return 0;
+}
+
+/* take the oldest published job; NULL if there is none */
+static aes_job *async_pop(aes_async *async)
+{
+    async_cell *cell;
+    uint64_t pos, seq;
+    int64_t diff;
+    aes_job *job;
+
+    pos = __atomic_load_n(&async->tail, __ATOMIC_RELAXED);
+
+    while(1){
+
+        cell = &async->ring[pos & async->mask];
+        seq = __atomic_load_n(&cell->seq, __ATOMIC_ACQUIRE);
+        diff = (int64_t)(seq - (pos + 1));
+
+        if(!diff){
+
+            if(__atomic_compare_exchange_n(&async->tail, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+                break;
+        }
+        else if(diff < 0){
+
+            return NULL;
+        }
+        else{
+
+            pos = __atomic_load_n(&async->tail, __ATOMIC_RELAXED);
+        }
+    }
+
+    job = cell->job;
+    __atomic_store_n(&cell->seq, pos + async->mask + 1, __ATOMIC_RELEASE);
+
+    return job;
+}
+
+static void async_signal(aes_async *async)
+{
+#ifdef __linux__
+    uint64_t one = 1;
+
+    (void)!write(async->fd[1], &one, sizeof(one));
+#else
+    uint8_t one = 1;
+
+    (void)!write(async->fd[1], &one, sizeof(one));
+#endif
+}
+
+static void async_clear(aes_async *async)
+{
+    uint8_t buf[64];
+
+    while(read(async->fd[0], buf, sizeof(buf)) > 0);
+}
+
+static void async_run(aes_job *job)
+{
+    job->ret = -1;
+
+    switch(job->op){
+#ifdef AES_GCM
+    case AES_JOB_GCM_ENCIPHER:
+        aes_gcm_encipher(job->aes, job->IV, job->IV_size, job->out, job->in, job->size, job->aad, job->aad_size, job->T, job->T_size);
+        job->ret = 0;
+        break;
+    case AES_JOB_GCM_DECIPHER:
+        job->ret = aes_gcm_decipher(job->aes, job->IV, job->IV_size, job->out, job->in, job->size, job->aad, job->aad_size, job->T, job->T_size);
+        break;
+#endif
+#ifdef AES_ECB
+    case AES_JOB_ECB_ENCIPHER:
+        aes_ecb_encipher(job->aes, job->out, job->in, job->size);
+        job->ret = 0;
+        break;
+    case AES_JOB_ECB_DECIPHER:
+        aes_ecb_decipher(job->aes, job->out, job->in, job->size);
+        job->ret = 0;
+        break;
+#endif
+#ifdef AES_WRAP
+    case AES_JOB_WRAP_ENCIPHER:
+        job->ret = aes_wrap_encipher(job->aes, job->out, job->in, job->size, job->IV);
+        break;
+    case AES_JOB_WRAP_DECIPHER:
+        job->ret = aes_wrap_decipher(job->aes, job->out, job->in, job->size, job->IV);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+static void *async_thread(void *arg)
+{
+    aes_async *async = (aes_async *)arg;
+    aes_job *job, *head;
+
+    while(1){
+
+        while(sem_wait(&async->work) && (errno == EINTR));
+
+        /* a producer may have claimed an earlier slot without publishing */
+        while(!(job = async_pop(async))){
+
+            if(__atomic_load_n(&async->stop, __ATOMIC_ACQUIRE))
+                return NULL;
+
+            sched_yield();
+        }
+
+        async_run(job);
+
+        if(job->cb){
+
+            job->cb(job);
+        }
+        else{
+
+            head = __atomic_load_n(&async->done, __ATOMIC_RELAXED);
+
+            do{
+
+                job->next = head;
+            }
+            while(!__atomic_compare_exchange_n(&async->done, &head, job, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+            async_signal(async);
+        }
+    }
+}
+
+aes_async *aes_async_create(uint32_t depth, int threads)
+{
+    aes_async *async;
+    void *mem;
+    uint64_t size;
+    int i;
+
+    if(threads <= 0){
+
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+        if(threads <= 0)
+            threads = 1;
+    }
+
+    /* round up to a power of two */
+    for(size = 2; size < depth; size <<= 1);
+
+    if(posix_memalign(&mem, AES_ASYNC_LINE, sizeof(*async)))
+        return NULL;
+
+    async = (aes_async *)mem;
+    MEMSET(async, 0x0, sizeof(*async));
+
+    async->mask = size - 1;
+
+    if(!(async->ring = calloc(size, sizeof(async_cell))))
+        goto fail_ring;
+
+    for(i=0; i < size; i++)
+        async->ring[i].seq = i;
+
+    if(!(async->thread = calloc(threads, sizeof(pthread_t))))
+        goto fail_thread;
+
+    if(sem_init(&async->work, 0, 0))
+        goto fail_sem;
+
+#ifdef __linux__
+    if((async->fd[0] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) < 0)
+        goto fail_fd;
+
+    async->fd[1] = async->fd[0];
+#else
+    if(pipe(async->fd))
+        goto fail_fd;
+
+    fcntl(async->fd[0], F_SETFL, fcntl(async->fd[0], F_GETFL) | O_NONBLOCK);
+    fcntl(async->fd[1], F_SETFL, fcntl(async->fd[1], F_GETFL) | O_NONBLOCK);
+#endif
+
+    for(i=0; i < threads; i++){
+
+        if(pthread_create(&async->thread[i], NULL, async_thread, async))
+            break;
+
+        async->threads++;
+    }
+
+    if(async->threads)
+        return async;
+
+    close(async->fd[0]);
+
+    if(async->fd[1] != async->fd[0])
+        close(async->fd[1]);
+
+fail_fd:
+    sem_destroy(&async->work);
+fail_sem:
+    free(async->thread);
+fail_thread:
+    free(async->ring);
+fail_ring:
+    free(async);
+
+    return NULL;
+}
+
+void aes_async_destroy(aes_async *async)
+{
+    int i;
+
+    if(!async)
+        return;
+
+    __atomic_store_n(&async->stop, 1, __ATOMIC_RELEASE);
+
+    for(i=0; i < async->threads; i++)
+        sem_post(&async->work);
+
+    for(i=0; i < async->threads; i++)
+        pthread_join(async->thread[i], NULL);
+
+    close(async->fd[0]);
+
+    if(async->fd[1] != async->fd[0])
+        close(async->fd[1]);
+
+    sem_destroy(&async->work);
+    free(async->thread);
+    free(async->ring);
+    free(async);
+}
+
+int aes_async_submit(aes_async *async, aes_job *job)
+{
+    if(async_push(async, job))
+        return -1;
+
+    sem_post(&async->work);
+
+    return 0;
+}
+
+int aes_async_fd(const aes_async *async)
+{
+    return async->fd[0];
+}
+
+uint32_t aes_async_poll(aes_async *async, aes_job **jobs, uint32_t max)
+{
+    aes_job *list, *job;
+    uint32_t n = 0;
+
+    async_clear(async);
+
+    if(!async->reaped){
+
+        list = __atomic_exchange_n(&async->done, NULL, __ATOMIC_ACQUIRE);
+
+        /* reverse into completion order */
+        while(list){
+
+            job = list;
+            list = list->next;
+            job->next = async->reaped;
+            async->reaped = job;
+        }
+    }
+
+    while(async->reaped && (n < max)){
+
+        jobs[n++] = async->reaped;
+        async->reaped = async->reaped->next;
+    }
+
+    /* keep the descriptor readable while jobs remain */
+    if(async->reaped || __atomic_load_n(&async->done, __ATOMIC_RELAXED))
+        async_signal(async);
+
+    return n;
+}
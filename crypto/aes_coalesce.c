@@ -0,0 +1,332 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+#include "aes.h"
+#include "common.c"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+
+/* coalesce_req operations */
+#define COALESCE_ENCR           0
+#define COALESCE_GCM_ENCIPHER   1
+#define COALESCE_GCM_DECIPHER   2
+
+typedef struct {
+
+    int op;
+
+    /* COALESCE_ENCR */
+    const aes_ctxt *aes;
+    uint8_t *s;
+
+    /* COALESCE_GCM_* */
+    aes_gcm_req gcm;
+
+    int done;
+
+} coalesce_req;
+
+struct aes_coalesce {
+
+    pthread_mutex_t mutex;
+    pthread_cond_t full;    /* pending has reached max */
+    pthread_cond_t done;    /* a batch was taken or completed */
+
+    uint32_t max;
+    uint32_t wait_us;
+
+    int leader;             /* a caller is collecting pending */
+    uint32_t count;
+    coalesce_req *pending[AES_COALESCE_MAX];
+
+    uint64_t hist[AES_COALESCE_MAX + 1];
+};
+
+/* run a batch outside of the lock */
+static void coalesce_run(coalesce_req **batch, uint32_t n)
+{
+    const aes_ctxt *key[AES_COALESCE_MAX];
+    uint8_t s[AES_COALESCE_MAX][AES_BLOCK_SIZE];
+#ifdef AES_GCM
+    aes_gcm_req gcm[AES_COALESCE_MAX];
+    int mode;
+#endif
+    uint32_t i, m;
+
+    for(i=0, m=0; i < n; i++){
+
+        if(batch[i]->op == COALESCE_ENCR){
+
+            key[m] = batch[i]->aes;
+            MEMCPY(s[m++], batch[i]->s, AES_BLOCK_SIZE);
+        }
+    }
+
+    if(m){
+
+        aes_encr_multi(key, (uint8_t *)s, m);
+
+        for(i=0, m=0; i < n; i++){
+
+            if(batch[i]->op == COALESCE_ENCR)
+                MEMCPY(batch[i]->s, s[m++], AES_BLOCK_SIZE);
+        }
+    }
+
+#ifdef AES_GCM
+    for(mode = COALESCE_GCM_ENCIPHER; mode <= COALESCE_GCM_DECIPHER; mode++){
+
+        for(i=0, m=0; i < n; i++){
+
+            if(batch[i]->op == mode)
+                gcm[m++] = batch[i]->gcm;
+        }
+
+        if(!m)
+            continue;
+
+        if(mode == COALESCE_GCM_ENCIPHER)
+            aes_gcm_encipher_multi(gcm, m);
+        else
+            aes_gcm_decipher_multi(gcm, m);
+
+        for(i=0, m=0; i < n; i++){
+
+            if(batch[i]->op == mode)
+                batch[i]->gcm.ret = gcm[m++].ret;
+        }
+    }
+#endif
+}
+
+/* add req to the pending batch and return once it has been run */
+static void coalesce_submit(aes_coalesce *co, coalesce_req *req)
+{
+    coalesce_req *batch[AES_COALESCE_MAX];
+    struct timespec deadline;
+    uint32_t i, n;
+
+    req->done = 0;
+
+    pthread_mutex_lock(&co->mutex);
+
+    /* the pending batch is full but not yet taken by its leader */
+    while(co->count == co->max)
+        pthread_cond_wait(&co->done, &co->mutex);
+
+    co->pending[co->count++] = req;
+
+    if(co->leader){
+
+        if(co->count == co->max)
+            pthread_cond_signal(&co->full);
+
+        while(!req->done)
+            pthread_cond_wait(&co->done, &co->mutex);
+
+        pthread_mutex_unlock(&co->mutex);
+        return;
+    }
+
+    co->leader = 1;
+
+    if(co->wait_us && (co->count < co->max)){
+
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+        deadline.tv_sec += co->wait_us / 1000000;
+        deadline.tv_nsec += (long)(co->wait_us % 1000000) * 1000;
+
+        if(deadline.tv_nsec >= 1000000000){
+
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+
+        while((co->count < co->max) && (pthread_cond_timedwait(&co->full, &co->mutex, &deadline) != ETIMEDOUT));
+    }
+
+    n = co->count;
+
+    for(i=0; i < n; i++)
+        batch[i] = co->pending[i];
+
+    co->count = 0;
+    co->leader = 0;
+    co->hist[n]++;
+
+    AES_STAT_ADD(coalesce_batches, 1);
+    AES_STAT_ADD(coalesce_requests, n);
+
+    /* let callers waiting for space start the next batch */
+    pthread_cond_broadcast(&co->done);
+    pthread_mutex_unlock(&co->mutex);
+
+    coalesce_run(batch, n);
+
+    pthread_mutex_lock(&co->mutex);
+
+    for(i=0; i < n; i++)
+        batch[i]->done = 1;
+
+    pthread_cond_broadcast(&co->done);
+    pthread_mutex_unlock(&co->mutex);
+}
+
+aes_coalesce *aes_coalesce_create(uint32_t max, uint32_t wait_us)
+{
+    aes_coalesce *co;
+    pthread_condattr_t attr;
+
+    if(!max || (max > AES_COALESCE_MAX))
+        return NULL;
+
+    if(!(co = calloc(1, sizeof(*co))))
+        return NULL;
+
+    co->max = max;
+    co->wait_us = wait_us;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+
+    pthread_mutex_init(&co->mutex, NULL);
+    pthread_cond_init(&co->full, &attr);
+    pthread_cond_init(&co->done, NULL);
+
+    pthread_condattr_destroy(&attr);
+
+    return co;
+}
+
+void aes_coalesce_destroy(aes_coalesce *co)
+{
+    if(!co)
+        return;
+
+    pthread_cond_destroy(&co->done);
+    pthread_cond_destroy(&co->full);
+    pthread_mutex_destroy(&co->mutex);
+
+    free(co);
+}
+
+void aes_coalesce_encr(aes_coalesce *co, const aes_ctxt *aes, uint8_t *s)
+{
+    coalesce_req req;
+
+    req.op = COALESCE_ENCR;
+    req.aes = aes;
+    req.s = s;
+
+    coalesce_submit(co, &req);
+}
+
+#ifdef AES_GCM
+
+void aes_coalesce_gcm_encipher(
+
+    aes_coalesce *co,
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    uint8_t *T,
+    int T_size)
+{
+    coalesce_req req;
+
+    req.op = COALESCE_GCM_ENCIPHER;
+    req.gcm.aes = aes;
+    req.gcm.IV = IV;
+    req.gcm.IV_size = IV_size;
+    req.gcm.out = out;
+    req.gcm.in = in;
+    req.gcm.size = size;
+    req.gcm.aad = aad;
+    req.gcm.aad_size = aad_size;
+    req.gcm.T = T;
+    req.gcm.T_size = T_size;
+
+    coalesce_submit(co, &req);
+}
+
+int aes_coalesce_gcm_decipher(
+
+    aes_coalesce *co,
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    const uint8_t *T,
+    int T_size)
+{
+    coalesce_req req;
+
+    req.op = COALESCE_GCM_DECIPHER;
+    req.gcm.aes = aes;
+    req.gcm.IV = IV;
+    req.gcm.IV_size = IV_size;
+    req.gcm.out = out;
+    req.gcm.in = in;
+    req.gcm.size = size;
+    req.gcm.aad = aad;
+    req.gcm.aad_size = aad_size;
+    req.gcm.T = (uint8_t *)T;
+    req.gcm.T_size = T_size;
+
+    coalesce_submit(co, &req);
+
+    return req.gcm.ret;
+}
+
+#endif
+
+void aes_coalesce_histogram(aes_coalesce *co, uint64_t *hist, int reset)
+{
+    pthread_mutex_lock(&co->mutex);
+
+    MEMCPY(hist, co->hist, sizeof(co->hist));
+
+    if(reset)
+        MEMSET(co->hist, 0x0, sizeof(co->hist));
+
+    pthread_mutex_unlock(&co->mutex);
+}
@@ -22,49 +22,217 @@
 #include "aes.h"
 #include "common.c"
 
+/* blocks passed to aes_encr_blocks() per call */
+#ifndef AES_ECB_CHUNK
+#define AES_ECB_CHUNK 8
+#endif
+
+/* smallest input (octets) for which streaming stores are used */
+#ifndef AES_ECB_STREAM_MIN
+#define AES_ECB_STREAM_MIN 0x100000
+#endif
+
+/* prefetch distance (octets) ahead of the input read pointer */
+#ifndef AES_ECB_PREFETCH
+#define AES_ECB_PREFETCH 512
+#endif
+
+#if defined(AES_ECB_STREAM) && defined(__SSE2__)
+#include <emmintrin.h>
+#define ECB_STREAM
+#endif
+
 int aes_ecb_init(aes_ctxt *aes, const uint8_t *k, int k_size)
 {
     return aes_init(aes, k, k_size);
 }
 
-void aes_ecb_encipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t size)
+#ifdef ECB_STREAM
+
+/* cipher n whole blocks through a local buffer, prefetching *in and
+ * writing *out (16 byte aligned) with non-temporal stores */
+static void ecb_stream(aes_ctxt *aes, int decr, uint8_t *out, const uint8_t *in, uint32_t n)
 {
-    uint8_t s[AES_BLOCK_SIZE];
+    union {
 
-    while(1){
+        uint8_t b[AES_ECB_CHUNK * AES_BLOCK_SIZE];
+        __m128i v[AES_ECB_CHUNK];
 
-        xor128((__word_t *)s, (__word_t *)s);
+    } buf;
+    uint32_t c, i;
 
-        MEMCPY(s, in, (size > sizeof(s))?sizeof(s):size);
-        aes_encr(aes, s);
-        MEMCPY(out, s, (size > sizeof(s))?sizeof(s):size);
-    
-        if(size <= sizeof(s))
-            return;
-
-        size -= sizeof(s);
-        in += sizeof(s);
-        out += sizeof(s);
+    while(n){
+
+        c = (n < AES_ECB_CHUNK) ? n : AES_ECB_CHUNK;
+
+        __builtin_prefetch(in + AES_ECB_PREFETCH, 0, 0);
+
+        MEMCPY(buf.b, in, c * AES_BLOCK_SIZE);
+
+        if(decr)
+            aes_decr_blocks(aes, buf.b, c);
+        else
+            aes_encr_blocks(aes, buf.b, c);
+
+        for(i=0; i < c; i++)
+            _mm_stream_si128(((__m128i *)out) + i, buf.v[i]);
+
+        n -= c;
+        in += c * AES_BLOCK_SIZE;
+        out += c * AES_BLOCK_SIZE;
     }
+
+    _mm_sfence();
+
+    MEMSET(buf.b, 0x0, sizeof(buf.b));
 }
 
-void aes_ecb_decipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t size)
+#endif
+
+/* cipher n whole blocks in place in *out */
+static void ecb_blocks(aes_ctxt *aes, int decr, uint8_t *out, const uint8_t *in, uint32_t n)
+{
+    uint32_t c;
+
+#ifdef ECB_STREAM
+    if((n >= (AES_ECB_STREAM_MIN / AES_BLOCK_SIZE)) && !(((uintptr_t)out) & (AES_BLOCK_SIZE - 1))){
+
+        ecb_stream(aes, decr, out, in, n);
+        return;
+    }
+#endif
+
+    while(n){
+
+        c = (n < AES_ECB_CHUNK) ? n : AES_ECB_CHUNK;
+
+        if(out != in)
+            MEMCPY(out, in, c * AES_BLOCK_SIZE);
+
+        if(decr)
+            aes_decr_blocks(aes, out, c);
+        else
+            aes_encr_blocks(aes, out, c);
+
+        n -= c;
+        in += c * AES_BLOCK_SIZE;
+        out += c * AES_BLOCK_SIZE;
+    }
+}
+
+/* cipher a trailing incomplete block with zero padding */
+static void ecb_partial(aes_ctxt *aes, int decr, uint8_t *out, const uint8_t *in, uint32_t size)
 {
     uint8_t s[AES_BLOCK_SIZE];
 
-    while(1){
+    xor128((__word_t *)s, (__word_t *)s);
 
-        xor128((__word_t *)s, (__word_t *)s);
+    MEMCPY(s, in, size);
 
-        MEMCPY(s, in, (size > sizeof(s))?sizeof(s):size);
+    if(decr)
         aes_decr(aes, s);
-        MEMCPY(out, s, (size > sizeof(s))?sizeof(s):size);
-    
-        if(size <= sizeof(s))
-            return;
-
-        size -= sizeof(s);
-        in += sizeof(s);
-        out += sizeof(s);
+    else
+        aes_encr(aes, s);
+
+    MEMCPY(out, s, size);
+}
+
+void aes_ecb_encipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t size)
+{
+    uint32_t n = size / AES_BLOCK_SIZE;
+
+    AES_STAT_ADD(ecb_bytes, size);
+    AES_PROBE2("ecb_encipher_entry", size, KEY_BITS(aes));
+
+    ecb_blocks(aes, 0, out, in, n);
+
+    if(size % AES_BLOCK_SIZE)
+        ecb_partial(aes, 0, out + (n * AES_BLOCK_SIZE), in + (n * AES_BLOCK_SIZE), size % AES_BLOCK_SIZE);
+
+    AES_PROBE1("ecb_encipher_return", size);
+}
+
+void aes_ecb_decipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t size)
+{
+    uint32_t n = size / AES_BLOCK_SIZE;
+
+    AES_STAT_ADD(ecb_bytes, size);
+
+    ecb_blocks(aes, 1, out, in, n);
+
+    if(size % AES_BLOCK_SIZE)
+        ecb_partial(aes, 1, out + (n * AES_BLOCK_SIZE), in + (n * AES_BLOCK_SIZE), size % AES_BLOCK_SIZE);
+}
+
+void aes_ecb_hp_masks(const aes_ctxt *aes, const uint8_t *const *sample, uint8_t *mask, uint32_t n)
+{
+    uint8_t b[AES_ECB_CHUNK * AES_BLOCK_SIZE];
+    uint32_t c, i;
+
+    AES_STAT_ADD(ecb_bytes, n * AES_BLOCK_SIZE);
+
+    while(n){
+
+        c = (n < AES_ECB_CHUNK) ? n : AES_ECB_CHUNK;
+
+        for(i=0; i < c; i++)
+            MEMCPY(b + (i * AES_BLOCK_SIZE), sample[i], AES_BLOCK_SIZE);
+
+        aes_encr_blocks(aes, b, c);
+
+        for(i=0; i < c; i++)
+            MEMCPY(mask + (i * AES_HP_MASK_SIZE), b + (i * AES_BLOCK_SIZE), AES_HP_MASK_SIZE);
+
+        n -= c;
+        sample += c;
+        mask += c * AES_HP_MASK_SIZE;
     }
 }
+
+#ifdef AES_POOL
+
+typedef struct {
+
+    aes_ctxt *aes;
+    int decr;
+    uint8_t *out;
+    const uint8_t *in;
+
+} ecb_par_job;
+
+static void ecb_par_chunk(void *arg, uint32_t first, uint32_t count)
+{
+    ecb_par_job *job = (ecb_par_job *)arg;
+
+    ecb_blocks(job->aes, job->decr, job->out + (first * AES_BLOCK_SIZE), job->in + (first * AES_BLOCK_SIZE), count);
+}
+
+static void ecb_par(aes_pool *pool, aes_ctxt *aes, int decr, uint8_t *out, const uint8_t *in, uint32_t size)
+{
+    ecb_par_job job;
+    uint32_t n = size / AES_BLOCK_SIZE;
+
+    AES_STAT_ADD(ecb_bytes, size);
+
+    job.aes = aes;
+    job.decr = decr;
+    job.out = out;
+    job.in = in;
+
+    aes_pool_for(pool, n, AES_POOL_GRAIN, ecb_par_chunk, &job);
+
+    if(size % AES_BLOCK_SIZE)
+        ecb_partial(aes, decr, out + (n * AES_BLOCK_SIZE), in + (n * AES_BLOCK_SIZE), size % AES_BLOCK_SIZE);
+}
+
+void aes_ecb_encipher_par(aes_pool *pool, aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t size)
+{
+    ecb_par(pool, aes, 0, out, in, size);
+}
+
+void aes_ecb_decipher_par(aes_pool *pool, aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t size)
+{
+    ecb_par(pool, aes, 1, out, in, size);
+}
+
+#endif
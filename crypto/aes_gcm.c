@@ -1,401 +1,1809 @@
-/* Copyright (c) 2013 Cameron Harper
- * 
- * Permission is hereby granted, free of charge, to any person obtaining a copy of
- * this software and associated documentation files (the "Software"), to deal in
- * the Software without restriction, including without limitation the rights to
- * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
- * the Software, and to permit persons to whom the Software is furnished to do so,
- * subject to the following conditions:
- * 
- * The above copyright notice and this permission notice shall be included in all
- * copies or substantial portions of the Software.
- * 
- * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
- * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
- * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
- * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
- * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
- * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
- *
- * */
-#include "aes.h"
-#include "common.c"
-
-static const uint8_t counter_init[] =
-    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
-
-inline static __word_t swapw(__word_t w)
-{
-#if __WORD_SIZE == 1    
-    return w;
-#elif __WORD_SIZE == 2
-    return ((w >> 8) & 0xff) | ((w << 8) & 0xff00);    
-#elif __WORD_SIZE == 4
-    return  ((w << 24) & 0xff000000)    |
-            ((w <<  8) & 0xff0000)      |
-            ((w >>  8) & 0xff00)        |
-            ((w >> 24) & 0xff);
-#else
-    return  ((w << 56) & 0xff00000000000000)    |
-            ((w << 40) & 0xff000000000000)      |
-            ((w << 24) & 0xff0000000000)        |
-            ((w <<  8) & 0xff00000000)          |
-            ((w >>  8) & 0xff000000)            |
-            ((w >> 24) & 0xff0000)              |
-            ((w >> 40) & 0xff00)                |
-            ((w >> 56) & 0xff);            
-#endif
-}
-
-#if __LITTLE_ENDIAN
-
-#define R   0xe1
-
-#if __WORD_SIZE == 1
-#define TST_MSB 0x01
-#define LSB 0x80
-#elif __WORD_SIZE == 2
-#define TST_MSB 0x0100
-#define LSB 0x8000
-#elif __WORD_SIZE == 4
-#define TST_MSB 0x01000000
-#define LSB 0x80000000
-#else
-#define TST_MSB 0x0100000000000000
-#define LSB 0x8000000000000000
-#endif
-
-#else
-
-#define TST_MSB 0x01
-
-#if __WORD_SIZE == 1
-#define R 0xe1
-#define LSB 0x80
-#elif __WORD_SIZE == 2
-#define R 0xe100
-#define LSB 0x8000
-#elif __WORD_SIZE == 4
-#define R 0xe1000000
-#define LSB 0x80000000
-#else
-#define R 0xe100000000000000
-#define LSB 0x8000000000000000
-#endif
-
-#endif
-
-/* Table-less galois multiplication in a 128bit field
- *
- * XX = XX . YY
- *
- * algorithm:
- * 
- * Z <- 0, V <- X
- * for i to 127 do
- *   if Yi == 1 then
- *     Z <- Z XOR V
- *   end if
- *   if V127 = 0 then
- *     V <- rightshift(V)
- *   else
- *     V <- rightshit(V) XOR R
- *   end if
- * end for
- * return Z
- * 
- * */
-static void galois_mul128(__word_t *XX, const __word_t *YY)
-{
-    __word_t ZZ[WORD_BLOCK];
-    __word_t VV[WORD_BLOCK];
-    __word_t y, t, tt, vmsb, carry;
-
-    int i, j, k;
-    
-    xor128(ZZ, ZZ);
-    copy128(VV, XX);
-
-    for(i=0; i < WORD_BLOCK; i++){
-
-        y = YY[i];
-
-        for(j=0; j < (sizeof(y)*8); j++){
-
-            if(y & LSB)
-                xor128(ZZ, VV);
-            
-            /* MSbit of vector */
-            vmsb = VV[WORD_BLOCK-1] & TST_MSB;
-            carry = 0x0;
-            
-            /* rightshift vector */
-            for(k=0; k < WORD_BLOCK; k++){
-
-                t = VV[k];        
-#if __LITTLE_ENDIAN
-                t = swapw(t);        
-#endif
-                tt = t;
-                tt >>= 1;
-                tt |= carry;
-#if __LITTLE_ENDIAN
-                tt = swapw(tt);        
-#endif        
-                carry = (t & 0x1)?LSB:0x0;
-                VV[k] = tt;
-            }
-
-            if(vmsb)
-                VV[0] ^= R;                
-            
-            y <<= 1;            
-        }
-    }
-
-    copy128(XX, ZZ);
-}
-
-/* Increment the counter */
-static void increment(uint8_t *counter)
-{
-    if(++(counter[AES_BLOCK_SIZE-1]))
-        return;
-    if(++(counter[AES_BLOCK_SIZE-2]))
-        return;
-    if(++(counter[AES_BLOCK_SIZE-3]))
-        return;
-    counter[AES_BLOCK_SIZE-4]++;        
-}
-
-
-/* Internal GCM
- *
- * mode:
- * 0: Encipher Mode
- * 1: Decipher Mode
- * 2: GHASH mode
- *
- * *aes AES key schedule context
- * *IV initialisation vector
- * IV_size size of *IV in bytes
- * mode function mode
- * *out cipher output buffer
- * *in cipher input buffer
- * size size of *in or *out in bytes
- * *aad additional non-ciphered data for authentication
- * aad_size size of *aad
- * *XX GMAC output
- * 
- * */
-static void gcm(    
-
-    const aes_ctxt *aes,
-
-    const uint8_t *IV,
-    uint32_t IV_size,
-
-    int mode,
-
-    uint8_t *out, const uint8_t *in, uint32_t size,
-    const uint8_t *aad, uint32_t aad_size,
-
-    __word_t *XX)     
-{
-    __word_t icount[WORD_BLOCK];
-    __word_t tcount[WORD_BLOCK];
-    __word_t count[WORD_BLOCK];
-
-    __word_t part[WORD_BLOCK];
-    __word_t HH[WORD_BLOCK];
-    uint8_t sz[AES_BLOCK_SIZE];
-
-    /* only implementation error within this file would cause this */
-    if(mode > 2)
-        return;
-
-    /* generate the hash subkey */
-    xor128(HH, HH);
-    aes_encr(aes, (uint8_t *)HH);
-#if __LITTLE_ENDIAN
-    int i;
-    for(i=0; i < WORD_BLOCK; i++)
-        HH[i] = swapw(HH[i]);
-#endif
-
-    /* GHASH mode does not need an IV */
-    if(mode != 2){
-
-        if(IV_size == GCM_IV_SIZE){
-
-            MEMCPY(icount, counter_init, sizeof(icount));
-            MEMCPY(icount, IV, GCM_IV_SIZE);
-        }
-        /* GHASH(H, {}, IV) */
-        else{
-
-            gcm(aes, NULL, 0, 2, NULL, IV, IV_size, NULL, 0, icount);            
-        }
-
-        copy128(count, icount);
-    }
-
-    /* create zero block */
-    xor128(XX, XX);
-
-    /* [aad_size]64 || [size]64 */
-    sz[0] = 0x0;
-    sz[1] = 0x0;
-    sz[2] = 0x0;
-    sz[3] = aad_size >> (32-3); /* (x8 bits) */   
-    sz[4] = aad_size >> (24-3);
-    sz[5] = aad_size >> (16-3); 
-    sz[6] = aad_size >> (8-3);
-    sz[7] = aad_size << 3;
-    sz[8] = 0x0;
-    sz[9] = 0x0;
-    sz[10] = 0x0;
-    sz[11] = size >> (32-3);
-    sz[12] = size >> (24-3);
-    sz[13] = size >> (16-3);
-    sz[14] = size >> (8-3);
-    sz[15] = size << 3; 
-    
-    if(aad_size){
-
-        while(1){
-
-            xor128(part, part);
-            MEMCPY(part, aad, ((aad_size < sizeof(part))?aad_size:sizeof(part)));
-
-            xor128(XX, part);
-            galois_mul128(XX, HH);
-
-            if(aad_size <= sizeof(part))
-                break;
-
-            aad += sizeof(part);
-            aad_size -= sizeof(part);
-        }
-    }
-        
-    if(size){
-
-        while(1){
-
-            if(mode != 2){
-                increment((uint8_t *)count);
-                copy128(tcount, count);
-                aes_encr(aes, (uint8_t *)tcount);  
-            }
-
-            xor128(part, part);
-            MEMCPY(part, in, ((size < sizeof(part))?size:sizeof(part)));
-            
-            /* deciphering or hashing */
-            if((mode == 1) || (mode == 2)){
-
-                xor128(XX, part);
-                galois_mul128(XX, HH);
-            }
-
-            /* deciphering or enciphering */
-            if(mode != 2){
-                xor128(part, tcount);
-                MEMCPY(out, part, (size < sizeof(part))?size:sizeof(part));
-            }
-
-            /* enciphering */
-            if(mode == 0){
-
-                /* zero garbage in unused block portion */
-                if(size < sizeof(part)){
-                    MEMSET(((uint8_t *)part) + size, 0x0, sizeof(part) - size);
-                }
-
-                xor128(XX, part);
-                galois_mul128(XX, HH);
-            }
-            
-            if(size <= sizeof(part))
-                break;
-
-            in += sizeof(part);
-            out += sizeof(part);
-            size -= sizeof(part);
-        }
-    }
-
-    /* GHASH output with size */
-    xor128(XX, (__word_t *)sz);
-    galois_mul128(XX, HH);
-
-    /* XOR initial counter with GHASH output */
-    if(mode != 2){
-        aes_encr(aes, (uint8_t *)icount);  
-        xor128(XX, icount);
-    }
-
-    xor128(HH, HH);    
-}
-    
-void aes_gcm_encipher(
-
-    const aes_ctxt *aes,
-
-    const uint8_t *IV,
-    uint32_t IV_size,
-
-    uint8_t *out,
-    const uint8_t *in,
-    uint32_t size,
-
-    const uint8_t *aad,
-    uint32_t aad_size,
-
-    uint8_t *T,
-    int T_size)
-{
-    __word_t XX[WORD_BLOCK];
-
-    gcm(aes, IV, IV_size, 0, out, in, size, aad, aad_size, XX);
-
-    if(T){
-        MEMCPY(T, XX, (T_size < GCM_TAG_SIZE)?T_size:GCM_TAG_SIZE);
-    }
-}
-
-int aes_gcm_decipher(
-
-    const aes_ctxt *aes,
-    
-    const uint8_t *IV,
-    uint32_t IV_size,
-
-    uint8_t *out,
-    const uint8_t *in,
-    uint32_t size,
-
-    const uint8_t *aad,
-    uint32_t aad_size,
-
-    const uint8_t *T,
-    int T_size)
-{
-    __word_t XX[WORD_BLOCK];
-
-    if(T_size > GCM_TAG_SIZE)
-        return -1;
-
-    gcm(aes, IV, IV_size, 1, out, in, size, aad, aad_size, XX);
-
-    if(MEMCMP(XX, T, T_size))
-        return -1;
-
-    return 0;
-}
-
-int aes_gcm_init(aes_ctxt *aes, const uint8_t *k, int k_size)
-{
-    return aes_init(aes, k, k_size);
-}
+/* Copyright (c) 2013 Cameron Harper
+ * 
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+#include "aes.h"
+#include "common.c"
+
+static const uint8_t counter_init[] =
+    {0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1};
+
+inline static __word_t swapw(__word_t w)
+{
+#if __WORD_SIZE == 1    
+    return w;
+#elif __WORD_SIZE == 2
+    return ((w >> 8) & 0xff) | ((w << 8) & 0xff00);    
+#elif __WORD_SIZE == 4
+    return  ((w << 24) & 0xff000000)    |
+            ((w <<  8) & 0xff0000)      |
+            ((w >>  8) & 0xff00)        |
+            ((w >> 24) & 0xff);
+#elif __WORD_SIZE == 8
+    return  ((w << 56) & 0xff00000000000000)    |
+            ((w << 40) & 0xff000000000000)      |
+            ((w << 24) & 0xff0000000000)        |
+            ((w <<  8) & 0xff00000000)          |
+            ((w >>  8) & 0xff000000)            |
+            ((w >> 24) & 0xff0000)              |
+            ((w >> 40) & 0xff00)                |
+            ((w >> 56) & 0xff);            
+#else
+    typedef uint8_t v16 __attribute__((__vector_size__(16)));
+#if defined(__clang__)
+    return (__word_t)__builtin_shufflevector((v16)w, (v16)w, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+#else
+    return (__word_t)__builtin_shuffle((v16)w, (v16){15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0});
+#endif
+#endif
+}
+
+#if __LITTLE_ENDIAN
+
+#define R   0xe1
+
+#if __WORD_SIZE == 1
+#define TST_MSB 0x01
+#define LSB 0x80
+#elif __WORD_SIZE == 2
+#define TST_MSB 0x0100
+#define LSB 0x8000
+#elif __WORD_SIZE == 4
+#define TST_MSB 0x01000000
+#define LSB 0x80000000
+#else
+#define TST_MSB 0x0100000000000000
+#define LSB 0x8000000000000000
+#endif
+
+#else
+
+#define TST_MSB 0x01
+
+#if __WORD_SIZE == 1
+#define R 0xe1
+#define LSB 0x80
+#elif __WORD_SIZE == 2
+#define R 0xe100
+#define LSB 0x8000
+#elif __WORD_SIZE == 4
+#define R 0xe1000000
+#define LSB 0x80000000
+#else
+#define R 0xe100000000000000
+#define LSB 0x8000000000000000
+#endif
+
+#endif
+
+/* Table-less galois multiplication in a 128bit field
+ *
+ * XX = XX . YY
+ *
+ * algorithm:
+ * 
+ * Z <- 0, V <- X
+ * for i to 127 do
+ *   if Yi == 1 then
+ *     Z <- Z XOR V
+ *   end if
+ *   if V127 = 0 then
+ *     V <- rightshift(V)
+ *   else
+ *     V <- rightshit(V) XOR R
+ *   end if
+ * end for
+ * return Z
+ * 
+ * */
+#if __WORD_SIZE == 16
+
+/* lanes of a 128bit value in big endian integer form */
+#if __LITTLE_ENDIAN
+#define HI 1
+#define LO 0
+#else
+#define HI 0
+#define LO 1
+#endif
+
+/* galois_mul128_shift() for a single vector word
+ *
+ * V is held as a big endian integer so that the field right shift is a
+ * lane shift with a carry between lanes. Z is accumulated with a mask
+ * instead of a branch.
+ *
+ * */
+static void galois_mul128_shift(__word_t *XX, const __word_t *YY)
+{
+    __word_t ZZ, VV, carry;
+    uint64_t y, m;
+    int i, j;
+
+    AES_STAT_ADD(ghash_multiplications, 1);
+
+    ZZ = XX[0] ^ XX[0];
+    carry = ZZ;
+
+#if __LITTLE_ENDIAN
+    VV = swapw(XX[0]);
+#else
+    VV = XX[0];
+#endif
+
+    for(i=0; i < 2; i++){
+
+        y = YY[0][i ? LO : HI];
+
+        for(j=0; j < 64; j++, y <<= 1){
+
+            m = (uint64_t)0 - (y >> 63);
+            carry[0] = m;
+            carry[1] = m;
+            ZZ ^= VV & carry;
+
+            /* rightshift vector, reduce if a bit falls off */
+            m = (uint64_t)0 - (VV[LO] & 0x1);
+            carry[LO] = VV[HI] << 63;
+            carry[HI] = m & 0xe100000000000000;
+            VV = (VV >> 1) ^ carry;
+        }
+    }
+
+#if __LITTLE_ENDIAN
+    XX[0] = swapw(ZZ);
+#else
+    XX[0] = ZZ;
+#endif
+}
+
+#undef HI
+#undef LO
+
+#else
+
+static void galois_mul128_shift(__word_t *XX, const __word_t *YY)
+{
+    __word_t ZZ[WORD_BLOCK];
+    __word_t VV[WORD_BLOCK];
+    __word_t y, t, tt, vmsb, carry;
+
+    int i, j, k;
+
+    AES_STAT_ADD(ghash_multiplications, 1);
+    
+    xor128(ZZ, ZZ);
+    copy128(VV, XX);
+
+    for(i=0; i < WORD_BLOCK; i++){
+
+        y = YY[i];
+
+        for(j=0; j < (sizeof(y)*8); j++){
+
+            if(y & LSB)
+                xor128(ZZ, VV);
+            
+            /* MSbit of vector */
+            vmsb = VV[WORD_BLOCK-1] & TST_MSB;
+            carry = 0x0;
+            
+            /* rightshift vector */
+            for(k=0; k < WORD_BLOCK; k++){
+
+                t = VV[k];        
+#if __LITTLE_ENDIAN
+                t = swapw(t);        
+#endif
+                tt = t;
+                tt >>= 1;
+                tt |= carry;
+#if __LITTLE_ENDIAN
+                tt = swapw(tt);        
+#endif        
+                carry = (t & 0x1)?LSB:0x0;
+                VV[k] = tt;
+            }
+
+            if(vmsb)
+                VV[0] ^= R;                
+            
+            y <<= 1;            
+        }
+    }
+
+    copy128(XX, ZZ);
+}
+
+#endif
+
+#ifdef AES_TUNE
+
+/* carry-less 64x64 multiply (low half) with integer multiplies
+ *
+ * Every fourth bit is kept so that the carries of the integer products
+ * fall into the holes and are masked off afterwards.
+ *
+ * */
+static uint64_t bmul64(uint64_t x, uint64_t y)
+{
+    uint64_t x0, x1, x2, x3, y0, y1, y2, y3, z0, z1, z2, z3;
+
+    x0 = x & 0x1111111111111111;
+    x1 = x & 0x2222222222222222;
+    x2 = x & 0x4444444444444444;
+    x3 = x & 0x8888888888888888;
+    y0 = y & 0x1111111111111111;
+    y1 = y & 0x2222222222222222;
+    y2 = y & 0x4444444444444444;
+    y3 = y & 0x8888888888888888;
+
+    z0 = (x0 * y0) ^ (x1 * y3) ^ (x2 * y2) ^ (x3 * y1);
+    z1 = (x0 * y1) ^ (x1 * y0) ^ (x2 * y3) ^ (x3 * y2);
+    z2 = (x0 * y2) ^ (x1 * y1) ^ (x2 * y0) ^ (x3 * y3);
+    z3 = (x0 * y3) ^ (x1 * y2) ^ (x2 * y1) ^ (x3 * y0);
+
+    return  (z0 & 0x1111111111111111) |
+            (z1 & 0x2222222222222222) |
+            (z2 & 0x4444444444444444) |
+            (z3 & 0x8888888888888888);
+}
+
+/* bit reversal of a 64bit value */
+static uint64_t rev64(uint64_t x)
+{
+    x = ((x & 0x5555555555555555) << 1) | ((x >> 1) & 0x5555555555555555);
+    x = ((x & 0x3333333333333333) << 2) | ((x >> 2) & 0x3333333333333333);
+    x = ((x & 0x0f0f0f0f0f0f0f0f) << 4) | ((x >> 4) & 0x0f0f0f0f0f0f0f0f);
+    x = ((x & 0x00ff00ff00ff00ff) << 8) | ((x >> 8) & 0x00ff00ff00ff00ff);
+    x = ((x & 0x0000ffff0000ffff) << 16) | ((x >> 16) & 0x0000ffff0000ffff);
+
+    return (x << 32) | (x >> 32);
+}
+
+static uint64_t load64(const uint8_t *b)
+{
+    uint64_t w = 0;
+    int i;
+
+    for(i=0; i < 8; i++)
+        w = (w << 8) | b[i];
+
+    return w;
+}
+
+static void store64(uint8_t *b, uint64_t w)
+{
+    int i;
+
+    for(i=7; i >= 0; i--, w >>= 8)
+        b[i] = w;
+}
+
+/* Constant time galois multiplication with integer multiplies
+ *
+ * Karatsuba over three 64bit carry-less products; the upper halves come
+ * from the products of the bit reversed operands. Same operands and result
+ * as galois_mul128_shift().
+ *
+ * */
+static void galois_mul128_ctmul(__word_t *XX, const __word_t *YY)
+{
+    __word_t HH[WORD_BLOCK];
+    uint64_t y0, y1, y2, y0r, y1r, y2r;
+    uint64_t h0, h1, h2, h0r, h1r, h2r;
+    uint64_t z0, z1, z2, z0h, z1h, z2h;
+    uint64_t v0, v1, v2, v3;
+    int i;
+
+    AES_STAT_ADD(ghash_multiplications, 1);
+
+    /* YY is held word swapped */
+    for(i=0; i < WORD_BLOCK; i++){
+#if __LITTLE_ENDIAN
+        HH[i] = swapw(YY[i]);
+#else
+        HH[i] = YY[i];
+#endif
+    }
+
+    h1 = load64((uint8_t *)HH);
+    h0 = load64(((uint8_t *)HH) + 8);
+    y1 = load64((uint8_t *)XX);
+    y0 = load64(((uint8_t *)XX) + 8);
+
+    h0r = rev64(h0);
+    h1r = rev64(h1);
+    h2 = h0 ^ h1;
+    h2r = h0r ^ h1r;
+
+    y0r = rev64(y0);
+    y1r = rev64(y1);
+    y2 = y0 ^ y1;
+    y2r = y0r ^ y1r;
+
+    z0 = bmul64(y0, h0);
+    z1 = bmul64(y1, h1);
+    z2 = bmul64(y2, h2);
+    z0h = bmul64(y0r, h0r);
+    z1h = bmul64(y1r, h1r);
+    z2h = bmul64(y2r, h2r);
+
+    z2 ^= z0 ^ z1;
+    z2h ^= z0h ^ z1h;
+    z0h = rev64(z0h) >> 1;
+    z1h = rev64(z1h) >> 1;
+    z2h = rev64(z2h) >> 1;
+
+    v0 = z0;
+    v1 = z0h ^ z2;
+    v2 = z1 ^ z2h;
+    v3 = z1h;
+
+    /* bit reflected product is one bit short; shift then reduce */
+    v3 = (v3 << 1) | (v2 >> 63);
+    v2 = (v2 << 1) | (v1 >> 63);
+    v1 = (v1 << 1) | (v0 >> 63);
+    v0 = (v0 << 1);
+
+    v2 ^= v0 ^ (v0 >> 1) ^ (v0 >> 2) ^ (v0 >> 7);
+    v1 ^= (v0 << 63) ^ (v0 << 62) ^ (v0 << 57);
+    v3 ^= v1 ^ (v1 >> 1) ^ (v1 >> 2) ^ (v1 >> 7);
+    v2 ^= (v1 << 63) ^ (v1 << 62) ^ (v1 << 57);
+
+    store64((uint8_t *)XX, v3);
+    store64(((uint8_t *)XX) + 8, v2);
+}
+
+/* GHASH multiply bound by aes_tune() */
+static void (*galois_mul128_backend)(__word_t *XX, const __word_t *YY) = galois_mul128_shift;
+
+#define galois_mul128(XX, YY) __atomic_load_n(&galois_mul128_backend, __ATOMIC_ACQUIRE)((XX), (YY))
+
+#else
+
+#define galois_mul128 galois_mul128_shift
+
+#endif
+
+/* Increment the counter */
+static void increment(uint8_t *counter)
+{
+    if(++(counter[AES_BLOCK_SIZE-1]))
+        return;
+    if(++(counter[AES_BLOCK_SIZE-2]))
+        return;
+    if(++(counter[AES_BLOCK_SIZE-3]))
+        return;
+    counter[AES_BLOCK_SIZE-4]++;        
+}
+
+
+/* [a]64 || [b]64 in bits (a and b in octets) */
+static void gcm_lengths(uint8_t *sz, uint64_t a, uint64_t b)
+{
+    int i;
+
+    a <<= 3;
+    b <<= 3;
+
+    for(i=7; i >= 0; i--, a >>= 8, b >>= 8){
+
+        sz[i] = a;
+        sz[i + 8] = b;
+    }
+}
+
+/* Internal GCM
+ *
+ * mode:
+ * 0: Encipher Mode
+ * 1: Decipher Mode
+ * 2: GHASH mode
+ *
+ * *aes AES key schedule context
+ * *IV initialisation vector
+ * IV_size size of *IV in bytes
+ * mode function mode
+ * *out cipher output buffer
+ * *in cipher input buffer
+ * size size of *in or *out in bytes
+ * *aad additional non-ciphered data for authentication
+ * aad_size size of *aad
+ * prefix_size octets of aad already hashed into *XX (0 to start afresh)
+ * *XX GMAC output
+ * 
+ * */
+static void gcm(    
+
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    int mode,
+
+    uint8_t *out, const uint8_t *in, uint32_t size,
+    const uint8_t *aad, uint32_t aad_size,
+
+    uint32_t prefix_size,
+
+    __word_t *XX)     
+{
+    __word_t icount[WORD_BLOCK];
+    __word_t tcount[WORD_BLOCK];
+    __word_t count[WORD_BLOCK];
+
+    __word_t part[WORD_BLOCK];
+    __word_t HH[WORD_BLOCK];
+    uint8_t sz[AES_BLOCK_SIZE];
+
+    /* only implementation error within this file would cause this */
+    if(mode > 2)
+        return;
+
+    /* generate the hash subkey */
+    xor128(HH, HH);
+    aes_encr(aes, (uint8_t *)HH);
+#if __LITTLE_ENDIAN
+    int i;
+    for(i=0; i < WORD_BLOCK; i++)
+        HH[i] = swapw(HH[i]);
+#endif
+
+    /* GHASH mode does not need an IV; its counters stay zero */
+    MEMSET(icount, 0x0, sizeof(icount));
+
+    if(mode != 2){
+
+        AES_STAT_ADD(gcm_bytes, size);
+
+        if(IV_size == GCM_IV_SIZE){
+
+            MEMCPY(icount, counter_init, sizeof(icount));
+            MEMCPY(icount, IV, GCM_IV_SIZE);
+        }
+        /* GHASH(H, {}, IV) */
+        else{
+
+            gcm(aes, NULL, 0, 2, NULL, IV, IV_size, NULL, 0, 0, icount);            
+        }
+    }
+
+    copy128(count, icount);
+
+    /* create zero block */
+    if(!prefix_size)
+        xor128(XX, XX);
+
+    /* the prefix and aad together may exceed 32 bits */
+    gcm_lengths(sz, (uint64_t)prefix_size + aad_size, size);
+
+    if(aad_size){
+
+        while(1){
+
+            xor128(part, part);
+            MEMCPY(part, aad, ((aad_size < sizeof(part))?aad_size:sizeof(part)));
+
+            xor128(XX, part);
+            galois_mul128(XX, HH);
+
+            if(aad_size <= sizeof(part))
+                break;
+
+            aad += sizeof(part);
+            aad_size -= sizeof(part);
+        }
+    }
+        
+    if(size){
+
+        while(1){
+
+            if(mode != 2){
+                increment((uint8_t *)count);
+                copy128(tcount, count);
+                aes_encr(aes, (uint8_t *)tcount);  
+            }
+
+            xor128(part, part);
+            MEMCPY(part, in, ((size < sizeof(part))?size:sizeof(part)));
+            
+            /* deciphering or hashing */
+            if((mode == 1) || (mode == 2)){
+
+                xor128(XX, part);
+                galois_mul128(XX, HH);
+            }
+
+            /* deciphering or enciphering */
+            if(mode != 2){
+                xor128(part, tcount);
+                MEMCPY(out, part, (size < sizeof(part))?size:sizeof(part));
+            }
+
+            /* enciphering */
+            if(mode == 0){
+
+                /* zero garbage in unused block portion */
+                if(size < sizeof(part)){
+                    MEMSET(((uint8_t *)part) + size, 0x0, sizeof(part) - size);
+                }
+
+                xor128(XX, part);
+                galois_mul128(XX, HH);
+            }
+            
+            if(size <= sizeof(part))
+                break;
+
+            in += sizeof(part);
+            out += sizeof(part);
+            size -= sizeof(part);
+        }
+    }
+
+    /* GHASH output with size */
+    xor128(XX, (__word_t *)sz);
+    galois_mul128(XX, HH);
+
+    /* XOR initial counter with GHASH output */
+    if(mode != 2){
+        aes_encr(aes, (uint8_t *)icount);  
+        xor128(XX, icount);
+    }
+
+    xor128(HH, HH);    
+}
+    
+void aes_gcm_encipher(
+
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    uint8_t *T,
+    int T_size)
+{
+    __word_t XX[WORD_BLOCK];
+
+    AES_PROBE3("gcm_encipher_entry", size, aad_size, KEY_BITS(aes));
+
+    gcm(aes, IV, IV_size, 0, out, in, size, aad, aad_size, 0, XX);
+
+    if(T && (T_size > 0)){
+        MEMCPY(T, XX, (T_size < GCM_TAG_SIZE)?T_size:GCM_TAG_SIZE);
+    }
+
+    AES_PROBE1("gcm_encipher_return", size);
+}
+
+int aes_gcm_decipher(
+
+    const aes_ctxt *aes,
+    
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    const uint8_t *T,
+    int T_size)
+{
+    __word_t XX[WORD_BLOCK];
+    int ret = -1;
+
+    AES_PROBE3("gcm_decipher_entry", size, aad_size, KEY_BITS(aes));
+
+    if((T_size >= 0) && (T_size <= GCM_TAG_SIZE)){
+
+        gcm(aes, IV, IV_size, 1, out, in, size, aad, aad_size, 0, XX);
+
+        if(MEMCMP_CT(XX, T, T_size)){
+
+            AES_STAT_ADD(gcm_tag_failures, 1);
+            AES_PROBE2("gcm_tag_failure", size, aad_size);
+        }
+        else{
+
+            ret = 0;
+        }
+    }
+
+    AES_PROBE2("gcm_decipher_return", size, ret);
+
+    return ret;
+}
+
+int aes_gcm_init(aes_ctxt *aes, const uint8_t *k, int k_size)
+{
+    return aes_init(aes, k, k_size);
+}
+
+/* number of requests advanced in lockstep by gcm_multi() */
+#define GCM_LANES 8
+
+/* progress of one request through the lockstep scheduler */
+typedef struct {
+
+    aes_gcm_req *req;
+
+    uint8_t *out;
+    const uint8_t *in;
+    uint32_t size;      /* octets remaining */
+    uint32_t step;      /* 0: hash subkey, 1: E(J0), then keystream */
+
+    __word_t HH[WORD_BLOCK];
+    __word_t XX[WORD_BLOCK];
+    __word_t count[WORD_BLOCK];
+    __word_t EJ[WORD_BLOCK];
+
+} gcm_lane;
+
+/* convert between GHASH operand and subkey word order */
+inline static void gcm_swap(__word_t *to, const __word_t *from)
+{
+    int i;
+
+    for(i=0; i < WORD_BLOCK; i++){
+#if __LITTLE_ENDIAN
+        to[i] = swapw(from[i]);
+#else
+        to[i] = from[i];
+#endif
+    }
+}
+
+/* HH = E(K, 0^128) in GHASH operand order */
+static void gcm_subkey(__word_t *HH, const aes_ctxt *aes)
+{
+    xor128(HH, HH);
+    aes_encr(aes, (uint8_t *)HH);
+    gcm_swap(HH, HH);
+}
+
+/* XX = GHASH(XX, zero padded in) */
+static void gcm_hash(__word_t *XX, const __word_t *HH, const uint8_t *in, uint32_t size)
+{
+    __word_t part[WORD_BLOCK];
+
+    while(size){
+
+        xor128(part, part);
+        MEMCPY(part, in, (size < sizeof(part)) ? size : sizeof(part));
+
+        xor128(XX, part);
+        galois_mul128(XX, HH);
+
+        in += (size < sizeof(part)) ? size : sizeof(part);
+        size -= (size < sizeof(part)) ? size : sizeof(part);
+    }
+}
+
+/* JJ = pre-counter block of IV */
+static void gcm_j0(__word_t *JJ, const __word_t *HH, const uint8_t *IV, uint32_t IV_size)
+{
+    uint8_t sz[AES_BLOCK_SIZE];
+
+    if(IV_size == GCM_IV_SIZE){
+
+        MEMCPY(JJ, counter_init, sizeof(__word_t) * WORD_BLOCK);
+        MEMCPY(JJ, IV, GCM_IV_SIZE);
+    }
+    /* GHASH(H, {}, IV) */
+    else{
+
+        xor128(JJ, JJ);
+        gcm_hash(JJ, HH, IV, IV_size);
+        gcm_lengths(sz, 0, IV_size);
+        xor128(JJ, (__word_t *)sz);
+        galois_mul128(JJ, HH);
+    }
+}
+
+/* XX = GMAC of in with the cached subkey */
+static void gcm_gmac(const aes_gmac_ctxt *gmac, const uint8_t *IV, uint32_t IV_size, const uint8_t *in, uint32_t size, __word_t *XX)
+{
+    __word_t HH[WORD_BLOCK];
+    __word_t icount[WORD_BLOCK];
+    uint8_t sz[AES_BLOCK_SIZE];
+
+    AES_STAT_ADD(gcm_bytes, size);
+
+    MEMCPY(HH, gmac->H, sizeof(HH));
+
+    gcm_j0(icount, HH, IV, IV_size);
+
+    xor128(XX, XX);
+    gcm_hash(XX, HH, in, size);
+    gcm_lengths(sz, size, 0);
+    xor128(XX, (__word_t *)sz);
+    galois_mul128(XX, HH);
+
+    aes_encr(&gmac->aes, (uint8_t *)icount);
+    xor128(XX, icount);
+
+    xor128(HH, HH);
+}
+
+int aes_gmac_init(aes_gmac_ctxt *gmac, const uint8_t *k, int k_size)
+{
+    __word_t HH[WORD_BLOCK];
+
+    if(aes_init(&gmac->aes, k, k_size))
+        return -1;
+
+    gcm_subkey(HH, &gmac->aes);
+
+    MEMCPY(gmac->H, HH, sizeof(HH));
+
+    xor128(HH, HH);
+
+    return 0;
+}
+
+void aes_gmac_tag(
+
+    const aes_gmac_ctxt *gmac,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    const uint8_t *in,
+    uint32_t size,
+
+    uint8_t *T,
+    int T_size)
+{
+    __word_t XX[WORD_BLOCK];
+
+    gcm_gmac(gmac, IV, IV_size, in, size, XX);
+
+    if(T && (T_size > 0)){
+        MEMCPY(T, XX, (T_size < GCM_TAG_SIZE)?T_size:GCM_TAG_SIZE);
+    }
+}
+
+int aes_gmac_verify(
+
+    const aes_gmac_ctxt *gmac,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *T,
+    int T_size)
+{
+    __word_t XX[WORD_BLOCK];
+
+    if((T_size < 0) || (T_size > GCM_TAG_SIZE))
+        return -1;
+
+    gcm_gmac(gmac, IV, IV_size, in, size, XX);
+
+    if(MEMCMP_CT(XX, T, T_size)){
+
+        AES_STAT_ADD(gcm_tag_failures, 1);
+        return -1;
+    }
+
+    return 0;
+}
+
+int aes_gcm_prefix_init(aes_gcm_prefix *prefix, const aes_ctxt *aes, const uint8_t *aad, uint32_t aad_size)
+{
+    __word_t HH[WORD_BLOCK];
+    __word_t XX[WORD_BLOCK];
+
+    if(aad_size % AES_BLOCK_SIZE)
+        return -1;
+
+    gcm_subkey(HH, aes);
+
+    xor128(XX, XX);
+    gcm_hash(XX, HH, aad, aad_size);
+
+    MEMCPY(prefix->X, XX, sizeof(XX));
+    prefix->size = aad_size;
+
+    xor128(HH, HH);
+
+    return 0;
+}
+
+void aes_gcm_encipher_prefix(
+
+    const aes_ctxt *aes,
+    const aes_gcm_prefix *prefix,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    uint8_t *T,
+    int T_size)
+{
+    __word_t XX[WORD_BLOCK];
+
+    MEMCPY(XX, prefix->X, sizeof(XX));
+
+    gcm(aes, IV, IV_size, 0, out, in, size, aad, aad_size, prefix->size, XX);
+
+    if(T && (T_size > 0)){
+        MEMCPY(T, XX, (T_size < GCM_TAG_SIZE)?T_size:GCM_TAG_SIZE);
+    }
+}
+
+int aes_gcm_decipher_prefix(
+
+    const aes_ctxt *aes,
+    const aes_gcm_prefix *prefix,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    const uint8_t *T,
+    int T_size)
+{
+    __word_t XX[WORD_BLOCK];
+
+    if((T_size < 0) || (T_size > GCM_TAG_SIZE))
+        return -1;
+
+    MEMCPY(XX, prefix->X, sizeof(XX));
+
+    gcm(aes, IV, IV_size, 1, out, in, size, aad, aad_size, prefix->size, XX);
+
+    if(MEMCMP_CT(XX, T, T_size)){
+
+        AES_STAT_ADD(gcm_tag_failures, 1);
+        AES_PROBE2("gcm_tag_failure", size, (uint64_t)prefix->size + aad_size);
+
+        return -1;
+    }
+
+    return 0;
+}
+
+/* PP = H^m (subkey word order) where HH is H (subkey word order) */
+static void gcm_power(__word_t *PP, const __word_t *HH, uint32_t m)
+{
+    __word_t XX[WORD_BLOCK];
+    __word_t YY[WORD_BLOCK];
+    int i;
+
+    /* H^0 is the field identity */
+    if(!m){
+
+        xor128(PP, PP);
+        ((uint8_t *)PP)[0] = 0x80;
+        gcm_swap(PP, PP);
+        return;
+    }
+
+    gcm_swap(XX, HH);
+
+    for(i=31; !(m & (1UL << i)); i--);
+
+    /* left to right square and multiply */
+    while(i--){
+
+        gcm_swap(YY, XX);
+        galois_mul128(XX, YY);
+
+        if(m & (1UL << i))
+            galois_mul128(XX, HH);
+    }
+
+    gcm_swap(PP, XX);
+}
+
+/* add n to the 32 bit counter field */
+static void add_counter(uint8_t *counter, uint32_t n)
+{
+    uint32_t c;
+
+    c = ((uint32_t)counter[AES_BLOCK_SIZE-4] << 24) |
+        ((uint32_t)counter[AES_BLOCK_SIZE-3] << 16) |
+        ((uint32_t)counter[AES_BLOCK_SIZE-2] << 8) |
+        (uint32_t)counter[AES_BLOCK_SIZE-1];
+
+    c += n;
+
+    counter[AES_BLOCK_SIZE-4] = c >> 24;
+    counter[AES_BLOCK_SIZE-3] = c >> 16;
+    counter[AES_BLOCK_SIZE-2] = c >> 8;
+    counter[AES_BLOCK_SIZE-1] = c;
+}
+
+int aes_gcm_update(
+
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t offset,
+    uint32_t n,
+    uint32_t size,
+
+    uint8_t *T,
+    int T_size)
+{
+    __word_t HH[WORD_BLOCK];
+    __word_t PP[WORD_BLOCK];
+    __word_t XX[WORD_BLOCK];
+    __word_t count[WORD_BLOCK];
+    __word_t tcount[WORD_BLOCK];
+    __word_t part[WORD_BLOCK];
+    uint32_t b, last, lo, hi, i;
+
+    if((T_size < 0) || (T_size > GCM_TAG_SIZE) || (offset > size) || (n > (size - offset)))
+        return -1;
+
+    if(!n)
+        return 0;
+
+    gcm_subkey(HH, aes);
+
+    gcm_j0(count, HH, IV, IV_size);
+
+    b = offset / AES_BLOCK_SIZE;
+    last = (offset + n - 1) / AES_BLOCK_SIZE;
+
+    /* counter of block b is J0 + 1 + b */
+    add_counter((uint8_t *)count, b + 1);
+
+    /* XX = sum of (old XOR new ciphertext) . H^(last - b + 1) by Horner */
+    xor128(XX, XX);
+
+    for(; b <= last; b++){
+
+        copy128(tcount, count);
+        aes_encr(aes, (uint8_t *)tcount);
+        increment((uint8_t *)count);
+
+        lo = (b == (offset / AES_BLOCK_SIZE)) ? (offset % AES_BLOCK_SIZE) : 0;
+        hi = (b == last) ? (((offset + n - 1) % AES_BLOCK_SIZE) + 1) : AES_BLOCK_SIZE;
+
+        xor128(part, part);
+
+        for(i=lo; i < hi; i++){
+
+            ((uint8_t *)part)[i] = *out ^ *in ^ ((uint8_t *)tcount)[i];
+            *out++ ^= ((uint8_t *)part)[i];
+            in++;
+        }
+
+        xor128(XX, part);
+        galois_mul128(XX, HH);
+    }
+
+    /* ciphertext block last is followed by the remaining blocks and the
+     * lengths block */
+    gcm_power(PP, HH, ((size + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE) - last);
+    galois_mul128(XX, PP);
+
+    for(i=0; (i < (uint32_t)T_size) && T; i++)
+        T[i] ^= ((uint8_t *)XX)[i];
+
+    xor128(HH, HH);
+    xor128(PP, PP);
+    xor128(tcount, tcount);
+
+    return 0;
+}
+
+/* counter blocks enciphered per aes_encr_blocks() call by gcm_ctr() */
+#define GCM_CTR_CHUNK 8
+
+/* out = in XOR keystream from the block after count */
+static void gcm_ctr(const aes_ctxt *aes, __word_t *count, uint8_t *out, const uint8_t *in, uint32_t size)
+{
+    __word_t ks[GCM_CTR_CHUNK][WORD_BLOCK];
+    __word_t part[WORD_BLOCK];
+    uint32_t m, i, n;
+
+    while(size){
+
+        m = (size + AES_BLOCK_SIZE - 1) / AES_BLOCK_SIZE;
+        m = (m < GCM_CTR_CHUNK) ? m : GCM_CTR_CHUNK;
+
+        for(i=0; i < m; i++){
+
+            increment((uint8_t *)count);
+            copy128(ks[i], count);
+        }
+
+        aes_encr_blocks(aes, (uint8_t *)ks, m);
+
+        for(i=0; i < m; i++){
+
+            n = (size < sizeof(part)) ? size : sizeof(part);
+
+            MEMCPY(part, in, n);
+            xor128(part, ks[i]);
+            MEMCPY(out, part, n);
+
+            in += n;
+            out += n;
+            size -= n;
+        }
+    }
+
+    MEMSET(ks, 0x0, sizeof(ks));
+    xor128(part, part);
+}
+
+int aes_gcm_decipher_verified(
+
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    const uint8_t *T,
+    int T_size)
+{
+    __word_t HH[WORD_BLOCK];
+    __word_t XX[WORD_BLOCK];
+    __word_t icount[WORD_BLOCK];
+    __word_t EJ[WORD_BLOCK];
+    uint8_t sz[AES_BLOCK_SIZE];
+    int ret = -1;
+
+    AES_PROBE3("gcm_decipher_entry", size, aad_size, KEY_BITS(aes));
+
+    if((T_size >= 0) && (T_size <= GCM_TAG_SIZE)){
+
+        AES_STAT_ADD(gcm_bytes, size);
+
+        gcm_subkey(HH, aes);
+
+        gcm_j0(icount, HH, IV, IV_size);
+
+        /* tag mask first so the comparison follows the hash directly */
+        copy128(EJ, icount);
+        aes_encr(aes, (uint8_t *)EJ);
+
+        /* GHASH(H, aad, ciphertext) */
+        xor128(XX, XX);
+        gcm_hash(XX, HH, aad, aad_size);
+        gcm_hash(XX, HH, in, size);
+        gcm_lengths(sz, aad_size, size);
+        xor128(XX, (__word_t *)sz);
+        galois_mul128(XX, HH);
+
+        xor128(XX, EJ);
+
+        if(MEMCMP_CT(XX, T, T_size)){
+
+            AES_STAT_ADD(gcm_tag_failures, 1);
+            AES_PROBE2("gcm_tag_failure", size, aad_size);
+        }
+        else{
+
+            gcm_ctr(aes, icount, out, in, size);
+            ret = 0;
+        }
+
+        xor128(HH, HH);
+        xor128(EJ, EJ);
+    }
+
+    AES_PROBE2("gcm_decipher_return", size, ret);
+
+    return ret;
+}
+
+/* position in a list of segments */
+typedef struct {
+
+    const aes_iovec *v;
+    uint32_t n;
+    uint32_t i;         /* current segment */
+    uint32_t off;       /* octets of it consumed */
+
+} gcm_iov_pos;
+
+static uint32_t gcm_iov_total(const aes_iovec *v, uint32_t n)
+{
+    uint32_t i, total = 0;
+
+    for(i=0; i < n; i++)
+        total += v[i].size;
+
+    return total;
+}
+
+/* contiguous octets at the position (0 at the end) */
+static uint32_t gcm_iov_span(gcm_iov_pos *pos, uint8_t **p)
+{
+    while((pos->i < pos->n) && (pos->off == pos->v[pos->i].size)){
+
+        pos->i++;
+        pos->off = 0;
+    }
+
+    if(pos->i == pos->n)
+        return 0;
+
+    *p = pos->v[pos->i].base + pos->off;
+
+    return pos->v[pos->i].size - pos->off;
+}
+
+/* copy n octets from (write == 0) or to (write != 0) the segments */
+static void gcm_iov_copy(gcm_iov_pos *pos, uint8_t *buf, uint32_t n, int write)
+{
+    uint8_t *p;
+    uint32_t m;
+
+    while(n){
+
+        m = gcm_iov_span(pos, &p);
+        m = (m < n) ? m : n;
+
+        if(write)
+            MEMCPY(p, buf, m);
+        else
+            MEMCPY(buf, p, m);
+
+        pos->off += m;
+        buf += m;
+        n -= m;
+    }
+}
+
+/* gcm() over segments for mode 0 and 1; -1 if out is smaller than in */
+static int gcm_iov(
+
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    int mode,
+
+    const aes_iovec *out, uint32_t out_n,
+    const aes_iovec *in, uint32_t in_n,
+    const aes_iovec *aad, uint32_t aad_n,
+
+    __word_t *XX)
+{
+    __word_t HH[WORD_BLOCK];
+    __word_t icount[WORD_BLOCK];
+    __word_t count[WORD_BLOCK];
+    __word_t part[WORD_BLOCK];
+    uint8_t sz[AES_BLOCK_SIZE];
+    gcm_iov_pos ip = {in, in_n, 0, 0}, op = {out, out_n, 0, 0}, ap = {aad, aad_n, 0, 0};
+    uint32_t size, aad_size, rem, m, a;
+    uint8_t *pi, *po;
+
+    size = gcm_iov_total(in, in_n);
+    aad_size = gcm_iov_total(aad, aad_n);
+
+    if(gcm_iov_total(out, out_n) < size)
+        return -1;
+
+    AES_STAT_ADD(gcm_bytes, size);
+
+    gcm_subkey(HH, aes);
+    gcm_j0(icount, HH, IV, IV_size);
+    copy128(count, icount);
+
+    xor128(XX, XX);
+
+    /* whole blocks within a segment are hashed in place */
+    for(rem = aad_size; rem; rem -= m){
+
+        m = gcm_iov_span(&ap, &pi);
+
+        if(m >= AES_BLOCK_SIZE){
+
+            m &= ~(AES_BLOCK_SIZE - 1);
+            gcm_hash(XX, HH, pi, m);
+            ap.off += m;
+        }
+        else{
+
+            m = (rem < AES_BLOCK_SIZE) ? rem : AES_BLOCK_SIZE;
+            gcm_iov_copy(&ap, (uint8_t *)part, m, 0);
+            gcm_hash(XX, HH, (uint8_t *)part, m);
+        }
+    }
+
+    /* whole blocks within a segment of both in and out go through
+     * gcm_ctr() in place; blocks split across segments are gathered */
+    for(rem = size; rem; rem -= m){
+
+        m = gcm_iov_span(&ip, &pi);
+        a = gcm_iov_span(&op, &po);
+        m = (a < m) ? a : m;
+
+        if(m >= AES_BLOCK_SIZE){
+
+            m &= ~(AES_BLOCK_SIZE - 1);
+
+            if(mode == 1)
+                gcm_hash(XX, HH, pi, m);
+
+            gcm_ctr(aes, count, po, pi, m);
+
+            if(mode == 0)
+                gcm_hash(XX, HH, po, m);
+
+            ip.off += m;
+            op.off += m;
+        }
+        else{
+
+            m = (rem < AES_BLOCK_SIZE) ? rem : AES_BLOCK_SIZE;
+
+            gcm_iov_copy(&ip, (uint8_t *)part, m, 0);
+
+            if(mode == 1)
+                gcm_hash(XX, HH, (uint8_t *)part, m);
+
+            gcm_ctr(aes, count, (uint8_t *)part, (uint8_t *)part, m);
+
+            if(mode == 0)
+                gcm_hash(XX, HH, (uint8_t *)part, m);
+
+            gcm_iov_copy(&op, (uint8_t *)part, m, 1);
+        }
+    }
+
+    gcm_lengths(sz, aad_size, size);
+    xor128(XX, (__word_t *)sz);
+    galois_mul128(XX, HH);
+
+    aes_encr(aes, (uint8_t *)icount);
+    xor128(XX, icount);
+
+    xor128(HH, HH);
+    xor128(part, part);
+
+    return 0;
+}
+
+int aes_gcm_encipher_iov(
+
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    const aes_iovec *out,
+    uint32_t out_n,
+    const aes_iovec *in,
+    uint32_t in_n,
+
+    const aes_iovec *aad,
+    uint32_t aad_n,
+
+    uint8_t *T,
+    int T_size)
+{
+    __word_t XX[WORD_BLOCK];
+
+    if(gcm_iov(aes, IV, IV_size, 0, out, out_n, in, in_n, aad, aad_n, XX))
+        return -1;
+
+    if(T && (T_size > 0)){
+        MEMCPY(T, XX, (T_size < GCM_TAG_SIZE)?T_size:GCM_TAG_SIZE);
+    }
+
+    return 0;
+}
+
+int aes_gcm_decipher_iov(
+
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    const aes_iovec *out,
+    uint32_t out_n,
+    const aes_iovec *in,
+    uint32_t in_n,
+
+    const aes_iovec *aad,
+    uint32_t aad_n,
+
+    const uint8_t *T,
+    int T_size)
+{
+    __word_t XX[WORD_BLOCK];
+
+    if((T_size < 0) || (T_size > GCM_TAG_SIZE))
+        return -1;
+
+    if(gcm_iov(aes, IV, IV_size, 1, out, out_n, in, in_n, aad, aad_n, XX))
+        return -1;
+
+    if(MEMCMP_CT(XX, T, T_size)){
+
+        AES_STAT_ADD(gcm_tag_failures, 1);
+        AES_PROBE2("gcm_tag_failure", gcm_iov_total(in, in_n), gcm_iov_total(aad, aad_n));
+
+        return -1;
+    }
+
+    return 0;
+}
+
+/* returns 1 if the lane must be stepped, 0 if req is already complete */
+static int gcm_lane_start(int mode, aes_gcm_req *req, gcm_lane *lane)
+{
+    req->ret = -1;
+
+    if((mode == 1) && ((req->T_size < 0) || (req->T_size > GCM_TAG_SIZE)))
+        return 0;
+
+    AES_STAT_ADD(gcm_bytes, req->size);
+
+    lane->req = req;
+    lane->out = req->out;
+    lane->in = req->in;
+    lane->size = req->size;
+    lane->step = 0;
+
+    xor128(lane->count, lane->count);
+
+    return 1;
+}
+
+/* consume the cipher output of the last step */
+static void gcm_lane_step(int mode, gcm_lane *lane, __word_t *block)
+{
+    aes_gcm_req *req = lane->req;
+    __word_t part[WORD_BLOCK];
+    uint32_t size;
+
+    switch(lane->step++){
+    case 0:
+
+        gcm_swap(lane->HH, block);
+
+        if(req->IV_size == GCM_IV_SIZE){
+
+            MEMCPY(lane->count, counter_init, sizeof(lane->count));
+            MEMCPY(lane->count, req->IV, GCM_IV_SIZE);
+        }
+        /* GHASH(H, {}, IV) */
+        else{
+
+            gcm_hash(lane->count, lane->HH, req->IV, req->IV_size);
+            gcm_lengths((uint8_t *)part, 0, req->IV_size);
+            xor128(lane->count, part);
+            galois_mul128(lane->count, lane->HH);
+        }
+
+        xor128(lane->XX, lane->XX);
+        gcm_hash(lane->XX, lane->HH, req->aad, req->aad_size);
+        break;
+
+    case 1:
+
+        copy128(lane->EJ, block);
+        break;
+
+    default:
+
+        size = (lane->size < sizeof(part)) ? lane->size : sizeof(part);
+
+        xor128(part, part);
+        MEMCPY(part, lane->in, size);
+
+        if(mode == 1){
+
+            xor128(lane->XX, part);
+            galois_mul128(lane->XX, lane->HH);
+        }
+
+        xor128(part, block);
+        MEMCPY(lane->out, part, size);
+
+        if(mode == 0){
+
+            MEMSET(((uint8_t *)part) + size, 0x0, sizeof(part) - size);
+
+            xor128(lane->XX, part);
+            galois_mul128(lane->XX, lane->HH);
+        }
+
+        lane->in += size;
+        lane->out += size;
+        lane->size -= size;
+        break;
+    }
+}
+
+/* GHASH the lengths, produce or check the tag */
+static void gcm_lane_finish(int mode, gcm_lane *lane)
+{
+    aes_gcm_req *req = lane->req;
+    uint8_t sz[AES_BLOCK_SIZE];
+
+    gcm_lengths(sz, req->aad_size, req->size);
+
+    xor128(lane->XX, (__word_t *)sz);
+    galois_mul128(lane->XX, lane->HH);
+    xor128(lane->XX, lane->EJ);
+
+    if(mode == 0){
+
+        if(req->T && (req->T_size > 0)){
+            MEMCPY(req->T, lane->XX, (req->T_size < GCM_TAG_SIZE)?req->T_size:GCM_TAG_SIZE);
+        }
+
+        req->ret = 0;
+    }
+    else{
+
+        req->ret = MEMCMP_CT(lane->XX, req->T, req->T_size) ? -1 : 0;
+
+        if(req->ret)
+            AES_STAT_ADD(gcm_tag_failures, 1);
+    }
+
+    xor128(lane->HH, lane->HH);
+}
+
+/* run n requests through GCM_LANES lanes
+ *
+ * Every step encrypts one counter block for each lane with a single
+ * aes_encr_multi() call. A lane which completes is refilled with the next
+ * request.
+ *
+ * */
+static int gcm_multi(int mode, aes_gcm_req *req, uint32_t n)
+{
+    gcm_lane lane[GCM_LANES];
+    const aes_ctxt *key[GCM_LANES];
+    __word_t block[GCM_LANES][WORD_BLOCK];
+    uint32_t i, next = 0, active = 0;
+    int ret = 0;
+
+    while(1){
+
+        while((active < GCM_LANES) && (next < n)){
+
+            if(gcm_lane_start(mode, &req[next], &lane[active]))
+                active++;
+            else
+                ret = -1;
+
+            next++;
+        }
+
+        if(!active)
+            break;
+
+        for(i=0; i < active; i++){
+
+            key[i] = lane[i].req->aes;
+
+            if(lane[i].step == 0){
+
+                xor128(block[i], block[i]);
+            }
+            else{
+
+                if(lane[i].step > 1)
+                    increment((uint8_t *)lane[i].count);
+
+                copy128(block[i], lane[i].count);
+            }
+        }
+
+        aes_encr_multi(key, (uint8_t *)block, active);
+
+        for(i=0; i < active; ){
+
+            gcm_lane_step(mode, &lane[i], block[i]);
+
+            if((lane[i].step > 1) && !lane[i].size){
+
+                gcm_lane_finish(mode, &lane[i]);
+
+                if(lane[i].req->ret)
+                    ret = -1;
+
+                /* keep active lanes contiguous */
+                if(i != --active){
+
+                    lane[i] = lane[active];
+                    copy128(block[i], block[active]);
+                }
+            }
+            else{
+
+                i++;
+            }
+        }
+    }
+
+    return ret;
+}
+
+void aes_gcm_encipher_multi(aes_gcm_req *req, uint32_t n)
+{
+    gcm_multi(0, req, n);
+}
+
+int aes_gcm_decipher_multi(aes_gcm_req *req, uint32_t n)
+{
+    return gcm_multi(1, req, n);
+}
+
+#ifdef AES_POOL
+
+#include <stdlib.h>
+
+typedef struct {
+
+    const aes_ctxt *aes;
+    int mode;
+
+    uint8_t *out;
+    const uint8_t *in;
+
+    __word_t HH[WORD_BLOCK];
+    __word_t icount[WORD_BLOCK];
+
+    __word_t (*YY)[WORD_BLOCK];     /* GHASH of each chunk from zero */
+
+} gcm_par_job;
+
+/* CTR and GHASH over whole blocks [first, first + count) */
+static void gcm_par_chunk(void *arg, uint32_t first, uint32_t count)
+{
+    gcm_par_job *job = (gcm_par_job *)arg;
+
+    __word_t count_[WORD_BLOCK];
+    __word_t *YY = job->YY[first / AES_POOL_GRAIN];
+
+    const uint8_t *in = job->in + (first * AES_BLOCK_SIZE);
+    uint8_t *out = job->out + (first * AES_BLOCK_SIZE);
+
+    copy128(count_, job->icount);
+    add_counter((uint8_t *)count_, first);
+
+    xor128(YY, YY);
+
+    /* deciphering hashes the ciphertext before it is overwritten */
+    if(job->mode == 1)
+        gcm_hash(YY, job->HH, in, count * AES_BLOCK_SIZE);
+
+    gcm_ctr(job->aes, count_, out, in, count * AES_BLOCK_SIZE);
+
+    if(job->mode == 0)
+        gcm_hash(YY, job->HH, out, count * AES_BLOCK_SIZE);
+}
+
+/* parallel equivalent of gcm() for mode 0 and 1
+ *
+ * Whole blocks are split into chunks of AES_POOL_GRAIN blocks. Each chunk
+ * is hashed from zero and the results are folded together in order:
+ *
+ * X <- (X . H^m) XOR Y
+ *
+ * returns -1 if the chunk results cannot be allocated
+ *
+ * */
+static int gcm_par(
+
+    aes_pool *pool,
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    int mode,
+
+    uint8_t *out, const uint8_t *in, uint32_t size,
+    const uint8_t *aad, uint32_t aad_size,
+
+    __word_t *XX)
+{
+    gcm_par_job job;
+
+    __word_t PP[WORD_BLOCK];
+    __word_t count[WORD_BLOCK];
+    uint8_t sz[AES_BLOCK_SIZE];
+
+    uint32_t n = size / AES_BLOCK_SIZE;
+    uint32_t chunks = (n + AES_POOL_GRAIN - 1) / AES_POOL_GRAIN;
+    uint32_t i, rem;
+
+    if(!(job.YY = malloc(chunks * sizeof(*job.YY))))
+        return -1;
+
+    AES_STAT_ADD(gcm_bytes, size);
+
+    job.aes = aes;
+    job.mode = mode;
+    job.out = out;
+    job.in = in;
+
+    gcm_subkey(job.HH, aes);
+    gcm_j0(job.icount, job.HH, IV, IV_size);
+
+    xor128(XX, XX);
+    gcm_hash(XX, job.HH, aad, aad_size);
+
+    aes_pool_for(pool, n, AES_POOL_GRAIN, gcm_par_chunk, &job);
+
+    /* fold whole chunks, then the (shorter) last chunk */
+    if(chunks){
+
+        gcm_power(PP, job.HH, AES_POOL_GRAIN);
+
+        for(i=0; i < (chunks - 1); i++){
+
+            galois_mul128(XX, PP);
+            xor128(XX, job.YY[i]);
+        }
+
+        gcm_power(PP, job.HH, n - (i * AES_POOL_GRAIN));
+
+        galois_mul128(XX, PP);
+        xor128(XX, job.YY[i]);
+    }
+
+    /* incomplete last block */
+    if((rem = size % AES_BLOCK_SIZE)){
+
+        if(mode == 1)
+            gcm_hash(XX, job.HH, in + (n * AES_BLOCK_SIZE), rem);
+
+        copy128(count, job.icount);
+        add_counter((uint8_t *)count, n);
+        gcm_ctr(aes, count, out + (n * AES_BLOCK_SIZE), in + (n * AES_BLOCK_SIZE), rem);
+
+        if(mode == 0)
+            gcm_hash(XX, job.HH, out + (n * AES_BLOCK_SIZE), rem);
+    }
+
+    gcm_lengths(sz, aad_size, size);
+    xor128(XX, (__word_t *)sz);
+    galois_mul128(XX, job.HH);
+
+    aes_encr(aes, (uint8_t *)job.icount);
+    xor128(XX, job.icount);
+
+    xor128(job.HH, job.HH);
+    free(job.YY);
+
+    return 0;
+}
+
+void aes_gcm_encipher_par(
+
+    aes_pool *pool,
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    uint8_t *T,
+    int T_size)
+{
+    __word_t XX[WORD_BLOCK];
+
+    if((aes_pool_threads(pool) == 1) || (size < (2 * AES_POOL_GRAIN * AES_BLOCK_SIZE)) ||
+        gcm_par(pool, aes, IV, IV_size, 0, out, in, size, aad, aad_size, XX)){
+
+        aes_gcm_encipher(aes, IV, IV_size, out, in, size, aad, aad_size, T, T_size);
+        return;
+    }
+
+    if(T && (T_size > 0)){
+        MEMCPY(T, XX, (T_size < GCM_TAG_SIZE)?T_size:GCM_TAG_SIZE);
+    }
+}
+
+int aes_gcm_decipher_par(
+
+    aes_pool *pool,
+    const aes_ctxt *aes,
+
+    const uint8_t *IV,
+    uint32_t IV_size,
+
+    uint8_t *out,
+    const uint8_t *in,
+    uint32_t size,
+
+    const uint8_t *aad,
+    uint32_t aad_size,
+
+    const uint8_t *T,
+    int T_size)
+{
+    __word_t XX[WORD_BLOCK];
+
+    if((T_size < 0) || (T_size > GCM_TAG_SIZE))
+        return -1;
+
+    if((aes_pool_threads(pool) == 1) || (size < (2 * AES_POOL_GRAIN * AES_BLOCK_SIZE)) ||
+        gcm_par(pool, aes, IV, IV_size, 1, out, in, size, aad, aad_size, XX)){
+
+        return aes_gcm_decipher(aes, IV, IV_size, out, in, size, aad, aad_size, T, T_size);
+    }
+
+    if(MEMCMP_CT(XX, T, T_size)){
+
+        AES_STAT_ADD(gcm_tag_failures, 1);
+        return -1;
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,329 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+#include "aes.h"
+#include "common.c"
+
+#include <stdlib.h>
+#include <pthread.h>
+
+typedef struct keycache_entry keycache_entry;
+
+struct keycache_entry {
+
+    aes_ctxt aes;           /* first so that a borrowed context is the entry */
+
+    aes_key key;
+    uint32_t hash;
+    uint32_t shard;
+    uint32_t refs;          /* borrowers */
+
+    keycache_entry *chain;  /* next in hash bucket */
+    keycache_entry *prev;   /* towards most recently used */
+    keycache_entry *next;   /* towards least recently used */
+};
+
+typedef struct {
+
+    pthread_mutex_t mutex;
+
+    keycache_entry **bucket;
+    uint32_t mask;          /* buckets - 1 */
+
+    keycache_entry *entry;  /* all entries of the shard */
+    keycache_entry *free;   /* unused entries (linked by chain) */
+
+    keycache_entry *head;   /* most recently used */
+    keycache_entry *tail;   /* least recently used */
+
+    uint32_t used;
+    uint32_t capacity;
+
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+    uint64_t full;
+
+} keycache_shard;
+
+struct aes_keycache {
+
+    uint32_t mask;          /* shards - 1 */
+    keycache_shard *shard;
+};
+
+/* FNV-1a of key and size */
+static uint32_t keycache_hash(const aes_key *key)
+{
+    uint32_t h = 0x811c9dc5;
+    int i;
+
+    for(i=0; i < key->k_size; i++)
+        h = (h ^ key->k[i]) * 0x01000193;
+
+    return (h ^ key->k_size) * 0x01000193;
+}
+
+static void lru_unlink(keycache_shard *s, keycache_entry *e)
+{
+    if(e->prev)
+        e->prev->next = e->next;
+    else
+        s->head = e->next;
+
+    if(e->next)
+        e->next->prev = e->prev;
+    else
+        s->tail = e->prev;
+}
+
+static void lru_push(keycache_shard *s, keycache_entry *e)
+{
+    e->prev = NULL;
+    e->next = s->head;
+
+    if(s->head)
+        s->head->prev = e;
+    else
+        s->tail = e;
+
+    s->head = e;
+}
+
+/* an unused entry; the least recently used unpinned one if there is none */
+static keycache_entry *keycache_take(keycache_shard *s)
+{
+    keycache_entry *e, **p;
+
+    if((e = s->free)){
+
+        s->free = e->chain;
+        s->used++;
+        return e;
+    }
+
+    for(e = s->tail; e && e->refs; e = e->prev);
+
+    if(!e)
+        return NULL;
+
+    for(p = &s->bucket[e->hash & s->mask]; *p != e; p = &(*p)->chain);
+
+    *p = e->chain;
+
+    lru_unlink(s, e);
+    s->evictions++;
+
+    return e;
+}
+
+int aes_key_init(aes_key *key, const uint8_t *k, int k_size)
+{
+    if((k_size != AES128_KEY_SIZE) && (k_size != AES192_KEY_SIZE) && (k_size != AES256_KEY_SIZE))
+        return -1;
+
+    MEMSET(key, 0x0, sizeof(*key));
+    MEMCPY(key->k, k, k_size);
+    key->k_size = k_size;
+
+    return 0;
+}
+
+aes_keycache *aes_keycache_create(uint32_t entries, uint32_t shards)
+{
+    aes_keycache *kc;
+    keycache_shard *s;
+    uint32_t n, buckets, i, j;
+
+    if(!shards)
+        shards = AES_KEYCACHE_SHARDS;
+
+    /* round up to a power of two */
+    for(n = 1; n < shards; n <<= 1);
+    shards = n;
+
+    /* at least one entry per shard */
+    n = (entries + shards - 1) / shards;
+    n = n ? n : 1;
+
+    for(buckets = 1; buckets < n; buckets <<= 1);
+
+    if(!(kc = calloc(1, sizeof(*kc))))
+        return NULL;
+
+    if(!(kc->shard = calloc(shards, sizeof(keycache_shard)))){
+
+        free(kc);
+        return NULL;
+    }
+
+    kc->mask = shards - 1;
+
+    for(i=0; i < shards; i++){
+
+        s = &kc->shard[i];
+
+        s->bucket = calloc(buckets, sizeof(keycache_entry *));
+        s->entry = calloc(n, sizeof(keycache_entry));
+
+        if(!s->bucket || !s->entry){
+
+            free(s->bucket);
+            free(s->entry);
+
+            while(i--){
+
+                pthread_mutex_destroy(&kc->shard[i].mutex);
+                free(kc->shard[i].bucket);
+                free(kc->shard[i].entry);
+            }
+
+            free(kc->shard);
+            free(kc);
+            return NULL;
+        }
+
+        pthread_mutex_init(&s->mutex, NULL);
+
+        s->mask = buckets - 1;
+        s->capacity = n;
+
+        for(j=0; j < n; j++){
+
+            s->entry[j].shard = i;
+            s->entry[j].chain = s->free;
+            s->free = &s->entry[j];
+        }
+    }
+
+    return kc;
+}
+
+void aes_keycache_destroy(aes_keycache *kc)
+{
+    uint32_t i;
+
+    if(!kc)
+        return;
+
+    for(i=0; i <= kc->mask; i++){
+
+        MEMSET(kc->shard[i].entry, 0x0, kc->shard[i].capacity * sizeof(keycache_entry));
+
+        pthread_mutex_destroy(&kc->shard[i].mutex);
+        free(kc->shard[i].bucket);
+        free(kc->shard[i].entry);
+    }
+
+    free(kc->shard);
+    free(kc);
+}
+
+const aes_ctxt *aes_keycache_get(aes_keycache *kc, const aes_key *key)
+{
+    keycache_shard *s;
+    keycache_entry *e;
+    uint32_t hash = keycache_hash(key);
+
+    /* shards from the upper bits, buckets from the lower */
+    s = &kc->shard[(hash >> 16) & kc->mask];
+
+    pthread_mutex_lock(&s->mutex);
+
+    for(e = s->bucket[hash & s->mask]; e; e = e->chain){
+
+        if((e->hash == hash) && (e->key.k_size == key->k_size) && !MEMCMP_CT(e->key.k, key->k, key->k_size))
+            break;
+    }
+
+    if(e){
+
+        s->hits++;
+        lru_unlink(s, e);
+    }
+    else if((e = keycache_take(s))){
+
+        s->misses++;
+
+        aes_init(&e->aes, key->k, key->k_size);
+
+        e->key = *key;
+        e->hash = hash;
+        e->chain = s->bucket[hash & s->mask];
+        s->bucket[hash & s->mask] = e;
+    }
+    else{
+
+        s->full++;
+        pthread_mutex_unlock(&s->mutex);
+
+        return NULL;
+    }
+
+    e->refs++;
+    lru_push(s, e);
+
+    pthread_mutex_unlock(&s->mutex);
+
+    return &e->aes;
+}
+
+void aes_keycache_put(aes_keycache *kc, const aes_ctxt *aes)
+{
+    keycache_entry *e = (keycache_entry *)aes;
+    keycache_shard *s = &kc->shard[e->shard];
+
+    pthread_mutex_lock(&s->mutex);
+    e->refs--;
+    pthread_mutex_unlock(&s->mutex);
+}
+
+void aes_keycache_stats_get(aes_keycache *kc, aes_keycache_stats *stats, int reset)
+{
+    keycache_shard *s;
+    uint32_t i;
+
+    MEMSET(stats, 0x0, sizeof(*stats));
+
+    for(i=0; i <= kc->mask; i++){
+
+        s = &kc->shard[i];
+
+        pthread_mutex_lock(&s->mutex);
+
+        stats->hits += s->hits;
+        stats->misses += s->misses;
+        stats->evictions += s->evictions;
+        stats->full += s->full;
+        stats->entries += s->used;
+        stats->capacity += s->capacity;
+
+        if(reset){
+
+            s->hits = 0;
+            s->misses = 0;
+            s->evictions = 0;
+            s->full = 0;
+        }
+
+        pthread_mutex_unlock(&s->mutex);
+    }
+}
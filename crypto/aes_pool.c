@@ -0,0 +1,354 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+#include "aes.h"
+#include "common.c"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+/* cache line size assumed for padding */
+#ifndef AES_POOL_LINE
+#define AES_POOL_LINE 64
+#endif
+
+/* range of chunk indices owned by one participant
+ *
+ * lo is in the upper half and hi in the lower half so that the owner
+ * (taking from lo) and thieves (taking from hi) can both update it with a
+ * single compare and swap.
+ *
+ * */
+typedef struct {
+
+    uint64_t range;
+    uint8_t pad[AES_POOL_LINE - sizeof(uint64_t)];
+
+} pool_range;
+
+typedef struct {
+
+    aes_pool *pool;
+    pthread_t thread;
+    int id;
+
+} pool_worker;
+
+struct aes_pool {
+
+    int threads;            /* participants including the caller */
+
+    pool_worker *worker;    /* (threads - 1) worker threads */
+    pool_range *range;      /* one per participant */
+
+    pthread_mutex_t lock;   /* serialises aes_pool_for() callers */
+    pthread_mutex_t mutex;  /* protects the fields below */
+    pthread_cond_t start;
+    pthread_cond_t done;
+
+    uint32_t generation;    /* incremented for each job */
+    int busy;               /* participants yet to finish the job */
+    int stop;
+
+    /* current job */
+    aes_pool_fn fn;
+    void *arg;
+    uint32_t n;
+    uint32_t grain;
+};
+
+#define RANGE(LO, HI) ((((uint64_t)(LO)) << 32) | (HI))
+#define RANGE_LO(R) ((uint32_t)((R) >> 32))
+#define RANGE_HI(R) ((uint32_t)(R))
+
+/* take the next chunk from the bottom of our own range */
+static int pool_take(aes_pool *pool, int id, uint32_t *c)
+{
+    uint64_t *range = &pool->range[id].range;
+    uint64_t r = __atomic_load_n(range, __ATOMIC_ACQUIRE);
+
+    while(RANGE_LO(r) < RANGE_HI(r)){
+
+        if(__atomic_compare_exchange_n(range, &r, RANGE(RANGE_LO(r) + 1, RANGE_HI(r)), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+
+            *c = RANGE_LO(r);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* move the top half of another participant's range into our own */
+static int pool_steal(aes_pool *pool, int id)
+{
+    int i, victim;
+    uint64_t r;
+    uint32_t lo, hi, mid;
+
+    for(i=1; i < pool->threads; i++){
+
+        victim = (id + i) % pool->threads;
+        r = __atomic_load_n(&pool->range[victim].range, __ATOMIC_ACQUIRE);
+
+        while((lo = RANGE_LO(r)) < (hi = RANGE_HI(r))){
+
+            mid = hi - ((hi - lo + 1) >> 1);
+
+            if(__atomic_compare_exchange_n(&pool->range[victim].range, &r, RANGE(lo, mid), 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+
+                __atomic_store_n(&pool->range[id].range, RANGE(mid, hi), __ATOMIC_RELEASE);
+                return 1;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/* work on the current job until no chunks are left anywhere */
+static void pool_run(aes_pool *pool, int id)
+{
+    uint32_t c, first;
+
+    do{
+
+        while(pool_take(pool, id, &c)){
+
+            first = c * pool->grain;
+
+            pool->fn(pool->arg, first, ((pool->n - first) < pool->grain) ? (pool->n - first) : pool->grain);
+        }
+    }
+    while(pool_steal(pool, id));
+}
+
+static void *pool_thread(void *arg)
+{
+    pool_worker *w = (pool_worker *)arg;
+    aes_pool *pool = w->pool;
+    uint32_t generation = 0;
+
+    pthread_mutex_lock(&pool->mutex);
+
+    while(1){
+
+        while(!pool->stop && (pool->generation == generation))
+            pthread_cond_wait(&pool->start, &pool->mutex);
+
+        if(pool->stop)
+            break;
+
+        generation = pool->generation;
+
+        pthread_mutex_unlock(&pool->mutex);
+
+        pool_run(pool, w->id);
+
+        pthread_mutex_lock(&pool->mutex);
+
+        if(!--pool->busy)
+            pthread_cond_signal(&pool->done);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    return NULL;
+}
+
+/* hint that worker id should run on its own CPU */
+static void pool_affinity(pool_worker *w)
+{
+#if defined(__linux__) && defined(CPU_SET)
+    cpu_set_t set;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if(cpus < 1)
+        return;
+
+    CPU_ZERO(&set);
+    CPU_SET(w->id % cpus, &set);
+
+    /* only a hint; failure is not an error */
+    (void)pthread_setaffinity_np(w->thread, sizeof(set), &set);
+#else
+    (void)w;
+#endif
+}
+
+aes_pool *aes_pool_create(int threads, int flags)
+{
+    aes_pool *pool;
+    void *range;
+    int i;
+
+    if(threads <= 0){
+
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+
+        if(threads <= 0)
+            threads = 1;
+    }
+
+    if(!(pool = calloc(1, sizeof(*pool))))
+        return NULL;
+
+    if(posix_memalign(&range, AES_POOL_LINE, threads * sizeof(pool_range))){
+
+        free(pool);
+        return NULL;
+    }
+
+    pool->range = (pool_range *)range;
+    MEMSET(pool->range, 0x0, threads * sizeof(pool_range));
+
+    if(!(pool->worker = calloc(threads, sizeof(pool_worker)))){
+
+        free(pool->range);
+        free(pool);
+        return NULL;
+    }
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    /* the caller of aes_pool_for() is participant 0 */
+    pool->threads = 1;
+
+    for(i=1; i < threads; i++){
+
+        pool->worker[i].pool = pool;
+        pool->worker[i].id = i;
+
+        if(pthread_create(&pool->worker[i].thread, NULL, pool_thread, &pool->worker[i]))
+            break;
+
+        if(flags & AES_POOL_AFFINITY)
+            pool_affinity(&pool->worker[i]);
+
+        pool->threads++;
+    }
+
+    return pool;
+}
+
+void aes_pool_destroy(aes_pool *pool)
+{
+    int i;
+
+    if(!pool)
+        return;
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    for(i=1; i < pool->threads; i++)
+        pthread_join(pool->worker[i].thread, NULL);
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool->worker);
+    free(pool->range);
+    free(pool);
+}
+
+int aes_pool_threads(const aes_pool *pool)
+{
+    return pool ? pool->threads : 1;
+}
+
+void aes_pool_for(aes_pool *pool, uint32_t n, uint32_t grain, aes_pool_fn fn, void *arg)
+{
+    uint32_t chunks;
+    int i;
+
+    if(!n)
+        return;
+
+    if(!grain)
+        grain = 1;
+
+    chunks = (n / grain) + ((n % grain) ? 1 : 0);
+
+    /* nothing to share */
+    if(!pool || (pool->threads == 1) || (chunks == 1)){
+
+        for(i=0; n; i++){
+
+            fn(arg, i * grain, (n < grain) ? n : grain);
+            n -= (n < grain) ? n : grain;
+        }
+
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    pool->fn = fn;
+    pool->arg = arg;
+    pool->n = n;
+    pool->grain = grain;
+
+    /* contiguous ranges so each participant starts on its own region */
+    for(i=0; i < pool->threads; i++){
+
+        pool->range[i].range = RANGE(
+            ((uint64_t)chunks * i) / pool->threads,
+            ((uint64_t)chunks * (i + 1)) / pool->threads
+        );
+    }
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->busy = pool->threads;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->mutex);
+
+    pool_run(pool, 0);
+
+    pthread_mutex_lock(&pool->mutex);
+
+    if(--pool->busy){
+
+        while(pool->busy)
+            pthread_cond_wait(&pool->done, &pool->mutex);
+    }
+
+    pthread_mutex_unlock(&pool->mutex);
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+#undef RANGE
+#undef RANGE_LO
+#undef RANGE_HI
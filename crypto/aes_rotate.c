@@ -0,0 +1,249 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+
+#include "aes.h"
+#include "common.c"
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+
+/* cache line size assumed for padding */
+#ifndef AES_ROTATE_LINE
+#define AES_ROTATE_LINE 64
+#endif
+
+/* epoch announced by one reading thread
+ *
+ * Records are shared by every aes_rotate and are never freed; the record
+ * of an exited thread is taken by the next thread that needs one.
+ *
+ * */
+typedef struct rotate_reader {
+
+    uint64_t epoch;         /* global epoch on entry; 0 when not reading */
+    uint32_t depth;         /* nested aes_rotate_enter() */
+    int used;               /* owned by a thread */
+    struct rotate_reader *next;
+
+    uint8_t pad[AES_ROTATE_LINE - (2 * sizeof(uint64_t)) - sizeof(void *)];
+
+} rotate_reader;
+
+struct aes_rotate {
+
+    /* context readers are given (read mostly) */
+    aes_ctxt *current;
+    uint8_t pad0[AES_ROTATE_LINE - sizeof(aes_ctxt *)];
+
+    aes_ctxt ctx[2];
+
+    /* epoch after which the context not in current has no readers;
+     * 0 if it had none when last checked */
+    uint64_t retired;
+
+    pthread_mutex_t lock;   /* serialises aes_rotate_key() */
+};
+
+static pthread_once_t rotate_once = PTHREAD_ONCE_INIT;
+static pthread_key_t rotate_key;
+
+static rotate_reader *rotate_readers;   /* every record (push only) */
+static uint64_t rotate_epoch = 1;
+
+static __thread rotate_reader *rotate_self;
+
+/* release the record of an exiting thread */
+static void rotate_exit(void *arg)
+{
+    rotate_reader *self = (rotate_reader *)arg;
+
+    self->depth = 0;
+    __atomic_store_n(&self->epoch, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&self->used, 0, __ATOMIC_RELEASE);
+
+    rotate_self = NULL;
+}
+
+static void rotate_init(void)
+{
+    pthread_key_create(&rotate_key, rotate_exit);
+}
+
+/* first aes_rotate_enter() by this thread */
+static rotate_reader *rotate_register(void)
+{
+    rotate_reader *r;
+    void *mem;
+    int free_record;
+
+    pthread_once(&rotate_once, rotate_init);
+
+    for(r = __atomic_load_n(&rotate_readers, __ATOMIC_ACQUIRE); r; r = r->next){
+
+        free_record = 0;
+
+        if(__atomic_compare_exchange_n(&r->used, &free_record, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+            break;
+    }
+
+    if(!r){
+
+        if(posix_memalign(&mem, AES_ROTATE_LINE, sizeof(*r)))
+            return NULL;
+
+        r = (rotate_reader *)mem;
+        MEMSET(r, 0x0, sizeof(*r));
+        r->used = 1;
+
+        r->next = __atomic_load_n(&rotate_readers, __ATOMIC_RELAXED);
+
+        while(!__atomic_compare_exchange_n(&rotate_readers, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    }
+
+    pthread_setspecific(rotate_key, r);
+
+    rotate_self = r;
+
+    return r;
+}
+
+/* true if no thread has been reading since before epoch */
+static int rotate_drained(uint64_t epoch)
+{
+    rotate_reader *r;
+    uint64_t e;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    for(r = __atomic_load_n(&rotate_readers, __ATOMIC_ACQUIRE); r; r = r->next){
+
+        e = __atomic_load_n(&r->epoch, __ATOMIC_ACQUIRE);
+
+        if(e && (e < epoch))
+            return 0;
+    }
+
+    return 1;
+}
+
+aes_rotate *aes_rotate_create(const uint8_t *k, int k_size)
+{
+    aes_rotate *rot;
+    void *mem;
+
+    if(posix_memalign(&mem, AES_ROTATE_LINE, sizeof(*rot)))
+        return NULL;
+
+    rot = (aes_rotate *)mem;
+    MEMSET(rot, 0x0, sizeof(*rot));
+
+    if(aes_init(&rot->ctx[0], k, k_size)){
+
+        free(rot);
+        return NULL;
+    }
+
+    pthread_mutex_init(&rot->lock, NULL);
+
+    rot->current = &rot->ctx[0];
+
+    return rot;
+}
+
+void aes_rotate_destroy(aes_rotate *rot)
+{
+    if(!rot)
+        return;
+
+    pthread_mutex_destroy(&rot->lock);
+
+    MEMSET(rot->ctx, 0x0, sizeof(rot->ctx));
+
+    free(rot);
+}
+
+const aes_ctxt *aes_rotate_enter(aes_rotate *rot)
+{
+    rotate_reader *self = rotate_self;
+
+    if(!self && !(self = rotate_register()))
+        return NULL;
+
+    if(!self->depth++){
+
+        __atomic_store_n(&self->epoch, __atomic_load_n(&rotate_epoch, __ATOMIC_ACQUIRE), __ATOMIC_RELAXED);
+
+        /* announce before reading current (paired with rotate_drained()) */
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    }
+
+    return __atomic_load_n(&rot->current, __ATOMIC_ACQUIRE);
+}
+
+void aes_rotate_exit(aes_rotate *rot)
+{
+    rotate_reader *self = rotate_self;
+
+    (void)rot;
+
+    if(self && !--self->depth)
+        __atomic_store_n(&self->epoch, 0, __ATOMIC_RELEASE);
+}
+
+int aes_rotate_key(aes_rotate *rot, const uint8_t *k, int k_size, int flags)
+{
+    aes_ctxt *spare;
+
+    if((k_size != AES128_KEY_SIZE) && (k_size != AES192_KEY_SIZE) && (k_size != AES256_KEY_SIZE))
+        return -1;
+
+    pthread_mutex_lock(&rot->lock);
+
+    /* readers may still be using the context replaced last time */
+    while(rot->retired && !rotate_drained(rot->retired)){
+
+        if(flags & AES_ROTATE_NOWAIT){
+
+            pthread_mutex_unlock(&rot->lock);
+            return -1;
+        }
+
+        sched_yield();
+    }
+
+    rot->retired = 0;
+
+    spare = (rot->current == &rot->ctx[0]) ? &rot->ctx[1] : &rot->ctx[0];
+
+    MEMSET(spare, 0x0, sizeof(*spare));
+    aes_init(spare, k, k_size);
+
+    __atomic_store_n(&rot->current, spare, __ATOMIC_RELEASE);
+
+    /* readers announcing this epoch or later see spare */
+    rot->retired = __atomic_add_fetch(&rotate_epoch, 1, __ATOMIC_ACQ_REL);
+
+    pthread_mutex_unlock(&rot->lock);
+
+    return 0;
+}
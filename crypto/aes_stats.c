@@ -0,0 +1,184 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+#include "aes.h"
+#include "common.c"
+
+#include <stdio.h>
+#include <pthread.h>
+
+/* counters of one thread */
+typedef struct stats_thread {
+
+    aes_stats s;
+    struct stats_thread *next;
+
+} stats_thread;
+
+/* number of counters in aes_stats */
+#define STATS_COUNT (sizeof(aes_stats) / sizeof(uint64_t))
+
+static pthread_mutex_t stats_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t stats_key;
+
+/* protected by stats_mutex */
+static stats_thread *stats_threads;     /* threads with counters */
+static aes_stats stats_retired;         /* totals of exited threads */
+static aes_stats stats_base;            /* totals at the last reset */
+
+static __thread stats_thread stats_self;
+
+static const struct {
+
+    const char *name;
+    const char *label;
+    const char *help;   /* NULL for further members of the same family */
+
+} stats_metric[STATS_COUNT] = {
+    {"aes_blocks_enciphered_total", NULL, "Block cipher encryptions."},
+    {"aes_blocks_deciphered_total", NULL, "Block cipher decryptions."},
+    {"aes_ghash_multiplications_total", NULL, "GHASH field multiplications."},
+    {"aes_key_expansions_total", NULL, "Key schedules expanded."},
+    {"aes_gcm_tag_failures_total", NULL, "GCM authentication tag mismatches."},
+    {"aes_wrap_failures_total", NULL, "Key unwrap integrity check failures."},
+    {"aes_bytes_total", "mode=\"ecb\"", "Octets processed by each mode."},
+    {"aes_bytes_total", "mode=\"gcm\"", NULL},
+    {"aes_bytes_total", "mode=\"wrap\"", NULL},
+    {"aes_coalesce_batches_total", NULL, "Batches dispatched by the request coalescer."},
+    {"aes_coalesce_requests_total", NULL, "Requests dispatched by the request coalescer."}
+};
+
+/* acc += counters of t */
+static void stats_add(aes_stats *acc, aes_stats *t)
+{
+    uint64_t *a = (uint64_t *)acc;
+    uint64_t *v = (uint64_t *)t;
+    int i;
+
+    for(i=0; i < STATS_COUNT; i++)
+        a[i] += __atomic_load_n(&v[i], __ATOMIC_RELAXED);
+}
+
+/* fold the counters of an exiting thread into stats_retired */
+static void stats_exit(void *arg)
+{
+    stats_thread *self = (stats_thread *)arg;
+    stats_thread **t;
+
+    pthread_mutex_lock(&stats_mutex);
+
+    stats_add(&stats_retired, &self->s);
+
+    for(t = &stats_threads; *t; t = &(*t)->next){
+
+        if(*t == self){
+
+            *t = self->next;
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&stats_mutex);
+
+    /* counted again from zero if the thread does more work */
+    MEMSET(&self->s, 0x0, sizeof(self->s));
+    stats_local = NULL;
+}
+
+static void stats_init(void)
+{
+    pthread_key_create(&stats_key, stats_exit);
+}
+
+/* first counter update by this thread */
+static aes_stats *stats_register(void)
+{
+    pthread_once(&stats_once, stats_init);
+
+    pthread_mutex_lock(&stats_mutex);
+
+    stats_self.next = stats_threads;
+    stats_threads = &stats_self;
+
+    pthread_mutex_unlock(&stats_mutex);
+
+    pthread_setspecific(stats_key, &stats_self);
+
+    stats_local = &stats_self.s;
+
+    return stats_local;
+}
+
+void aes_stats_snapshot(aes_stats *stats, int reset)
+{
+    aes_stats total;
+    stats_thread *t;
+    uint64_t *out = (uint64_t *)stats;
+    int i;
+
+    pthread_mutex_lock(&stats_mutex);
+
+    total = stats_retired;
+
+    for(t = stats_threads; t; t = t->next)
+        stats_add(&total, &t->s);
+
+    for(i=0; i < STATS_COUNT; i++)
+        out[i] = ((uint64_t *)&total)[i] - ((uint64_t *)&stats_base)[i];
+
+    if(reset)
+        stats_base = total;
+
+    pthread_mutex_unlock(&stats_mutex);
+}
+
+size_t aes_stats_prometheus(const aes_stats *stats, char *buf, size_t size)
+{
+    const uint64_t *v = (const uint64_t *)stats;
+    size_t len = 0;
+    int i, n;
+
+#define STATS_PRINT(...) \
+    if((n = snprintf((len < size) ? buf + len : NULL, (len < size) ? size - len : 0, __VA_ARGS__)) > 0) \
+        len += n;
+
+    for(i=0; i < STATS_COUNT; i++){
+
+        if(stats_metric[i].help){
+
+            STATS_PRINT("# HELP %s %s\n# TYPE %s counter\n", stats_metric[i].name, stats_metric[i].help, stats_metric[i].name)
+        }
+
+        if(stats_metric[i].label){
+
+            STATS_PRINT("%s{%s} %llu\n", stats_metric[i].name, stats_metric[i].label, (unsigned long long)v[i])
+        }
+        else{
+
+            STATS_PRINT("%s %llu\n", stats_metric[i].name, (unsigned long long)v[i])
+        }
+    }
+
+#undef STATS_PRINT
+
+    return len;
+}
@@ -0,0 +1,401 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+#include "aes.h"
+#include "common.c"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define STORE_MAGIC     "mAESstr"
+#define STORE_ORDER     0x01020304
+#define STORE_ALIGN     64
+
+typedef struct {
+
+    uint8_t magic[8];
+    uint32_t version;
+    uint32_t order;         /* STORE_ORDER in the writer's byte order */
+    uint32_t ctxt_size;     /* sizeof(aes_ctxt) of the writer */
+    uint32_t stride;        /* octets from one record to the next */
+    uint32_t count;
+    uint32_t check;         /* CRC-32 of the header with check zero */
+    uint8_t pad[32];
+
+} store_header;
+
+typedef struct {
+
+    aes_ctxt aes;
+    uint32_t check;         /* CRC-32 of aes and id */
+    uint64_t id;
+
+} store_record;
+
+struct aes_store {
+
+    const uint8_t *map;
+    size_t size;
+    uint32_t stride;
+    uint32_t count;
+
+    /* per record: 1 once its check has passed (outside the read-only
+     * mapping so that each record is only checked on first use) */
+    uint8_t *verified;
+};
+
+#define RECORD(BASE, STRIDE, I) ((store_record *)((BASE) + sizeof(store_header) + ((size_t)(STRIDE) * (I))))
+
+/* CRC-32 (IEEE 802.3) an octet at a time */
+static uint32_t store_crc(uint32_t crc, const void *buf, size_t size)
+{
+    static const uint32_t table[256] = {
+        0x00000000, 0x77073096, 0xee0e612c, 0x990951ba, 0x076dc419, 0x706af48f, 0xe963a535, 0x9e6495a3,
+        0x0edb8832, 0x79dcb8a4, 0xe0d5e91e, 0x97d2d988, 0x09b64c2b, 0x7eb17cbd, 0xe7b82d07, 0x90bf1d91,
+        0x1db71064, 0x6ab020f2, 0xf3b97148, 0x84be41de, 0x1adad47d, 0x6ddde4eb, 0xf4d4b551, 0x83d385c7,
+        0x136c9856, 0x646ba8c0, 0xfd62f97a, 0x8a65c9ec, 0x14015c4f, 0x63066cd9, 0xfa0f3d63, 0x8d080df5,
+        0x3b6e20c8, 0x4c69105e, 0xd56041e4, 0xa2677172, 0x3c03e4d1, 0x4b04d447, 0xd20d85fd, 0xa50ab56b,
+        0x35b5a8fa, 0x42b2986c, 0xdbbbc9d6, 0xacbcf940, 0x32d86ce3, 0x45df5c75, 0xdcd60dcf, 0xabd13d59,
+        0x26d930ac, 0x51de003a, 0xc8d75180, 0xbfd06116, 0x21b4f4b5, 0x56b3c423, 0xcfba9599, 0xb8bda50f,
+        0x2802b89e, 0x5f058808, 0xc60cd9b2, 0xb10be924, 0x2f6f7c87, 0x58684c11, 0xc1611dab, 0xb6662d3d,
+        0x76dc4190, 0x01db7106, 0x98d220bc, 0xefd5102a, 0x71b18589, 0x06b6b51f, 0x9fbfe4a5, 0xe8b8d433,
+        0x7807c9a2, 0x0f00f934, 0x9609a88e, 0xe10e9818, 0x7f6a0dbb, 0x086d3d2d, 0x91646c97, 0xe6635c01,
+        0x6b6b51f4, 0x1c6c6162, 0x856530d8, 0xf262004e, 0x6c0695ed, 0x1b01a57b, 0x8208f4c1, 0xf50fc457,
+        0x65b0d9c6, 0x12b7e950, 0x8bbeb8ea, 0xfcb9887c, 0x62dd1ddf, 0x15da2d49, 0x8cd37cf3, 0xfbd44c65,
+        0x4db26158, 0x3ab551ce, 0xa3bc0074, 0xd4bb30e2, 0x4adfa541, 0x3dd895d7, 0xa4d1c46d, 0xd3d6f4fb,
+        0x4369e96a, 0x346ed9fc, 0xad678846, 0xda60b8d0, 0x44042d73, 0x33031de5, 0xaa0a4c5f, 0xdd0d7cc9,
+        0x5005713c, 0x270241aa, 0xbe0b1010, 0xc90c2086, 0x5768b525, 0x206f85b3, 0xb966d409, 0xce61e49f,
+        0x5edef90e, 0x29d9c998, 0xb0d09822, 0xc7d7a8b4, 0x59b33d17, 0x2eb40d81, 0xb7bd5c3b, 0xc0ba6cad,
+        0xedb88320, 0x9abfb3b6, 0x03b6e20c, 0x74b1d29a, 0xead54739, 0x9dd277af, 0x04db2615, 0x73dc1683,
+        0xe3630b12, 0x94643b84, 0x0d6d6a3e, 0x7a6a5aa8, 0xe40ecf0b, 0x9309ff9d, 0x0a00ae27, 0x7d079eb1,
+        0xf00f9344, 0x8708a3d2, 0x1e01f268, 0x6906c2fe, 0xf762575d, 0x806567cb, 0x196c3671, 0x6e6b06e7,
+        0xfed41b76, 0x89d32be0, 0x10da7a5a, 0x67dd4acc, 0xf9b9df6f, 0x8ebeeff9, 0x17b7be43, 0x60b08ed5,
+        0xd6d6a3e8, 0xa1d1937e, 0x38d8c2c4, 0x4fdff252, 0xd1bb67f1, 0xa6bc5767, 0x3fb506dd, 0x48b2364b,
+        0xd80d2bda, 0xaf0a1b4c, 0x36034af6, 0x41047a60, 0xdf60efc3, 0xa867df55, 0x316e8eef, 0x4669be79,
+        0xcb61b38c, 0xbc66831a, 0x256fd2a0, 0x5268e236, 0xcc0c7795, 0xbb0b4703, 0x220216b9, 0x5505262f,
+        0xc5ba3bbe, 0xb2bd0b28, 0x2bb45a92, 0x5cb36a04, 0xc2d7ffa7, 0xb5d0cf31, 0x2cd99e8b, 0x5bdeae1d,
+        0x9b64c2b0, 0xec63f226, 0x756aa39c, 0x026d930a, 0x9c0906a9, 0xeb0e363f, 0x72076785, 0x05005713,
+        0x95bf4a82, 0xe2b87a14, 0x7bb12bae, 0x0cb61b38, 0x92d28e9b, 0xe5d5be0d, 0x7cdcefb7, 0x0bdbdf21,
+        0x86d3d2d4, 0xf1d4e242, 0x68ddb3f8, 0x1fda836e, 0x81be16cd, 0xf6b9265b, 0x6fb077e1, 0x18b74777,
+        0x88085ae6, 0xff0f6a70, 0x66063bca, 0x11010b5c, 0x8f659eff, 0xf862ae69, 0x616bffd3, 0x166ccf45,
+        0xa00ae278, 0xd70dd2ee, 0x4e048354, 0x3903b3c2, 0xa7672661, 0xd06016f7, 0x4969474d, 0x3e6e77db,
+        0xaed16a4a, 0xd9d65adc, 0x40df0b66, 0x37d83bf0, 0xa9bcae53, 0xdebb9ec5, 0x47b2cf7f, 0x30b5ffe9,
+        0xbdbdf21c, 0xcabac28a, 0x53b39330, 0x24b4a3a6, 0xbad03605, 0xcdd70693, 0x54de5729, 0x23d967bf,
+        0xb3667a2e, 0xc4614ab8, 0x5d681b02, 0x2a6f2b94, 0xb40bbe37, 0xc30c8ea1, 0x5a05df1b, 0x2d02ef8d
+    };
+    const uint8_t *p = (const uint8_t *)buf;
+
+    crc = ~crc;
+
+    while(size--)
+        crc = (crc >> 8) ^ table[(crc ^ *p++) & 0xff];
+
+    return ~crc;
+}
+
+static uint32_t store_record_crc(const store_record *rec)
+{
+    return store_crc(store_crc(0, &rec->aes, sizeof(rec->aes)), &rec->id, sizeof(rec->id));
+}
+
+static uint32_t store_header_crc(const store_header *hdr)
+{
+    store_header h = *hdr;
+
+    h.check = 0;
+
+    return store_crc(0, &h, sizeof(h));
+}
+
+/* fsync the directory holding path so that a rename into it is durable */
+static int store_sync_dir(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+    char *dir;
+    int fd, ret;
+
+    if(!slash){
+
+        fd = open(".", O_RDONLY | O_CLOEXEC);
+    }
+    else{
+
+        if(!(dir = malloc((slash - path) + 2)))
+            return -1;
+
+        /* "/" for a file in the root directory */
+        MEMCPY(dir, path, (slash == path) ? 1 : (slash - path));
+        dir[(slash == path) ? 1 : (slash - path)] = 0;
+
+        fd = open(dir, O_RDONLY | O_CLOEXEC);
+
+        free(dir);
+    }
+
+    if(fd < 0)
+        return -1;
+
+    ret = fsync(fd);
+
+    close(fd);
+
+    return ret;
+}
+
+static int store_cmp(const void *a, const void *b)
+{
+    uint64_t x = ((const store_record *)a)->id;
+    uint64_t y = ((const store_record *)b)->id;
+
+    return (x > y) - (x < y);
+}
+
+int aes_store_write(const char *path, const aes_store_key *keys, uint32_t n)
+{
+    store_header hdr;
+    store_record *rec;
+    uint32_t stride = ((sizeof(store_record) + STORE_ALIGN - 1) / STORE_ALIGN) * STORE_ALIGN;
+    uint8_t *buf;
+    size_t size = sizeof(store_header) + ((size_t)stride * n);
+    char *tmp;
+    FILE *f;
+    uint32_t i;
+    int fd, ok, ret = -1;
+
+    /* expanded and sorted in an array, then laid out at the file stride */
+    if(!(buf = calloc(1, size)))
+        return -1;
+
+    rec = (store_record *)calloc(n ? n : 1, sizeof(store_record));
+    tmp = malloc(strlen(path) + 8);
+
+    if(!rec || !tmp)
+        goto out;
+
+    for(i=0; i < n; i++){
+
+        if(aes_init(&rec[i].aes, keys[i].k, keys[i].k_size))
+            goto out;
+
+        rec[i].id = keys[i].id;
+    }
+
+    qsort(rec, n, sizeof(store_record), store_cmp);
+
+    for(i=0; i < n; i++){
+
+        if(i && (rec[i].id == rec[i - 1].id))
+            goto out;
+
+        rec[i].check = store_record_crc(&rec[i]);
+        MEMCPY(RECORD(buf, stride, i), &rec[i], sizeof(store_record));
+    }
+
+    MEMSET(&hdr, 0x0, sizeof(hdr));
+    MEMCPY(hdr.magic, STORE_MAGIC, sizeof(STORE_MAGIC));
+    hdr.version = AES_STORE_VERSION;
+    hdr.order = STORE_ORDER;
+    hdr.ctxt_size = sizeof(aes_ctxt);
+    hdr.stride = stride;
+    hdr.count = n;
+    hdr.check = store_header_crc(&hdr);
+
+    MEMCPY(buf, &hdr, sizeof(hdr));
+
+    /* a unique temporary file readable by the owner only */
+    strcpy(tmp, path);
+    strcat(tmp, ".XXXXXX");
+
+    if((fd = mkstemp(tmp)) < 0)
+        goto out;
+
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    if(!(f = fdopen(fd, "wb"))){
+
+        close(fd);
+        remove(tmp);
+        goto out;
+    }
+
+    ok = (fwrite(buf, 1, size, f) == size) && !fflush(f) && !fsync(fileno(f));
+
+    if(fclose(f))
+        ok = 0;
+
+    if(!ok || rename(tmp, path)){
+
+        remove(tmp);
+        goto out;
+    }
+
+    if(store_sync_dir(path))
+        goto out;
+
+    ret = 0;
+
+out:
+    /* expanded keys are secret */
+    MEMSET(buf, 0x0, size);
+
+    if(rec)
+        MEMSET(rec, 0x0, (n ? n : 1) * sizeof(store_record));
+
+    free(tmp);
+    free(rec);
+    free(buf);
+
+    return ret;
+}
+
+aes_store *aes_store_open(const char *path, int flags)
+{
+    aes_store *store;
+    const store_header *hdr;
+    const store_record *rec;
+    struct stat st;
+    void *map;
+    int fd;
+    uint32_t i;
+
+    if((fd = open(path, O_RDONLY | O_CLOEXEC)) < 0)
+        return NULL;
+
+    if(fstat(fd, &st) || (st.st_size < (off_t)sizeof(store_header))){
+
+        close(fd);
+        return NULL;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if(map == MAP_FAILED)
+        return NULL;
+
+    hdr = (const store_header *)map;
+
+    if(MEMCMP(hdr->magic, STORE_MAGIC, sizeof(STORE_MAGIC)) ||
+        (hdr->version != AES_STORE_VERSION) ||
+        (hdr->order != STORE_ORDER) ||
+        (hdr->ctxt_size != sizeof(aes_ctxt)) ||
+        (hdr->stride < sizeof(store_record)) ||
+        (hdr->stride % STORE_ALIGN) ||
+        (hdr->check != store_header_crc(hdr)) ||
+        ((size_t)st.st_size != (sizeof(store_header) + ((size_t)hdr->stride * hdr->count)))){
+
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    if(!(store = malloc(sizeof(*store))) || !(store->verified = calloc(hdr->count ? hdr->count : 1, 1))){
+
+        free(store);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    store->map = (const uint8_t *)map;
+    store->size = st.st_size;
+    store->stride = hdr->stride;
+    store->count = hdr->count;
+
+    if(flags & AES_STORE_VERIFY){
+
+        for(i=0; i < hdr->count; i++){
+
+            rec = RECORD((const uint8_t *)map, hdr->stride, i);
+
+            if((rec->check != store_record_crc(rec)) || (i && (rec->id <= RECORD((const uint8_t *)map, hdr->stride, i - 1)->id))){
+
+                aes_store_close(store);
+                return NULL;
+            }
+
+            store->verified[i] = 1;
+        }
+    }
+
+    return store;
+}
+
+void aes_store_close(aes_store *store)
+{
+    if(!store)
+        return;
+
+    munmap((void *)store->map, store->size);
+    free(store->verified);
+    free(store);
+}
+
+uint32_t aes_store_count(const aes_store *store)
+{
+    return store->count;
+}
+
+const aes_ctxt *aes_store_get(const aes_store *store, uint64_t id)
+{
+    const store_record *rec;
+    uint32_t lo = 0, hi = store->count, mid;
+
+    while(lo < hi){
+
+        mid = lo + ((hi - lo) >> 1);
+        rec = RECORD(store->map, store->stride, mid);
+
+        if(rec->id < id){
+
+            lo = mid + 1;
+        }
+        else if(rec->id > id){
+
+            hi = mid;
+        }
+        else{
+
+            break;
+        }
+    }
+
+    if(lo >= hi)
+        return NULL;
+
+    /* first use: check the record once; a racing thread repeats the
+     * same check harmlessly */
+    if(!__atomic_load_n(&store->verified[mid], __ATOMIC_ACQUIRE)){
+
+        if(rec->check != store_record_crc(rec))
+            return NULL;
+
+        __atomic_store_n(&store->verified[mid], 1, __ATOMIC_RELEASE);
+    }
+
+    return &rec->aes;
+}
+
+#undef RECORD
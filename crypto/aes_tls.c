@@ -0,0 +1,195 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+
+#include "aes.h"
+#include "common.c"
+
+/* TLSCiphertext.opaque_type and legacy_record_version */
+#define TLS_APPLICATION_DATA    23
+#define TLS_VERSION_MAJOR       3
+#define TLS_VERSION_MINOR       3
+
+/* per-record nonce (RFC 8446 5.3) as the GCM pre-counter block */
+static void tls_j0(const aes_tls_key *key, __word_t *JJ)
+{
+    uint8_t *j = (uint8_t *)JJ;
+    int i;
+
+    MEMCPY(JJ, counter_init, sizeof(__word_t) * WORD_BLOCK);
+    MEMCPY(JJ, key->iv, GCM_IV_SIZE);
+
+    for(i=0; i < 8; i++)
+        j[GCM_IV_SIZE - 1 - i] ^= (uint8_t)(key->seq >> (i * 8));
+}
+
+/* XX = tag of the record header and n octets of ciphertext */
+static void tls_tag(const aes_tls_key *key, const __word_t *JJ, const uint8_t *rec, uint32_t n, __word_t *XX)
+{
+    __word_t HH[WORD_BLOCK];
+    __word_t EJ[WORD_BLOCK];
+    uint8_t sz[AES_BLOCK_SIZE];
+
+    MEMCPY(HH, key->gcm.H, sizeof(HH));
+
+    xor128(XX, XX);
+    gcm_hash(XX, HH, rec, AES_TLS_HEADER);
+    gcm_hash(XX, HH, rec + AES_TLS_HEADER, n);
+    gcm_lengths(sz, AES_TLS_HEADER, n);
+    xor128(XX, (__word_t *)sz);
+    galois_mul128(XX, HH);
+
+    MEMCPY(EJ, JJ, sizeof(EJ));
+    aes_encr(&key->gcm.aes, (uint8_t *)EJ);
+    xor128(XX, EJ);
+
+    xor128(HH, HH);
+    xor128(EJ, EJ);
+}
+
+int aes_tls_key_init(aes_tls_key *key, const uint8_t *k, int k_size, const uint8_t *iv)
+{
+    if(aes_gmac_init(&key->gcm, k, k_size))
+        return -1;
+
+    MEMCPY(key->iv, iv, GCM_IV_SIZE);
+    key->seq = 0;
+
+    return 0;
+}
+
+int aes_tls_seal(aes_tls_ctxt *tls, uint8_t *rec, uint32_t size, uint8_t type, uint32_t pad)
+{
+    aes_tls_key *key = &tls->write;
+    __word_t JJ[WORD_BLOCK];
+    __word_t count[WORD_BLOCK];
+    __word_t XX[WORD_BLOCK];
+    uint8_t *body = rec + AES_TLS_HEADER;
+    uint32_t n, len;
+
+    if((size > AES_TLS_MAX_PLAINTEXT) || (pad > (AES_TLS_MAX_PLAINTEXT - size)) || (key->seq == UINT64_MAX))
+        return -1;
+
+    /* TLSInnerPlaintext */
+    body[size] = type;
+    MEMSET(body + size + 1, 0x0, pad);
+
+    n = size + 1 + pad;
+    len = n + GCM_TAG_SIZE;
+
+    rec[0] = TLS_APPLICATION_DATA;
+    rec[1] = TLS_VERSION_MAJOR;
+    rec[2] = TLS_VERSION_MINOR;
+    rec[3] = len >> 8;
+    rec[4] = len;
+
+    AES_STAT_ADD(gcm_bytes, n);
+
+    tls_j0(key, JJ);
+    copy128(count, JJ);
+
+    gcm_ctr(&key->gcm.aes, count, body, body, n);
+    tls_tag(key, JJ, rec, n, XX);
+
+    MEMCPY(body + n, XX, GCM_TAG_SIZE);
+
+    key->seq++;
+
+    return AES_TLS_HEADER + len;
+}
+
+int aes_tls_open(aes_tls_ctxt *tls, uint8_t *rec, uint32_t rec_size, uint8_t *type)
+{
+    aes_tls_key *key = &tls->read;
+    __word_t JJ[WORD_BLOCK];
+    __word_t XX[WORD_BLOCK];
+    uint8_t *body = rec + AES_TLS_HEADER;
+    uint32_t n, len;
+
+    if((rec_size < (AES_TLS_HEADER + GCM_TAG_SIZE + 1)) || (key->seq == UINT64_MAX))
+        return -1;
+
+    len = ((uint32_t)rec[3] << 8) | rec[4];
+
+    if((rec[0] != TLS_APPLICATION_DATA) || (rec[1] != TLS_VERSION_MAJOR) || (rec[2] != TLS_VERSION_MINOR)
+        || (len != (rec_size - AES_TLS_HEADER)) || (len > (AES_TLS_MAX_PLAINTEXT + 256)))
+        return -1;
+
+    n = len - GCM_TAG_SIZE;
+
+    AES_STAT_ADD(gcm_bytes, n);
+
+    /* nothing is deciphered unless the tag matches */
+    tls_j0(key, JJ);
+    tls_tag(key, JJ, rec, n, XX);
+
+    if(MEMCMP_CT(XX, body + n, GCM_TAG_SIZE)){
+
+        AES_STAT_ADD(gcm_tag_failures, 1);
+        AES_PROBE2("gcm_tag_failure", n, AES_TLS_HEADER);
+
+        return -1;
+    }
+
+    gcm_ctr(&key->gcm.aes, JJ, body, body, n);
+
+    key->seq++;
+
+    /* content type is the last non-zero octet */
+    while(n && !body[n - 1])
+        n--;
+
+    if(!n)
+        return -1;
+
+    *type = body[n - 1];
+
+    return n - 1;
+}
+
+uint32_t aes_tls_seal_records(aes_tls_ctxt *tls, aes_tls_record *r, uint32_t n)
+{
+    uint32_t i, done;
+
+    for(i=0; i < n; i++)
+        r[i].ret = -1;
+
+    for(done=0; (done < n) && ((r[done].ret = aes_tls_seal(tls, r[done].rec, r[done].size, r[done].type, r[done].pad)) >= 0); done++);
+
+    return done;
+}
+
+uint32_t aes_tls_open_records(aes_tls_ctxt *tls, aes_tls_record *r, uint32_t n)
+{
+    uint32_t i, done;
+
+    for(i=0; i < n; i++)
+        r[i].ret = -1;
+
+    /* a record which fails ends the connection */
+    for(done=0; (done < n) && ((r[done].ret = aes_tls_open(tls, r[done].rec, r[done].size, &r[done].type)) >= 0); done++);
+
+    return done;
+}
+
+#undef TLS_APPLICATION_DATA
+#undef TLS_VERSION_MAJOR
+#undef TLS_VERSION_MINOR
@@ -0,0 +1,239 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+#include "aes.h"
+#include "common.c"
+
+#include <time.h>
+
+/* a compiled in backend */
+typedef struct {
+
+    int op;
+    const char *name;
+    void (*bind)(void);
+    void (*run)(const aes_ctxt *aes, __word_t *XX);
+    int vartime;
+    uint64_t rate;
+
+} tune_backend;
+
+static void bind_encr_byte(void)
+{
+    __atomic_store_n(&encr_backend, encr_byte, __ATOMIC_RELEASE);
+}
+
+static void bind_encr_table(void)
+{
+    tables_init();
+    __atomic_store_n(&encr_backend, encr_table, __ATOMIC_RELEASE);
+}
+
+static void run_encr_byte(const aes_ctxt *aes, __word_t *XX)
+{
+    encr_byte(aes, (uint8_t *)XX);
+}
+
+static void run_encr_table(const aes_ctxt *aes, __word_t *XX)
+{
+    encr_table(aes, (uint8_t *)XX);
+}
+
+#ifdef AES_GCM
+static void bind_ghash_shift(void)
+{
+    __atomic_store_n(&galois_mul128_backend, galois_mul128_shift, __ATOMIC_RELEASE);
+}
+
+static void bind_ghash_ctmul(void)
+{
+    __atomic_store_n(&galois_mul128_backend, galois_mul128_ctmul, __ATOMIC_RELEASE);
+}
+
+static void run_ghash_shift(const aes_ctxt *aes, __word_t *XX)
+{
+    galois_mul128_shift(XX, XX + WORD_BLOCK);
+}
+
+static void run_ghash_ctmul(const aes_ctxt *aes, __word_t *XX)
+{
+    galois_mul128_ctmul(XX, XX + WORD_BLOCK);
+}
+#endif
+
+/* the first backend of each operation is the default */
+static tune_backend tune_backends[] = {
+    {AES_TUNE_ENCR, "byte", bind_encr_byte, run_encr_byte, 0, 0},
+    {AES_TUNE_ENCR, "table", bind_encr_table, run_encr_table, 1, 0},
+#ifdef AES_GCM
+    {AES_TUNE_GHASH, "shift", bind_ghash_shift, run_ghash_shift, 0, 0},
+    {AES_TUNE_GHASH, "ctmul", bind_ghash_ctmul, run_ghash_ctmul, 0, 0},
+#endif
+};
+
+#define TUNE_COUNT (sizeof(tune_backends) / sizeof(*tune_backends))
+
+/* index of the bound backend of each operation */
+static int tune_selected[AES_TUNE_GHASH + 1] = {-1, -1};
+
+static uint64_t tune_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+/* run a backend on one block n times without binding it */
+static void tune_run(const tune_backend *b, const aes_ctxt *aes, __word_t *XX, uint32_t n)
+{
+    while(n--)
+        b->run(aes, XX);
+}
+
+/* best of three runs of budget_us / 3; octets per second */
+static uint64_t tune_measure(const tune_backend *b, const aes_ctxt *aes, uint32_t budget_us)
+{
+    __word_t XX[2 * WORD_BLOCK];
+    uint64_t start, ns, n, rate, best = 0;
+    int i;
+
+    MEMSET(XX, 0x5a, sizeof(XX));
+
+    /* warm the tables and branch predictors */
+    tune_run(b, aes, XX, 16);
+
+    for(i=0; i < 3; i++){
+
+        n = 0;
+        start = tune_ns();
+
+        do{
+
+            tune_run(b, aes, XX, 16);
+            n += 16;
+        }
+        while((ns = tune_ns() - start) < ((uint64_t)budget_us * 1000 / 3));
+
+        rate = (n * AES_BLOCK_SIZE * 1000000000) / (ns ? ns : 1);
+        best = (rate > best) ? rate : best;
+    }
+
+    return best;
+}
+
+void aes_tune(uint32_t budget_us)
+{
+    static const uint8_t key[AES128_KEY_SIZE] = {0};
+
+    aes_ctxt aes;
+    int i, op;
+
+    if(!budget_us)
+        budget_us = AES_TUNE_US;
+
+    aes_init(&aes, key, sizeof(key));
+    tables_init();
+
+    /* the bound backends stay in use while the others are measured */
+    for(i=0; i < TUNE_COUNT; i++)
+        tune_backends[i].rate = tune_measure(&tune_backends[i], &aes, budget_us);
+
+    for(op = AES_TUNE_ENCR; op <= AES_TUNE_GHASH; op++){
+
+        tune_selected[op] = -1;
+
+        /* the earlier backend wins a tie */
+        for(i=0; i < TUNE_COUNT; i++){
+
+            if(tune_backends[i].op != op)
+                continue;
+
+#ifndef AES_TUNE_VARTIME
+            /* variable time backends only by aes_tune_select() */
+            if(tune_backends[i].vartime)
+                continue;
+#endif
+            if((tune_selected[op] < 0) || (tune_backends[i].rate > tune_backends[tune_selected[op]].rate))
+                tune_selected[op] = i;
+        }
+
+        if(tune_selected[op] >= 0)
+            tune_backends[tune_selected[op]].bind();
+    }
+}
+
+uint32_t aes_tune_results(int op, aes_tune_result *res, uint32_t max)
+{
+    uint32_t n = 0;
+    int i, first = -1;
+
+    for(i=0; i < TUNE_COUNT; i++){
+
+        if(tune_backends[i].op != op)
+            continue;
+
+        if(first < 0)
+            first = i;
+
+        if(n < max){
+
+            res[n].name = tune_backends[i].name;
+            res[n].rate = tune_backends[i].rate;
+            res[n].vartime = tune_backends[i].vartime;
+            res[n].selected = (tune_selected[op] == i);
+        }
+
+        n++;
+    }
+
+    /* nothing bound yet: the default is in use */
+    if((first >= 0) && (tune_selected[op] < 0) && max)
+        res[0].selected = 1;
+
+    return n;
+}
+
+int aes_tune_select(int op, const char *name)
+{
+    int i, j;
+
+    for(i=0; i < TUNE_COUNT; i++){
+
+        if(tune_backends[i].op != op)
+            continue;
+
+        for(j=0; name[j] && (name[j] == tune_backends[i].name[j]); j++);
+
+        if(name[j] == tune_backends[i].name[j]){
+
+            tune_backends[i].bind();
+            tune_selected[op] = i;
+
+            return 0;
+        }
+    }
+
+    return -1;
+}
+
+#undef TUNE_COUNT
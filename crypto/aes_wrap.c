@@ -24,100 +24,396 @@
 
 #define WRAP_BLOCK (AES_BLOCK_SIZE >> 1)
 
+/* number of wraps advanced in lockstep */
+#define WRAP_LANES 8
+
+/* wrap_batch() flags */
+#define WRAP_DECR   0x1     /* unwrap */
+#define WRAP_PAD    0x2     /* RFC 5649 padding */
+
 static const unsigned char default_iv[] = {
     0xA6, 0xA6, 0xA6, 0xA6, 0xA6, 0xA6, 0xA6, 0xA6,
 };
 
-int aes_wrap_init(aes_ctxt *aes, const uint8_t *k, int k_size)
+/* RFC 5649 alternative IV (first half) */
+static const unsigned char kwp_iv[] = {
+    0xA6, 0x59, 0x59, 0xA6
+};
+
+/* B = A || R */
+typedef union {
+
+    uint8_t b[AES_BLOCK_SIZE];
+    uint64_t w[2];
+
+} wrap_block;
+
+/* progress of one wrap through the lockstep scheduler */
+typedef struct {
+
+    aes_wrap_req *req;
+
+    uint8_t *R;         /* R[1] */
+    uint32_t n;         /* number of R registers */
+    uint32_t i;         /* current R register */
+    uint64_t t;         /* step counter */
+    uint64_t steps;     /* steps remaining */
+
+} wrap_lane;
+
+/* t as a big endian 64bit field in memory order */
+inline static uint64_t wrap_t(uint64_t t)
 {
-    return aes_init(aes, k, k_size);
+    wrap_block x;
+    int i;
+
+    for(i=7; i >= 0; i--, t >>= 8)
+        x.b[i] = (uint8_t)t;
+
+    return x.w[0];
 }
 
-int aes_wrap_encipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint16_t in_size, const uint8_t *iv)
+/* check and remove RFC 5649 padding
+ *
+ * *A integrity check register
+ * *P unwrapped (padded) plaintext
+ * n number of 8 byte blocks in *P
+ * *size returned plaintext size
+ *
+ * */
+static int kwp_check(const uint8_t *A, const uint8_t *P, uint32_t n, uint32_t *size)
 {
-    uint8_t B[AES_BLOCK_SIZE], *R;
-    uint16_t i, j, t = 1;
-    
-    if((in_size % 8) || (in_size < 8))
+    uint32_t mli, i;
+    uint8_t pad = 0;
+
+    mli =   ((uint32_t)A[4] << 24) |
+            ((uint32_t)A[5] << 16) |
+            ((uint32_t)A[6] << 8) |
+            (uint32_t)A[7];
+
+    if(MEMCMP_CT(A, kwp_iv, sizeof(kwp_iv)) || (mli > (n << 3)) || (mli <= ((n - 1) << 3)))
         return -1;
 
-    if(!iv)
-        iv = default_iv;
+    for(i=mli; i < (n << 3); i++)
+        pad |= P[i];
+
+    if(pad)
+        return -1;
+
+    *size = mli;
+    return 0;
+}
+
+/* validate req, load the input into place and set up the lane
+ *
+ * returns 1 if the lane must be stepped, 0 if req is already complete
+ *
+ * */
+static int wrap_start(aes_ctxt *aes, int flags, const uint8_t *iv, aes_wrap_req *req, wrap_lane *lane, wrap_block *B)
+{
+    uint32_t i, n, size = req->in_size;
+
+    req->ret = -1;
+    req->out_size = 0;
+    lane->req = req;
+
+    AES_STAT_ADD(wrap_bytes, size);
+
+    if(flags & WRAP_DECR){
+
+        if((size % 8) || (size < 16))
+            return 0;
 
-    for(i=in_size; i; i-=8){
+        n = (size >> 3) - 1;
 
-        MEMCPY(out + i, in + i - 8, 8);        
+        MEMCPY(B->b, req->in, 8);
+
+        for(i=8; i < size; i+=8){
+
+            MEMCPY(req->out + i - 8, req->in + i, 8);        
+        }
+
+        /* single block is one ECB decryption */
+        if((flags & WRAP_PAD) && (n == 1)){
+
+            MEMCPY(B->b + 8, req->out, 8);
+            aes_decr(aes, B->b);
+            MEMCPY(req->out, B->b + 8, 8);
+
+            if((req->ret = kwp_check(B->b, req->out, 1, &req->out_size)))
+                AES_STAT_ADD(wrap_failures, 1);
+
+            return 0;
+        }
+
+        lane->R = req->out;
+        lane->i = n - 1;
+        lane->t = 6 * (uint64_t)n;
     }
+    else{
+
+        if(flags & WRAP_PAD){
+
+            if(!size)
+                return 0;
+
+            n = (size + 7) >> 3;
+
+            MEMCPY(B->b, kwp_iv, sizeof(kwp_iv));
+            B->b[4] = size >> 24;
+            B->b[5] = size >> 16;
+            B->b[6] = size >> 8;
+            B->b[7] = size;
+
+            /* zero pad and move the incomplete block */
+            i = size & ~7U;
+            MEMSET(req->out + 8 + size, 0x0, (n << 3) - size);
+
+            if(i < size)
+                MEMCPY(req->out + 8 + i, req->in + i, size - i);
+        }
+        else{
+
+            if((size % 8) || (size < 8))
+                return 0;
+
+            n = size >> 3;
+            i = size;
 
-    MEMCPY(B, iv, 8);
-    
-    for(j=0; j < 6; j++){
+            MEMCPY(B->b, iv, 8);
+        }
 
-        R = out + 8;
-        
-        for(i=0; i < (in_size >> 3); i++){
+        for(; i; i-=8){
 
-            MEMCPY(B + 8, R, 8);
+            MEMCPY(req->out + i, req->in + i - 8, 8);        
+        }
 
-            aes_encr(aes, B);
+        /* single block is one ECB encryption */
+        if((flags & WRAP_PAD) && (n == 1)){
 
-            B[7] ^= t;
-            B[6] ^= (t >> 8);
-            t++;
+            MEMCPY(B->b + 8, req->out + 8, 8);
+            aes_encr(aes, B->b);
+            MEMCPY(req->out, B->b, AES_BLOCK_SIZE);
 
-            MEMCPY(R, B + 8, 8);
-            
-            R += 8;            
+            req->out_size = AES_BLOCK_SIZE;
+            req->ret = 0;
+            return 0;
         }
+
+        lane->R = req->out + 8;
+        lane->i = 0;
+        lane->t = 1;
     }
 
-    MEMCPY(out, B, 8);
-    return 0;
+    lane->n = n;
+    lane->steps = 6 * (uint64_t)n;
+
+    return 1;
 }
 
-int aes_wrap_decipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t in_size, const uint8_t *iv)
+/* store the result of a lane which has run all of its steps */
+static void wrap_finish(int flags, const uint8_t *iv, wrap_lane *lane, wrap_block *B)
 {
-    uint8_t B[AES_BLOCK_SIZE], *R;
-    uint16_t i, j, t, n = (in_size >> 3) - 1;
-    
-    if((in_size % 8) || (in_size < 16))
-        return -1;
+    aes_wrap_req *req = lane->req;
+
+    if(!(flags & WRAP_DECR)){
+
+        MEMCPY(req->out, B->b, 8);
+        req->out_size = (lane->n + 1) << 3;
+        req->ret = 0;
+    }
+    else if(flags & WRAP_PAD){
+
+        if((req->ret = kwp_check(B->b, req->out, lane->n, &req->out_size)))
+            AES_STAT_ADD(wrap_failures, 1);
+    }
+    else if(MEMCMP_CT(B->b, iv, 8)){
+
+        AES_STAT_ADD(wrap_failures, 1);
+        req->ret = -1;
+    }
+    else{
+
+        req->out_size = lane->n << 3;
+        req->ret = 0;
+    }
+}
+
+/* advance every active lane by one step */
+static void wrap_step(aes_ctxt *aes, int flags, wrap_block *B, wrap_lane *L, uint32_t active)
+{
+    uint32_t k;
+
+    for(k=0; k < active; k++){
+
+        if(flags & WRAP_DECR)
+            B[k].w[0] ^= wrap_t(L[k].t);
+
+        MEMCPY(&B[k].w[1], L[k].R + (L[k].i << 3), 8);
+    }
+
+    if(flags & WRAP_DECR)
+        aes_decr_blocks(aes, B->b, active);
+    else
+        aes_encr_blocks(aes, B->b, active);
+
+    for(k=0; k < active; k++){
+
+        MEMCPY(L[k].R + (L[k].i << 3), &B[k].w[1], 8);
+
+        if(flags & WRAP_DECR){
+
+            L[k].t--;
+            L[k].i = (L[k].i ? L[k].i : L[k].n) - 1;
+        }
+        else{
+
+            B[k].w[0] ^= wrap_t(L[k].t);
+            L[k].t++;
+            L[k].i = ((L[k].i + 1) == L[k].n) ? 0 : (L[k].i + 1);
+        }
+
+        L[k].steps--;
+    }
+}
+
+/* run n requests through WRAP_LANES lanes
+ *
+ * Lanes that finish are refilled from the remaining requests so that every
+ * step encrypts as many independent blocks as possible.
+ *
+ * */
+static int wrap_batch(aes_ctxt *aes, int flags, const uint8_t *iv, aes_wrap_req *req, uint32_t n)
+{
+    wrap_block B[WRAP_LANES];
+    wrap_lane L[WRAP_LANES];
+    uint32_t k, active = 0, next = 0;
+    int ret = 0;
 
     if(!iv)
         iv = default_iv;
 
-    MEMCPY(B, in, 8);
+    while(1){
 
-    for(i=8; i < in_size; i+=8){
+        while((active < WRAP_LANES) && (next < n)){
 
-        MEMCPY(out + i - 8, in + i, 8);        
-    }
+            if(wrap_start(aes, flags, iv, &req[next], &L[active], &B[active]))
+                active++;
+            else if(req[next].ret)
+                ret = -1;
+
+            next++;
+        }
+
+        if(!active)
+            break;
+
+        wrap_step(aes, flags, B, L, active);
 
-    t =  6 * n;
+        for(k=0; k < active; ){
 
-    for(j=0; j < 6; j++){
+            if(L[k].steps){
 
-        R = out + in_size - 16;
-    
-        for(i=0; i < n; i++){
+                k++;
+                continue;
+            }
 
-            MEMCPY(B + 8, R, 8);
+            wrap_finish(flags, iv, &L[k], &B[k]);
 
-            B[7] ^= t;
-            B[6] ^= (t >> 8);
-            t--;
+            if(L[k].req->ret)
+                ret = -1;
 
-            aes_decr(aes, B);
+            if(k != --active){
 
-            MEMCPY(R, B + 8, 8);
-            
-            R -= 8;            
+                B[k] = B[active];
+                L[k] = L[active];
+            }
         }
     }
 
-    if(MEMCMP(B, iv, 8))
-        return -1;
-    else
-        return 0;
+    MEMSET(B, 0x0, sizeof(B));
+
+    return ret;
+}
+
+int aes_wrap_init(aes_ctxt *aes, const uint8_t *k, int k_size)
+{
+    return aes_init(aes, k, k_size);
+}
+
+int aes_wrap_encipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t in_size, const uint8_t *iv)
+{
+    aes_wrap_req req;
+    int ret;
+
+    AES_PROBE2("wrap_encipher_entry", in_size, KEY_BITS(aes));
+
+    req.out = out;
+    req.in = in;
+    req.in_size = in_size;
+
+    ret = wrap_batch(aes, 0, iv, &req, 1);
+
+    AES_PROBE2("wrap_encipher_return", in_size, ret);
+
+    return ret;
+}
+
+int aes_wrap_decipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t in_size, const uint8_t *iv)
+{
+    aes_wrap_req req;
+
+    req.out = out;
+    req.in = in;
+    req.in_size = in_size;
+
+    return wrap_batch(aes, WRAP_DECR, iv, &req, 1);
+}
+
+int aes_wrap_encipher_batch(aes_ctxt *aes, aes_wrap_req *req, uint32_t n, const uint8_t *iv)
+{
+    return wrap_batch(aes, 0, iv, req, n);
+}
+
+int aes_wrap_decipher_batch(aes_ctxt *aes, aes_wrap_req *req, uint32_t n, const uint8_t *iv)
+{
+    return wrap_batch(aes, WRAP_DECR, iv, req, n);
+}
+
+int aes_kwp_encipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t in_size)
+{
+    aes_wrap_req req;
+
+    req.out = out;
+    req.in = in;
+    req.in_size = in_size;
+
+    return wrap_batch(aes, WRAP_PAD, NULL, &req, 1);
+}
+
+int aes_kwp_decipher(aes_ctxt *aes, uint8_t *out, const uint8_t *in, uint32_t in_size, uint32_t *out_size)
+{
+    aes_wrap_req req;
+    int ret;
+
+    req.out = out;
+    req.in = in;
+    req.in_size = in_size;
+
+    ret = wrap_batch(aes, WRAP_DECR | WRAP_PAD, NULL, &req, 1);
+
+    if(out_size)
+        *out_size = req.out_size;
+
+    return ret;
 }
 
+int aes_kwp_encipher_batch(aes_ctxt *aes, aes_wrap_req *req, uint32_t n)
+{
+    return wrap_batch(aes, WRAP_PAD, NULL, req, n);
+}
+
+int aes_kwp_decipher_batch(aes_ctxt *aes, aes_wrap_req *req, uint32_t n)
+{
+    return wrap_batch(aes, WRAP_DECR | WRAP_PAD, NULL, req, n);
+}
@@ -22,6 +22,7 @@
 #define COMMON_C
 
 #include <stdint.h>
+#include <stddef.h>
 
 #if !defined(NULL)
 #define NULL 0
@@ -47,10 +48,28 @@ typedef uint16_t __word_t;
 typedef uint32_t __word_t;
 #elif __WORD_SIZE == 8
 typedef uint64_t __word_t;
+#elif __WORD_SIZE == 16
+/* one 128bit vector (GCC/Clang vector extension) of two 64bit lanes
+ *
+ * Byte alignment lets byte buffers be cast to __word_t; the compiler
+ * emits unaligned vector loads and stores.
+ *
+ * */
+typedef uint64_t __word_t __attribute__((__vector_size__(16), __aligned__(1)));
 #else
 #error "unknown word size"
 #endif
 
+/* __word_t which may alias any object (for the local memory functions) */
+#if defined(__GNUC__)
+typedef __word_t __attribute__((__may_alias__)) __word_alias_t;
+#else
+typedef __word_t __word_alias_t;
+#endif
+
+/* number of bytes from p to the next word boundary */
+#define WORD_HEAD(P) ((sizeof(__word_t) - ((uintptr_t)(P) & (sizeof(__word_t) - 1))) & (sizeof(__word_t) - 1))
+
 #ifdef __USE_STRING
 
 #include <string.h>
@@ -61,31 +80,97 @@ typedef uint64_t __word_t;
 
 #else
 
-/* local memcpy */
-inline static void __memcpy(void *s1, const void *s2, uint8_t n)
+/* local memcpy
+ *
+ * Whole words are copied when s1 and s2 have the same alignment within a
+ * word, leaving at most a byte head and tail.
+ *
+ * */
+inline static void __memcpy(void *s1, const void *s2, size_t n)
 {
     uint8_t *out = (uint8_t *)s1;
-    const uint8_t *in = (uint8_t *)s2;
+    const uint8_t *in = (const uint8_t *)s2;
+    size_t head;
+
+    if((n >= sizeof(__word_t)) && !(((uintptr_t)out ^ (uintptr_t)in) & (sizeof(__word_t) - 1))){
+
+        for(head = WORD_HEAD(out); head; head--, n--)
+            *out++ = *in++;
+
+        for(; n >= sizeof(__word_t); n -= sizeof(__word_t)){
+
+            *(__word_alias_t *)out = *(const __word_alias_t *)in;
+            out += sizeof(__word_t);
+            in += sizeof(__word_t);
+        }
+    }
 
     while(n--)
         *out++ = *in++;
 }
 
 /* local memset */
-inline static void __memset(void *s, const uint8_t c, uint8_t n)
+inline static void __memset(void *s, const uint8_t c, size_t n)
 {
     uint8_t *out = (uint8_t *)s;
-    
+    __word_t w;
+    size_t head;
+
+    if(n >= sizeof(__word_t)){
+
+        for(head = 0; head < sizeof(w); head++)
+            ((uint8_t *)&w)[head] = c;
+
+        for(head = WORD_HEAD(out); head; head--, n--)
+            *out++ = c;
+
+        for(; n >= sizeof(__word_t); n -= sizeof(__word_t)){
+
+            *(__word_alias_t *)out = w;
+            out += sizeof(__word_t);
+        }
+    }
+
     while(n--)
         *out++ = c;
 }
 
+/* non-zero if a and b differ */
+inline static int word_ne(__word_t a, __word_t b)
+{
+#if __WORD_SIZE == 16
+    __word_t x = a ^ b;
+
+    return (x[0] | x[1]) != 0;
+#else
+    return a != b;
+#endif
+}
+
 /* local memcmp (only indicates same or not same) */
-inline static int __memcmp(const void *s1, const void *s2, uint8_t n)
+inline static int __memcmp(const void *s1, const void *s2, size_t n)
 {
-    const uint8_t *in1 = (uint8_t *)s1;
-    const uint8_t *in2 = (uint8_t *)s2;
-    
+    const uint8_t *in1 = (const uint8_t *)s1;
+    const uint8_t *in2 = (const uint8_t *)s2;
+    size_t head;
+
+    if((n >= sizeof(__word_t)) && !(((uintptr_t)in1 ^ (uintptr_t)in2) & (sizeof(__word_t) - 1))){
+
+        for(head = WORD_HEAD(in1); head; head--, n--){
+            if(*in1++ != *in2++)
+                return -1;
+        }
+
+        for(; n >= sizeof(__word_t); n -= sizeof(__word_t)){
+
+            if(word_ne(*(const __word_alias_t *)in1, *(const __word_alias_t *)in2))
+                return -1;
+
+            in1 += sizeof(__word_t);
+            in2 += sizeof(__word_t);
+        }
+    }
+
     while(n--){
         if(*in1++ != *in2++)
             return -1;
@@ -100,6 +185,104 @@ inline static int __memcmp(const void *s1, const void *s2, uint8_t n)
 
 #endif
 
+/* constant time compare for authentication tags and integrity checks
+ *
+ * Time depends only on n. Returns 0 if same, -1 if not same.
+ *
+ * */
+inline static int __memcmp_ct(const void *s1, const void *s2, size_t n)
+{
+    const volatile uint8_t *in1 = (const volatile uint8_t *)s1;
+    const volatile uint8_t *in2 = (const volatile uint8_t *)s2;
+    uint32_t diff = 0;
+
+    while(n--)
+        diff |= *in1++ ^ *in2++;
+
+    /* 0 if diff is 0, otherwise -1 */
+    return -(int)((diff + 0xff) >> 8);
+}
+
+#define MEMCMP_CT __memcmp_ct
+
+/* statistics counters (aes_stats.c)
+ *
+ * AES_STAT_ADD(field, n) adds n to an aes_stats field of the calling
+ * thread. Only the owning thread writes its counters so a relaxed load and
+ * store is enough; readers never see a torn value.
+ *
+ * */
+#ifdef AES_STATS
+
+static __thread aes_stats *stats_local;
+static aes_stats *stats_register(void);
+
+#define AES_STAT_ADD(F, N) do{ \
+    aes_stats *s_ = stats_local ? stats_local : stats_register(); \
+    __atomic_store_n(&s_->F, __atomic_load_n(&s_->F, __ATOMIC_RELAXED) + (uint64_t)(N), __ATOMIC_RELAXED); \
+}while(0)
+
+#else
+
+#define AES_STAT_ADD(F, N) do{ }while(0)
+
+#endif
+
+/* USDT probes (SystemTap SDT v3 notes, no-op nops unless attached)
+ *
+ * AES_PROBEn("name", args...) marks provider "maes" probe "name" with n
+ * arguments, each passed as a signed 64bit value. The note layout is that
+ * of <sys/sdt.h> so that perf, bpftrace and SystemTap find the probes
+ * without it being installed.
+ *
+ * */
+#if defined(AES_USDT) && defined(__ELF__) && (defined(__x86_64__) || defined(__aarch64__))
+
+#define PROBE_NOTE(NAME, ARGS, ...) __asm__ __volatile__ ( \
+    "990: nop\n" \
+    ".pushsection .note.stapsdt,\"?\",\"note\"\n" \
+    ".balign 4\n" \
+    ".4byte 992f-991f, 994f-993f, 3\n" \
+    "991: .asciz \"stapsdt\"\n" \
+    "992: .balign 4\n" \
+    "993: .8byte 990b\n" \
+    ".8byte _.stapsdt.base\n" \
+    ".8byte 0\n" \
+    ".asciz \"maes\"\n" \
+    ".asciz \"" NAME "\"\n" \
+    ".asciz \"" ARGS "\"\n" \
+    "994: .balign 4\n" \
+    ".popsection\n" \
+    ".ifndef _.stapsdt.base\n" \
+    ".pushsection .stapsdt.base,\"aG\",\"progbits\",.stapsdt.base,comdat\n" \
+    ".weak _.stapsdt.base\n" \
+    ".hidden _.stapsdt.base\n" \
+    "_.stapsdt.base: .space 1\n" \
+    ".size _.stapsdt.base, 1\n" \
+    ".popsection\n" \
+    ".endif\n" \
+    :: __VA_ARGS__)
+
+#define AES_PROBE1(NAME, A1) \
+    PROBE_NOTE(NAME, "-8@%[a1]", [a1] "nor" ((int64_t)(A1)))
+
+#define AES_PROBE2(NAME, A1, A2) \
+    PROBE_NOTE(NAME, "-8@%[a1] -8@%[a2]", [a1] "nor" ((int64_t)(A1)), [a2] "nor" ((int64_t)(A2)))
+
+#define AES_PROBE3(NAME, A1, A2, A3) \
+    PROBE_NOTE(NAME, "-8@%[a1] -8@%[a2] -8@%[a3]", [a1] "nor" ((int64_t)(A1)), [a2] "nor" ((int64_t)(A2)), [a3] "nor" ((int64_t)(A3)))
+
+#else
+
+#define AES_PROBE1(NAME, A1) do{ }while(0)
+#define AES_PROBE2(NAME, A1, A2) do{ }while(0)
+#define AES_PROBE3(NAME, A1, A2, A3) do{ }while(0)
+
+#endif
+
+/* key size in bits from the number of rounds */
+#define KEY_BITS(AES) (((AES)->r - 6) * 32)
+
 /* block size but in words */
 #define WORD_BLOCK  (AES_BLOCK_SIZE / sizeof(__word_t))
 
@@ -19,11 +19,23 @@
  *
  * */
 
+/* pthread affinity, eventfd, monotonic clock, posix_memalign and mmap extensions */
+#if (defined(AES_POOL) || defined(AES_ASYNC) || defined(AES_COALESCE) || defined(AES_STATS) || defined(AES_TUNE) || defined(AES_ARENA) || defined(AES_STORE) || defined(AES_ROTATE)) && !defined(_GNU_SOURCE)
+    #define _GNU_SOURCE
+#endif
  
+#ifdef AES_STATS
+    #include "aes_stats.c"
+#endif
+
 #ifdef AES
     #include "aes.c"
 #endif    
 
+#ifdef AES_POOL
+    #include "aes_pool.c"
+#endif
+
 #ifdef AES_ECB
     #include "aes_ecb.c"
 #endif
@@ -36,6 +48,38 @@
     #include "aes_gcm.c"
 #endif
 
+#ifdef AES_TLS
+    #include "aes_tls.c"
+#endif
+
+#ifdef AES_ASYNC
+    #include "aes_async.c"
+#endif
+
+#ifdef AES_KEYCACHE
+    #include "aes_keycache.c"
+#endif
+
+#ifdef AES_ARENA
+    #include "aes_arena.c"
+#endif
+
+#ifdef AES_STORE
+    #include "aes_store.c"
+#endif
+
+#ifdef AES_ROTATE
+    #include "aes_rotate.c"
+#endif
+
+#ifdef AES_COALESCE
+    #include "aes_coalesce.c"
+#endif
+
+#ifdef AES_TUNE
+    #include "aes_tune.c"
+#endif
+
 
 
 
@@ -0,0 +1,320 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+
+/* Throughput of each mode for every key size and a range of message sizes
+ *
+ * One CSV row is printed per measurement:
+ *
+ * word_size,backend,op,key_bits,size,iterations,ns,mb_s,cpb
+ *
+ * - word_size and backend identify the build (__WORD_SIZE, __USE_STRING)
+ * - mb_s is 10^6 octets per second
+ * - cpb is time stamp counter cycles per octet (x86 only, empty otherwise)
+ *
+ * Options:
+ *
+ * -q           do not print the header row
+ * -m octets    largest message size (default BENCH_MAX)
+ * -t ms        shortest time to spend on each measurement (default BENCH_MS)
+ *
+ * */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define BENCH_TSC
+#endif
+
+#include <aes.h>
+
+#ifndef __WORD_SIZE
+#define __WORD_SIZE 1
+#endif
+
+#ifdef __USE_STRING
+#define BACKEND "string"
+#else
+#define BACKEND "local"
+#endif
+
+#ifndef BENCH_MAX
+#define BENCH_MAX   (16 * 1024 * 1024)
+#endif
+
+#ifndef BENCH_MS
+#define BENCH_MS    100
+#endif
+
+/* key wrap is for keys; larger inputs are not measured */
+#define BENCH_WRAP_MAX  4096
+
+enum {
+
+    OP_ENCR,
+    OP_DECR,
+    OP_ECB_ENCIPHER,
+    OP_ECB_DECIPHER,
+    OP_HP_MASKS,
+    OP_GCM_ENCIPHER,
+    OP_GCM_DECIPHER,
+    OP_GCM_DECIPHER_VERIFIED,
+    OP_WRAP_ENCIPHER,
+    OP_WRAP_DECIPHER,
+    OP_GCM_AAD,
+    OP_GMAC_TAG,
+#ifdef AES_OTF
+    OP_OTF_ENCR,
+    OP_OTF_DECR,
+#endif
+    OP_MAX
+};
+
+static const char *op_name[] = {
+    "aes_encr",
+    "aes_decr",
+    "ecb_encipher",
+    "ecb_decipher",
+    "hp_masks",
+    "gcm_encipher",
+    "gcm_decipher",
+    "gcm_decipher_verified",
+    "wrap_encipher",
+    "wrap_decipher",
+    "gcm_aad",
+    "gmac_tag",
+    "aes_otf_encr",
+    "aes_otf_decr"
+};
+
+static uint8_t *in, *out;
+static uint8_t tag[GCM_TAG_SIZE];
+static aes_gmac_ctxt gmac;
+static const uint8_t **sample;
+
+#ifdef AES_OTF
+static aes_otf_ctxt otf;
+#endif
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static uint64_t cycles(void)
+{
+#ifdef BENCH_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/* one operation on size octets */
+static void run(int op, aes_ctxt *aes, uint32_t size)
+{
+    static const uint8_t iv[GCM_IV_SIZE];
+    uint32_t i;
+
+    switch(op){
+    case OP_ENCR:
+        for(i=0; i < size; i += AES_BLOCK_SIZE)
+            aes_encr(aes, out + i);
+        break;
+    case OP_DECR:
+        for(i=0; i < size; i += AES_BLOCK_SIZE)
+            aes_decr(aes, out + i);
+        break;
+    case OP_ECB_ENCIPHER:
+        aes_ecb_encipher(aes, out, in, size);
+        break;
+    case OP_ECB_DECIPHER:
+        aes_ecb_decipher(aes, out, in, size);
+        break;
+    case OP_HP_MASKS:
+        /* a sample per AES_BLOCK_SIZE octets of in */
+        aes_ecb_hp_masks(aes, sample, out, size / AES_BLOCK_SIZE);
+        break;
+    case OP_GCM_ENCIPHER:
+        aes_gcm_encipher(aes, iv, sizeof(iv), out, in, size, NULL, 0, tag, sizeof(tag));
+        break;
+    case OP_GCM_DECIPHER:
+        /* tag will not match; the whole message is still processed */
+        (void)aes_gcm_decipher(aes, iv, sizeof(iv), out, in, size, NULL, 0, tag, sizeof(tag));
+        break;
+    case OP_GCM_DECIPHER_VERIFIED:
+        /* tag will not match; the cost of rejecting a forgery */
+        (void)aes_gcm_decipher_verified(aes, iv, sizeof(iv), out, in, size, NULL, 0, tag, sizeof(tag));
+        break;
+    case OP_WRAP_ENCIPHER:
+        aes_wrap_encipher(aes, out, in, size, NULL);
+        break;
+    case OP_WRAP_DECIPHER:
+        (void)aes_wrap_decipher(aes, out, in, size + 8, NULL);
+        break;
+    case OP_GCM_AAD:
+        aes_gcm_encipher(aes, iv, sizeof(iv), NULL, NULL, 0, in, size, tag, sizeof(tag));
+        break;
+    case OP_GMAC_TAG:
+        aes_gmac_tag(&gmac, iv, sizeof(iv), in, size, tag, sizeof(tag));
+        break;
+#ifdef AES_OTF
+    case OP_OTF_ENCR:
+        for(i=0; i < size; i += AES_BLOCK_SIZE)
+            aes_otf_encr(&otf, out + i);
+        break;
+    case OP_OTF_DECR:
+        for(i=0; i < size; i += AES_BLOCK_SIZE)
+            aes_otf_decr(&otf, out + i);
+        break;
+#endif
+    default:
+        break;
+    }
+}
+
+static void measure(int op, int key_size, uint32_t size, uint64_t min_ns)
+{
+    static const uint8_t key[AES256_KEY_SIZE];
+
+    aes_ctxt aes;
+    uint64_t iterations = 0, t, c;
+    double ns;
+
+    aes_init(&aes, key, key_size);
+    aes_gmac_init(&gmac, key, key_size);
+
+#ifdef AES_OTF
+    aes_otf_init(&otf, key, key_size);
+#endif
+
+    /* warm up caches and tables */
+    run(op, &aes, size);
+
+    t = now_ns();
+    c = cycles();
+
+    do{
+
+        run(op, &aes, size);
+        iterations++;
+    }
+    while((now_ns() - t) < min_ns);
+
+    c = cycles() - c;
+    ns = (double)(now_ns() - t);
+
+    fprintf(stdout, "%i,%s,%s,%i,%u,%llu,%.0f,%.2f,",
+        __WORD_SIZE * 8, BACKEND, op_name[op], key_size * 8, size,
+        (unsigned long long)iterations, ns,
+        ((double)size * iterations * 1000.0) / ns);
+
+#ifdef BENCH_TSC
+    fprintf(stdout, "%.2f", (double)c / ((double)size * iterations));
+#else
+    (void)c;
+#endif
+
+    fprintf(stdout, "\n");
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    static const int key_size[] = {AES128_KEY_SIZE, AES192_KEY_SIZE, AES256_KEY_SIZE};
+
+    uint32_t max = BENCH_MAX, size, i;
+    uint64_t min_ns = (uint64_t)BENCH_MS * 1000000;
+    int header = 1, op, k, c;
+
+    while((c = getopt(argc, argv, "qm:t:")) != -1){
+
+        switch(c){
+        case 'q':
+            header = 0;
+            break;
+        case 'm':
+            max = strtoul(optarg, NULL, 0);
+            break;
+        case 't':
+            min_ns = strtoull(optarg, NULL, 0) * 1000000;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-q] [-m octets] [-t ms]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if((max < AES_BLOCK_SIZE) || !(in = calloc(1, max + 8)) || !(out = calloc(1, max + 8))
+        || !(sample = calloc(max / AES_BLOCK_SIZE, sizeof(*sample)))){
+
+        fprintf(stderr, "setup failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for(i=0; i < (max / AES_BLOCK_SIZE); i++)
+        sample[i] = in + (i * AES_BLOCK_SIZE);
+
+    if(header)
+        fprintf(stdout, "word_size,backend,op,key_bits,size,iterations,ns,mb_s,cpb\n");
+
+    for(op=0; op < OP_MAX; op++){
+
+        for(k=0; k < (sizeof(key_size) / sizeof(*key_size)); k++){
+
+            /* the block functions are measured on a single block */
+            if((op == OP_ENCR) || (op == OP_DECR)
+#ifdef AES_OTF
+                || (op == OP_OTF_ENCR) || (op == OP_OTF_DECR)
+#endif
+            ){
+
+                measure(op, key_size[k], AES_BLOCK_SIZE, min_ns);
+                continue;
+            }
+
+            for(size = AES_BLOCK_SIZE; size <= max; size <<= 2){
+
+                if(((op == OP_WRAP_ENCIPHER) || (op == OP_WRAP_DECIPHER)) && (size > BENCH_WRAP_MAX))
+                    break;
+
+                measure(op, key_size[k], size, min_ns);
+            }
+        }
+    }
+
+    free(sample);
+    free(in);
+    free(out);
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,193 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+/* Event loop latency with and without aes_async offload
+ *
+ * A simulated event loop services a timer every TICK_US and is asked to
+ * seal SEAL_SIZE octets with aes_gcm_encipher() every SEAL_EVERY ticks.
+ * The lateness of each timer tick is reported for the seal running inline
+ * and for the seal submitted to an aes_async engine.
+ *
+ * */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+
+#include <aes.h>
+
+#ifndef TICK_US
+#define TICK_US     1000
+#endif
+
+#ifndef SEAL_EVERY
+#define SEAL_EVERY  50
+#endif
+
+#ifndef SEAL_SIZE
+#define SEAL_SIZE   (256 * 1024)
+#endif
+
+#ifndef TICKS
+#define TICKS       1000
+#endif
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, uint64_t *late, int n, int seals)
+{
+    qsort(late, n, sizeof(*late), cmp_u64);
+
+    fprintf(stdout, "%-8s ticks=%i seals=%i late_us p50=%llu p99=%llu p99.9=%llu max=%llu\n",
+        name, n, seals,
+        (unsigned long long)late[n / 2],
+        (unsigned long long)late[(n * 99) / 100],
+        (unsigned long long)late[(n * 999) / 1000],
+        (unsigned long long)late[n - 1]);
+}
+
+/* wait until deadline, reaping completions if async is not NULL */
+static int wait_until(aes_async *async, uint64_t deadline)
+{
+    struct pollfd pfd;
+    struct timespec ts;
+    aes_job *done[16];
+    uint64_t t;
+    int reaped = 0;
+
+    while((t = now_us()) < deadline){
+
+        ts.tv_sec = (deadline - t) / 1000000;
+        ts.tv_nsec = ((deadline - t) % 1000000) * 1000;
+
+        if(!async){
+
+            nanosleep(&ts, NULL);
+            continue;
+        }
+
+        pfd.fd = aes_async_fd(async);
+        pfd.events = POLLIN;
+
+        if(ppoll(&pfd, 1, &ts, NULL) == 1)
+            reaped += aes_async_poll(async, done, sizeof(done) / sizeof(*done));
+    }
+
+    return reaped;
+}
+
+static void run(const char *name, aes_async *async, aes_ctxt *aes, uint8_t *buf)
+{
+    static const uint8_t iv[GCM_IV_SIZE];
+    static uint64_t late[TICKS];
+
+    uint8_t tag[GCM_TAG_SIZE];
+    uint64_t next;
+    aes_job job;
+    int i, submitted = 0, seals = 0;
+
+    memset(&job, 0, sizeof(job));
+
+    job.op = AES_JOB_GCM_ENCIPHER;
+    job.aes = aes;
+    job.IV = iv;
+    job.IV_size = sizeof(iv);
+    job.out = buf;
+    job.in = buf;
+    job.size = SEAL_SIZE;
+    job.T = tag;
+    job.T_size = sizeof(tag);
+
+    next = now_us() + TICK_US;
+
+    for(i=0; i < TICKS; i++){
+
+        seals += wait_until(async, next);
+
+        late[i] = now_us() - next;
+        next += TICK_US;
+
+        if(i % SEAL_EVERY)
+            continue;
+
+        if(!async){
+
+            aes_gcm_encipher(aes, iv, sizeof(iv), buf, buf, SEAL_SIZE, NULL, 0, tag, sizeof(tag));
+            seals++;
+        }
+        /* the job and buffer are reused once the previous seal completes */
+        else if((submitted == seals) && !aes_async_submit(async, &job)){
+
+            submitted++;
+        }
+    }
+
+    while(seals < submitted)
+        seals += wait_until(async, now_us() + TICK_US);
+
+    report(name, late, TICKS, seals);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint8_t key[AES128_KEY_SIZE];
+
+    aes_ctxt aes;
+    aes_async *async;
+    uint8_t *buf;
+
+    if(!(buf = calloc(1, SEAL_SIZE)) || !(async = aes_async_create(16, 1))){
+
+        fprintf(stderr, "setup failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    aes_gcm_init(&aes, key, sizeof(key));
+
+    fprintf(stdout, "tick=%ius seal=%iB every %i ticks\n", TICK_US, SEAL_SIZE, SEAL_EVERY);
+
+    run("inline", NULL, &aes, buf);
+    run("offload", async, &aes, buf);
+
+    aes_async_destroy(async);
+    free(buf);
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,279 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+
+/* Per call latency distribution for small packets and key agility
+ *
+ * Each series times individual calls and reports percentiles:
+ *
+ * - aes_encr: one block, the cost of each of H and E(J0) that gcm()
+ *   derives again for every message
+ * - aes_init: AES-128 and AES-256 key expansion
+ * - gcm_seal: aes_gcm_encipher() of BENCH_PACKET octets under a
+ *   context set up once
+ * - fresh_key_seal: aes_gcm_init() then the same seal, for every message
+ *
+ * Every series is run warm (back to back) and cold (caches evicted
+ * before every sample by walking a buffer larger than the last level
+ * cache, and the context flushed on x86).
+ *
+ * Output is one CSV row per series:
+ *
+ * series,cache,unit,samples,min,p50,p90,p99,p99.9,max
+ *
+ * Options:
+ *
+ * -n samples   warm samples per series (cold is one tenth)
+ * -H           also print a log2 histogram of each series
+ *
+ * */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#if defined(__i386__) || defined(__x86_64__)
+#include <x86intrin.h>
+#define BENCH_TSC
+#endif
+
+#include <aes.h>
+
+#ifndef BENCH_SAMPLES
+#define BENCH_SAMPLES   10000
+#endif
+
+#ifndef BENCH_PACKET
+#define BENCH_PACKET    64
+#endif
+
+/* larger than the last level cache */
+#ifndef BENCH_EVICT
+#define BENCH_EVICT     (32 * 1024 * 1024)
+#endif
+
+#define BENCH_LINE      64
+
+enum {
+
+    SERIES_ENCR,
+    SERIES_INIT128,
+    SERIES_INIT256,
+    SERIES_SEAL,
+    SERIES_FRESH_SEAL,
+    SERIES_MAX
+};
+
+static const char *series_name[] = {
+    "aes_encr",
+    "aes_init_128",
+    "aes_init_256",
+    "gcm_seal",
+    "fresh_key_seal"
+};
+
+static const uint8_t key[AES256_KEY_SIZE] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F
+};
+
+static aes_ctxt aes;
+static uint8_t packet[BENCH_PACKET];
+static uint8_t tag[GCM_TAG_SIZE];
+static uint8_t *evict;
+
+#ifdef BENCH_TSC
+#define UNIT "cycles"
+
+static uint64_t stamp(void)
+{
+    _mm_lfence();
+    return __rdtsc();
+}
+#else
+#define UNIT "ns"
+
+static uint64_t stamp(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+#endif
+
+/* evict the cipher tables, context and buffers from the caches */
+static void cold(void)
+{
+    uint32_t i;
+
+    for(i=0; i < BENCH_EVICT; i += BENCH_LINE)
+        evict[i]++;
+
+#ifdef BENCH_TSC
+    for(i=0; i < sizeof(aes); i += BENCH_LINE)
+        _mm_clflush((uint8_t *)&aes + i);
+
+    for(i=0; i < sizeof(packet); i += BENCH_LINE)
+        _mm_clflush(packet + i);
+
+    _mm_mfence();
+#endif
+}
+
+static void run(int series)
+{
+    static const uint8_t iv[GCM_IV_SIZE];
+
+    switch(series){
+    case SERIES_ENCR:
+        aes_encr(&aes, packet);
+        break;
+    case SERIES_INIT128:
+        aes_init(&aes, key, AES128_KEY_SIZE);
+        break;
+    case SERIES_INIT256:
+        aes_init(&aes, key, AES256_KEY_SIZE);
+        break;
+    case SERIES_SEAL:
+        aes_gcm_encipher(&aes, iv, sizeof(iv), packet, packet, sizeof(packet), NULL, 0, tag, sizeof(tag));
+        break;
+    case SERIES_FRESH_SEAL:
+        aes_gcm_init(&aes, key, AES128_KEY_SIZE);
+        aes_gcm_encipher(&aes, iv, sizeof(iv), packet, packet, sizeof(packet), NULL, 0, tag, sizeof(tag));
+        break;
+    default:
+        break;
+    }
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void histogram(const uint64_t *t, int n)
+{
+    int bucket[64] = {0};
+    int i, b, max = 0;
+
+    for(i=0; i < n; i++){
+
+        for(b=0; (b < 63) && (t[i] >> (b + 1)); b++);
+
+        bucket[b]++;
+        max = (b > max) ? b : max;
+    }
+
+    for(b=0; b <= max; b++){
+
+        if(bucket[b])
+            fprintf(stdout, "#   [%llu, %llu) %i\n", 1ULL << b, 1ULL << (b + 1), bucket[b]);
+    }
+}
+
+static void measure(int series, int is_cold, int n, int show)
+{
+    uint64_t *t, start;
+    int i;
+
+    if(!(t = malloc(n * sizeof(*t)))){
+
+        fprintf(stderr, "malloc()\n");
+        exit(EXIT_FAILURE);
+    }
+
+    aes_gcm_init(&aes, key, AES128_KEY_SIZE);
+    run(series);
+
+    for(i=0; i < n; i++){
+
+        if(is_cold)
+            cold();
+
+        start = stamp();
+        run(series);
+        t[i] = stamp() - start;
+    }
+
+    qsort(t, n, sizeof(*t), cmp_u64);
+
+    fprintf(stdout, "%s,%s,%s,%i,%llu,%llu,%llu,%llu,%llu,%llu\n",
+        series_name[series], is_cold ? "cold" : "warm", UNIT, n,
+        (unsigned long long)t[0],
+        (unsigned long long)t[n / 2],
+        (unsigned long long)t[(n * 90) / 100],
+        (unsigned long long)t[(n * 99) / 100],
+        (unsigned long long)t[(n * 999) / 1000],
+        (unsigned long long)t[n - 1]);
+
+    if(show)
+        histogram(t, n);
+
+    fflush(stdout);
+    free(t);
+}
+
+int main(int argc, char **argv)
+{
+    int n = BENCH_SAMPLES, show = 0, series, c;
+
+    while((c = getopt(argc, argv, "n:H")) != -1){
+
+        switch(c){
+        case 'n':
+            n = atoi(optarg);
+            break;
+        case 'H':
+            show = 1;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n samples] [-H]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if((n < 10) || !(evict = calloc(1, BENCH_EVICT))){
+
+        fprintf(stderr, "setup failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(stdout, "series,cache,unit,samples,min,p50,p90,p99,p99.9,max\n");
+
+    for(series=0; series < SERIES_MAX; series++){
+
+        measure(series, 0, n, show);
+        measure(series, 1, n / 10, show);
+    }
+
+    free(evict);
+
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,267 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+
+/* Hardware performance counters for the hot functions (Linux)
+ *
+ * The library is included directly so that the internal functions
+ * galois_mul128() and gcm() can be measured alongside the public ones.
+ *
+ * Each function is run over PERF_BYTES octets with these counters open
+ * for the calling thread (user space only):
+ *
+ * - cycles, instructions, branch-misses, cache-misses, L1D read misses
+ *
+ * A counter which cannot be opened (no PMU, perf_event_paranoid, seccomp
+ * in containers) is reported once on stderr and left out; wall time is
+ * always reported as the "ns" counter.
+ *
+ * Output is one CSV row per function and counter:
+ *
+ * word_size,backend,function,size,counter,total,per_block,per_byte
+ *
+ * -q   do not print the header row
+ *
+ * */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "core.c"
+
+#ifdef __USE_STRING
+#define BACKEND "string"
+#else
+#define BACKEND "local"
+#endif
+
+#ifndef PERF_BYTES
+#define PERF_BYTES  (1024 * 1024)
+#endif
+
+/* largest message passed to one call */
+#define PERF_SIZE   4096
+
+typedef struct {
+
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+    int fd;
+
+} perf_counter;
+
+static perf_counter counter[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES, -1},
+    {"L1D-read-misses", PERF_TYPE_HW_CACHE,
+        PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16), -1}
+};
+
+#define COUNTERS (sizeof(counter) / sizeof(*counter))
+
+enum {
+
+    FN_AES_ENCR,
+    FN_AES_DECR,
+    FN_GALOIS_MUL128,
+    FN_ECB_ENCIPHER,
+    FN_GCM,
+    FN_WRAP_ENCIPHER,
+    FN_MAX
+};
+
+static const struct {
+
+    const char *name;
+    uint32_t size;      /* octets per call */
+
+} fn[] = {
+    {"aes_encr", AES_BLOCK_SIZE},
+    {"aes_decr", AES_BLOCK_SIZE},
+    {"galois_mul128", AES_BLOCK_SIZE},
+    {"aes_ecb_encipher", PERF_SIZE},
+    {"gcm", PERF_SIZE},
+    {"aes_wrap_encipher", 32}
+};
+
+static uint8_t in[PERF_SIZE + 8];
+static uint8_t out[PERF_SIZE + 8];
+
+static void counters_open(void)
+{
+    struct perf_event_attr attr;
+    int i;
+
+    for(i=0; i < COUNTERS; i++){
+
+        memset(&attr, 0, sizeof(attr));
+
+        attr.size = sizeof(attr);
+        attr.type = counter[i].type;
+        attr.config = counter[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+
+        counter[i].fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+
+        if(counter[i].fd < 0)
+            fprintf(stderr, "counter %s unavailable\n", counter[i].name);
+    }
+}
+
+static void counters_close(void)
+{
+    int i;
+
+    for(i=0; i < COUNTERS; i++){
+
+        if(counter[i].fd >= 0)
+            close(counter[i].fd);
+    }
+}
+
+static void counters_ioctl(unsigned long request)
+{
+    int i;
+
+    for(i=0; i < COUNTERS; i++){
+
+        if(counter[i].fd >= 0)
+            ioctl(counter[i].fd, request, 0);
+    }
+}
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static void run(int f, aes_ctxt *aes, uint32_t calls)
+{
+    static const uint8_t iv[GCM_IV_SIZE];
+    __word_t XX[WORD_BLOCK];
+    __word_t HH[WORD_BLOCK];
+
+    MEMSET(XX, 0x5a, sizeof(XX));
+    MEMSET(HH, 0xa5, sizeof(HH));
+
+    while(calls--){
+
+        switch(f){
+        case FN_AES_ENCR:
+            aes_encr(aes, out);
+            break;
+        case FN_AES_DECR:
+            aes_decr(aes, out);
+            break;
+        case FN_GALOIS_MUL128:
+            galois_mul128(XX, HH);
+            break;
+        case FN_ECB_ENCIPHER:
+            aes_ecb_encipher(aes, out, in, fn[f].size);
+            break;
+        case FN_GCM:
+            gcm(aes, iv, sizeof(iv), 0, out, in, fn[f].size, NULL, 0, 0, XX);
+            break;
+        case FN_WRAP_ENCIPHER:
+            aes_wrap_encipher(aes, out, in, fn[f].size, NULL);
+            break;
+        default:
+            break;
+        }
+    }
+
+    /* keep the GHASH result live */
+    out[0] ^= *(uint8_t *)XX;
+}
+
+static void report(int f, const char *name, double total, uint32_t calls)
+{
+    double bytes = (double)fn[f].size * calls;
+
+    fprintf(stdout, "%i,%s,%s,%u,%s,%.0f,%.3f,%.4f\n",
+        __WORD_SIZE * 8, BACKEND, fn[f].name, fn[f].size, name, total,
+        total / (bytes / AES_BLOCK_SIZE), total / bytes);
+}
+
+int main(int argc, char **argv)
+{
+    static const uint8_t key[AES128_KEY_SIZE];
+
+    aes_ctxt aes;
+    uint64_t value, t;
+    uint32_t calls;
+    int f, i;
+
+    aes_init(&aes, key, sizeof(key));
+
+    counters_open();
+
+    if((argc < 2) || strcmp(argv[1], "-q"))
+        fprintf(stdout, "word_size,backend,function,size,counter,total,per_block,per_byte\n");
+
+    for(f=0; f < FN_MAX; f++){
+
+        calls = PERF_BYTES / fn[f].size;
+
+        /* warm up */
+        run(f, &aes, 1);
+
+        counters_ioctl(PERF_EVENT_IOC_RESET);
+        counters_ioctl(PERF_EVENT_IOC_ENABLE);
+
+        t = now_ns();
+        run(f, &aes, calls);
+        t = now_ns() - t;
+
+        counters_ioctl(PERF_EVENT_IOC_DISABLE);
+
+        report(f, "ns", (double)t, calls);
+
+        for(i=0; i < COUNTERS; i++){
+
+            if((counter[i].fd >= 0) && (read(counter[i].fd, &value, sizeof(value)) == sizeof(value)))
+                report(f, counter[i].name, (double)value, calls);
+        }
+
+        fflush(stdout);
+    }
+
+    counters_close();
+
+    exit(EXIT_SUCCESS);
+}
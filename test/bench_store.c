@@ -0,0 +1,207 @@
+/* Copyright (c) 2013 Cameron Harper
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy of
+ * this software and associated documentation files (the "Software"), to deal in
+ * the Software without restriction, including without limitation the rights to
+ * use, copy, modify, merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is furnished to do so,
+ * subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS
+ * FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR
+ * COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER
+ * IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN
+ * CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ *
+ * */
+
+/* Time to first request: cold key expansion against a mapped aes_store
+ *
+ * For n keys (default 100000) the time from start until the first
+ * BENCH_PACKET octet GCM seal under the last key is reported for:
+ *
+ * - cold: aes_init() of every key into an array of contexts
+ * - store: aes_store_open() of a file written beforehand
+ * - store_verify: aes_store_open() with AES_STORE_VERIFY
+ *
+ * For each store the cost of aes_store_get() of every key is then given
+ * for the first lookup (which checks the record unless it was checked at
+ * open) and for a repeated lookup, alongside aes_init() of every key.
+ *
+ * The store file is likely to be in the page cache; drop caches before
+ * running to include the read from disk.
+ *
+ * Options:
+ *
+ * -n keys      number of keys
+ * -f file      store file (default bench_store.bin, removed afterwards)
+ *
+ * */
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <aes.h>
+
+#ifndef BENCH_PACKET
+#define BENCH_PACKET 64
+#endif
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static void seal(const aes_ctxt *aes)
+{
+    static const uint8_t iv[GCM_IV_SIZE];
+    static uint8_t buf[BENCH_PACKET];
+    uint8_t tag[GCM_TAG_SIZE];
+
+    aes_gcm_encipher(aes, iv, sizeof(iv), buf, buf, sizeof(buf), NULL, 0, tag, sizeof(tag));
+}
+
+static void report(const char *name, uint32_t n, uint64_t ns)
+{
+    fprintf(stdout, "%-13s keys=%u first_request_us=%.1f per_key_ns=%.1f\n", name, n, ns / 1000.0, (double)ns / n);
+}
+
+static void report_lookup(const char *name, uint32_t n, uint64_t ns)
+{
+    fprintf(stdout, "%-13s keys=%u per_key_ns=%.1f\n", name, n, (double)ns / n);
+}
+
+/* aes_store_get() of every id; -1 if one is missing */
+static int lookup(aes_store *store, uint32_t n, uint64_t *ns)
+{
+    uint64_t t = now_ns();
+    uint32_t i;
+
+    for(i=0; i < n; i++){
+
+        if(!aes_store_get(store, i))
+            return -1;
+    }
+
+    *ns = now_ns() - t;
+
+    return 0;
+}
+
+static int run_store(const char *name, const char *path, uint32_t n, uint64_t id, int flags)
+{
+    aes_store *store;
+    const aes_ctxt *aes;
+    uint64_t t = now_ns(), first, again;
+
+    if(!(store = aes_store_open(path, flags)) || !(aes = aes_store_get(store, id))){
+
+        fprintf(stderr, "%s: cannot use %s\n", name, path);
+        aes_store_close(store);
+        return -1;
+    }
+
+    seal(aes);
+    report(name, n, now_ns() - t);
+
+    if(lookup(store, n, &first) || lookup(store, n, &again)){
+
+        fprintf(stderr, "%s: lookup failed\n", name);
+        aes_store_close(store);
+        return -1;
+    }
+
+    report_lookup("  get_first", n, first);
+    report_lookup("  get", n, again);
+
+    aes_store_close(store);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    const char *path = "bench_store.bin";
+    aes_store_key *keys;
+    aes_ctxt *ctxt;
+    uint8_t *k;
+    uint32_t n = 100000, i, j;
+    uint64_t t;
+    int c, ret = EXIT_SUCCESS;
+
+    while((c = getopt(argc, argv, "n:f:")) != -1){
+
+        switch(c){
+        case 'n':
+            n = strtoul(optarg, NULL, 0);
+            break;
+        case 'f':
+            path = optarg;
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-n keys] [-f file]\n", argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if(!n || !(keys = calloc(n, sizeof(*keys))) || !(k = malloc((size_t)n * AES128_KEY_SIZE)) || !(ctxt = malloc((size_t)n * sizeof(*ctxt)))){
+
+        fprintf(stderr, "setup failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for(i=0; i < n; i++){
+
+        for(j=0; j < AES128_KEY_SIZE; j++)
+            k[(i * AES128_KEY_SIZE) + j] = rand();
+
+        keys[i].id = i;
+        keys[i].k = k + (i * AES128_KEY_SIZE);
+        keys[i].k_size = AES128_KEY_SIZE;
+    }
+
+    if(aes_store_write(path, keys, n)){
+
+        fprintf(stderr, "cannot write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    t = now_ns();
+
+    for(i=0; i < n; i++)
+        aes_init(&ctxt[i], keys[i].k, keys[i].k_size);
+
+    seal(&ctxt[n - 1]);
+    report("cold", n, now_ns() - t);
+
+    t = now_ns();
+
+    for(i=0; i < n; i++)
+        aes_init(&ctxt[i], keys[i].k, keys[i].k_size);
+
+    report_lookup("  aes_init", n, now_ns() - t);
+
+    if(run_store("store", path, n, n - 1, 0) || run_store("store_verify", path, n, n - 1, AES_STORE_VERIFY))
+        ret = EXIT_FAILURE;
+
+    remove(path);
+
+    free(ctxt);
+    free(k);
+    free(keys);
+
+    exit(ret);
+}
@@ -3,7 +3,7 @@
 #
 # 
 
-for i in 8 16 32 64
+for i in 8 16 32 64 128
 do
 
     if [ -e "test" ]
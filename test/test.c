@@ -25,6 +25,9 @@
 #include <string.h>
 #include <ctype.h>
 #include <stdint.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include <aes.h>
 
@@ -475,6 +478,1870 @@ abort:
     return fail;    
 }
 
+int test__ecb_bulk(void)
+{
+    /* large enough to take the streaming path when enabled */
+    const uint32_t size = 0x100000 + (3 * AES_BLOCK_SIZE) + 5;
+    const uint8_t key[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F};
+
+    uint8_t *pt, *ct, *buf;
+    uint8_t s[AES_BLOCK_SIZE];
+    uint32_t i;
+    aes_ctxt aes;
+    int fail = 0;
+
+    pt = malloc(size);
+    ct = malloc(size);
+    buf = malloc(size + 1);
+
+    if(!pt || !ct || !buf){
+
+        fprintf(stderr, "test__ecb_bulk() malloc()\n");
+        free(pt);
+        free(ct);
+        free(buf);
+        return -1;
+    }
+
+    aes_ecb_init(&aes, key, sizeof(key));
+
+    for(i=0; i < size; i++)
+        pt[i] = i * 7;
+
+    /* reference is one block at a time */
+    for(i=0; i < size; i += AES_BLOCK_SIZE){
+
+        memset(s, 0, sizeof(s));
+        memcpy(s, pt + i, ((size - i) < sizeof(s)) ? (size - i) : sizeof(s));
+        aes_encr(&aes, s);
+        memcpy(ct + i, s, ((size - i) < sizeof(s)) ? (size - i) : sizeof(s));
+    }
+
+    //non-overlap, unaligned output
+    aes_ecb_encipher(&aes, buf + 1, pt, size);
+
+    if(memcmp(buf + 1, ct, size)){
+
+        fprintf(stderr, "FAIL aes_ecb_encipher() bulk non-overlap\n");
+        fail++;
+    }
+
+    //non-overlap
+    aes_ecb_encipher(&aes, buf, pt, size);
+
+    if(memcmp(buf, ct, size)){
+
+        fprintf(stderr, "FAIL aes_ecb_encipher() bulk non-overlap\n");
+        fail++;
+    }
+
+    aes_ecb_decipher(&aes, buf, ct, size - 5);
+
+    if(memcmp(buf, pt, size - 5)){
+
+        fprintf(stderr, "FAIL aes_ecb_decipher() bulk non-overlap\n");
+        fail++;
+    }
+
+    //overlap
+    memcpy(buf, pt, size);
+    aes_ecb_encipher(&aes, buf, buf, size);
+
+    if(memcmp(buf, ct, size)){
+
+        fprintf(stderr, "FAIL aes_ecb_encipher() bulk overlap\n");
+        fail++;
+    }
+
+    aes_ecb_decipher(&aes, buf, buf, size - 5);
+
+    if(memcmp(buf, pt, size - 5)){
+
+        fprintf(stderr, "FAIL aes_ecb_decipher() bulk overlap\n");
+        fail++;
+    }
+
+    free(pt);
+    free(ct);
+    free(buf);
+
+    return fail;
+}
+
+int test__hp_masks(void)
+{
+    uint8_t key[AES256_KEY_SIZE] = {0};
+    uint8_t packets[100][40];
+    const uint8_t *sample[100];
+    uint8_t mask[100 * AES_HP_MASK_SIZE], expected[AES_BLOCK_SIZE];
+    aes_ctxt aes;
+    uint32_t i, j;
+    int fail = 0;
+
+    for(i=0; i < sizeof(key); i++)
+        key[i] = i * 9;
+
+    for(i=0; i < 100; i++){
+
+        for(j=0; j < sizeof(packets[i]); j++)
+            packets[i][j] = i + (j * 31);
+
+        /* samples at varying (unaligned) offsets */
+        sample[i] = packets[i] + 1 + (i % 20);
+    }
+
+    aes_ecb_init(&aes, key, sizeof(key));
+
+    memset(mask, 0, sizeof(mask));
+    aes_ecb_hp_masks(&aes, sample, mask, 100);
+
+    for(i=0; i < 100; i++){
+
+        aes_ecb_encipher(&aes, expected, sample[i], AES_BLOCK_SIZE);
+
+        if(memcmp(mask + (i * AES_HP_MASK_SIZE), expected, AES_HP_MASK_SIZE)){
+
+            fprintf(stderr, "FAIL aes_ecb_hp_masks() packet %u\n", i);
+            fail++;
+        }
+    }
+
+    return fail;
+}
+
+int test__gcm_prefix(void)
+{
+    static const uint32_t prefix_size[] = {0, 16, 64, 256};
+
+    uint8_t key[AES256_KEY_SIZE];
+    uint8_t iv[GCM_IV_SIZE];
+    uint8_t aad[256 + 40];
+    uint8_t in[100], out[100], expected_out[100], plain[100];
+    uint8_t T[GCM_TAG_SIZE], expected[GCM_TAG_SIZE];
+    aes_gcm_prefix prefix;
+    aes_ctxt aes;
+    uint32_t i, p, a;
+    int fail = 0;
+
+    for(i=0; i < sizeof(key); i++)
+        key[i] = i;
+
+    for(i=0; i < sizeof(iv); i++)
+        iv[i] = 0xa0 + i;
+
+    for(i=0; i < sizeof(aad); i++)
+        aad[i] = i * 5;
+
+    for(i=0; i < sizeof(in); i++)
+        in[i] = i * 11;
+
+    aes_gcm_init(&aes, key, AES192_KEY_SIZE);
+
+    if(aes_gcm_prefix_init(&prefix, &aes, aad, 17) != -1){
+
+        fprintf(stderr, "FAIL aes_gcm_prefix_init() accepted a partial block\n");
+        fail++;
+    }
+
+    for(p=0; p < sizeof(prefix_size) / sizeof(*prefix_size); p++){
+
+        aes_gcm_prefix_init(&prefix, &aes, aad, prefix_size[p]);
+
+        for(a=0; a <= 40; a += 13){
+
+            aes_gcm_encipher(&aes, iv, sizeof(iv), expected_out, in, sizeof(in), aad, prefix_size[p] + a, expected, sizeof(expected));
+            aes_gcm_encipher_prefix(&aes, &prefix, iv, sizeof(iv), out, in, sizeof(in), aad + prefix_size[p], a, T, sizeof(T));
+
+            if(memcmp(out, expected_out, sizeof(out)) || memcmp(T, expected, sizeof(T))){
+
+                fprintf(stderr, "FAIL aes_gcm_encipher_prefix() prefix %u aad %u\n", prefix_size[p], a);
+                fail++;
+            }
+
+            if(aes_gcm_decipher_prefix(&aes, &prefix, iv, sizeof(iv), plain, out, sizeof(out), aad + prefix_size[p], a, T, sizeof(T)) || memcmp(plain, in, sizeof(in))){
+
+                fprintf(stderr, "FAIL aes_gcm_decipher_prefix() prefix %u aad %u\n", prefix_size[p], a);
+                fail++;
+            }
+
+            out[a] ^= 1;
+
+            if(!aes_gcm_decipher_prefix(&aes, &prefix, iv, sizeof(iv), plain, out, sizeof(out), aad + prefix_size[p], a, T, sizeof(T))){
+
+                fprintf(stderr, "FAIL aes_gcm_decipher_prefix() accepted a bad message\n");
+                fail++;
+            }
+        }
+    }
+
+    return fail;
+}
+
+int test__gcm_update(void)
+{
+    static const uint32_t edit[][2] = {
+        {0, 1}, {5, 40}, {16, 16}, {31, 2}, {0, 300}, {290, 10}, {150, 0}
+    };
+    static const uint32_t iv_size[] = {GCM_IV_SIZE, 7};
+
+    uint8_t key[AES128_KEY_SIZE] = {0};
+    uint8_t iv[GCM_IV_SIZE] = {0};
+    uint8_t aad[20] = {0};
+    uint8_t msg[300], ct[300], expected_ct[300];
+    uint8_t T[GCM_TAG_SIZE], expected[GCM_TAG_SIZE];
+    aes_ctxt aes;
+    uint32_t i, e, v;
+    int fail = 0;
+
+    for(i=0; i < sizeof(msg); i++)
+        msg[i] = i;
+
+    aes_gcm_init(&aes, key, sizeof(key));
+
+    for(v=0; v < 2; v++){
+
+        aes_gcm_encipher(&aes, iv, iv_size[v], ct, msg, sizeof(msg), aad, sizeof(aad), T, sizeof(T));
+
+        for(e=0; e < sizeof(edit) / sizeof(*edit); e++){
+
+            for(i=0; i < edit[e][1]; i++)
+                msg[edit[e][0] + i] ^= 0x5a + e;
+
+            if(aes_gcm_update(&aes, iv, iv_size[v], ct + edit[e][0], msg + edit[e][0], edit[e][0], edit[e][1], sizeof(msg), T, sizeof(T))){
+
+                fprintf(stderr, "FAIL aes_gcm_update()\n");
+                fail++;
+            }
+
+            aes_gcm_encipher(&aes, iv, iv_size[v], expected_ct, msg, sizeof(msg), aad, sizeof(aad), expected, sizeof(expected));
+
+            if(memcmp(ct, expected_ct, sizeof(ct)) || memcmp(T, expected, sizeof(T))){
+
+                fprintf(stderr, "FAIL aes_gcm_update() IV %u offset %u size %u\n", iv_size[v], edit[e][0], edit[e][1]);
+                fail++;
+            }
+        }
+    }
+
+    if(aes_gcm_update(&aes, iv, sizeof(iv), ct, msg, 299, 2, sizeof(msg), T, sizeof(T)) != -1){
+
+        fprintf(stderr, "FAIL aes_gcm_update() accepted a range outside the message\n");
+        fail++;
+    }
+
+    return fail;
+}
+
+int test__gcm_verified(void)
+{
+    static const uint32_t iv_size[] = {GCM_IV_SIZE, 20};
+
+    uint8_t key[AES256_KEY_SIZE] = {0};
+    uint8_t iv[20] = {0};
+    uint8_t aad[33];
+    uint8_t msg[200], ct[200], out[200];
+    uint8_t T[GCM_TAG_SIZE];
+    aes_ctxt aes;
+    uint32_t i, v, size;
+    int fail = 0;
+
+    for(i=0; i < sizeof(msg); i++)
+        msg[i] = i * 7;
+
+    for(i=0; i < sizeof(aad); i++)
+        aad[i] = i;
+
+    aes_gcm_init(&aes, key, sizeof(key));
+
+    for(v=0; v < 2; v++){
+
+        for(size=0; size <= sizeof(msg); size += 29){
+
+            aes_gcm_encipher(&aes, iv, iv_size[v], ct, msg, size, aad, sizeof(aad), T, sizeof(T));
+
+            memset(out, 0xee, sizeof(out));
+
+            if(aes_gcm_decipher_verified(&aes, iv, iv_size[v], out, ct, size, aad, sizeof(aad), T, sizeof(T)) || memcmp(out, msg, size)){
+
+                fprintf(stderr, "FAIL aes_gcm_decipher_verified() IV %u size %u\n", iv_size[v], size);
+                fail++;
+            }
+
+            if(aes_gcm_decipher_verified(&aes, iv, iv_size[v], out, ct, size, aad, sizeof(aad), T, 8)){
+
+                fprintf(stderr, "FAIL aes_gcm_decipher_verified() short tag\n");
+                fail++;
+            }
+
+            /* forged messages leave out untouched */
+            memset(out, 0xee, sizeof(out));
+            aad[size % sizeof(aad)] ^= 1;
+
+            if(!aes_gcm_decipher_verified(&aes, iv, iv_size[v], out, ct, size, aad, sizeof(aad), T, sizeof(T))){
+
+                fprintf(stderr, "FAIL aes_gcm_decipher_verified() accepted a forgery\n");
+                fail++;
+            }
+
+            aad[size % sizeof(aad)] ^= 1;
+
+            for(i=0; (i < sizeof(out)) && (out[i] == 0xee); i++);
+
+            if(i != sizeof(out)){
+
+                fprintf(stderr, "FAIL aes_gcm_decipher_verified() wrote plaintext of a forgery\n");
+                fail++;
+            }
+        }
+    }
+
+    if(aes_gcm_decipher_verified(&aes, iv, GCM_IV_SIZE, out, ct, 16, NULL, 0, T, GCM_TAG_SIZE + 1) != -1){
+
+        fprintf(stderr, "FAIL aes_gcm_decipher_verified() accepted an invalid T_size\n");
+        fail++;
+    }
+
+    return fail;
+}
+
+/* split buf into segments of the sizes in cut (repeated) */
+static uint32_t test__iov_split(aes_iovec *v, uint8_t *buf, uint32_t size, const uint32_t *cut, uint32_t cuts)
+{
+    uint32_t n = 0, m;
+
+    while(size){
+
+        m = (cut[n % cuts] < size) ? cut[n % cuts] : size;
+
+        v[n].base = buf;
+        v[n].size = m;
+
+        buf += m;
+        size -= m;
+        n++;
+    }
+
+    return n;
+}
+
+int test__gcm_iov(void)
+{
+    static const uint32_t cut[][5] = {
+        {300, 300, 300, 300, 300},
+        {1, 15, 16, 17, 40},
+        {7, 7, 7, 7, 7},
+        {32, 5, 0, 64, 3}
+    };
+
+    uint8_t key[AES128_KEY_SIZE] = {0};
+    uint8_t iv[GCM_IV_SIZE] = {0};
+    uint8_t aad[45], msg[300], ct[300], expected_ct[300], pt[300];
+    uint8_t T[GCM_TAG_SIZE], expected[GCM_TAG_SIZE];
+    aes_iovec in[300], out[300], av[45];
+    uint32_t in_n, out_n, aad_n, i, c, d;
+    aes_ctxt aes;
+    int fail = 0;
+
+    for(i=0; i < sizeof(msg); i++)
+        msg[i] = i * 3;
+
+    for(i=0; i < sizeof(aad); i++)
+        aad[i] = i + 100;
+
+    aes_gcm_init(&aes, key, sizeof(key));
+    aes_gcm_encipher(&aes, iv, sizeof(iv), expected_ct, msg, sizeof(msg), aad, sizeof(aad), expected, sizeof(expected));
+
+    for(c=0; c < 4; c++){
+
+        /* out split differently to in */
+        d = (c + 1) % 4;
+
+        memset(ct, 0, sizeof(ct));
+
+        in_n = test__iov_split(in, msg, sizeof(msg), cut[c], 5);
+        out_n = test__iov_split(out, ct, sizeof(ct), cut[d], 5);
+        aad_n = test__iov_split(av, aad, sizeof(aad), cut[d], 5);
+
+        if(aes_gcm_encipher_iov(&aes, iv, sizeof(iv), out, out_n, in, in_n, av, aad_n, T, sizeof(T))
+            || memcmp(ct, expected_ct, sizeof(ct)) || memcmp(T, expected, sizeof(T))){
+
+            fprintf(stderr, "FAIL aes_gcm_encipher_iov() split %u/%u\n", c, d);
+            fail++;
+        }
+
+        /* in place */
+        memcpy(pt, ct, sizeof(pt));
+        in_n = test__iov_split(in, pt, sizeof(pt), cut[d], 5);
+
+        if(aes_gcm_decipher_iov(&aes, iv, sizeof(iv), in, in_n, in, in_n, av, aad_n, T, sizeof(T)) || memcmp(pt, msg, sizeof(pt))){
+
+            fprintf(stderr, "FAIL aes_gcm_decipher_iov() split %u/%u\n", c, d);
+            fail++;
+        }
+
+        ct[c] ^= 1;
+        in_n = test__iov_split(in, ct, sizeof(ct), cut[c], 5);
+        out_n = test__iov_split(out, pt, sizeof(pt), cut[d], 5);
+
+        if(!aes_gcm_decipher_iov(&aes, iv, sizeof(iv), out, out_n, in, in_n, av, aad_n, T, sizeof(T))){
+
+            fprintf(stderr, "FAIL aes_gcm_decipher_iov() accepted a bad message\n");
+            fail++;
+        }
+    }
+
+    /* out too small */
+    out_n = test__iov_split(out, ct, sizeof(ct) - 1, cut[0], 5);
+
+    if(aes_gcm_encipher_iov(&aes, iv, sizeof(iv), out, out_n, in, in_n, NULL, 0, T, sizeof(T)) != -1){
+
+        fprintf(stderr, "FAIL aes_gcm_encipher_iov() accepted a short output\n");
+        fail++;
+    }
+
+    return fail;
+}
+
+int test__tls(void)
+{
+    uint8_t key[AES128_KEY_SIZE], iv[GCM_IV_SIZE], nonce[GCM_IV_SIZE];
+    uint8_t content[100], inner[100 + 1 + 7];
+    uint8_t rec[4][100 + 7 + AES_TLS_OVERHEAD];
+    uint8_t expected[sizeof(inner)], T[GCM_TAG_SIZE], type;
+    aes_tls_ctxt client, server;
+    aes_tls_record r[4];
+    aes_ctxt aes;
+    uint32_t i, seq;
+    int len, fail = 0;
+
+    for(i=0; i < sizeof(key); i++)
+        key[i] = 0x40 + i;
+
+    for(i=0; i < sizeof(iv); i++)
+        iv[i] = 0x80 + i;
+
+    for(i=0; i < sizeof(content); i++)
+        content[i] = i;
+
+    aes_tls_key_init(&client.write, key, sizeof(key), iv);
+    aes_tls_key_init(&server.read, key, sizeof(key), iv);
+    aes_gcm_init(&aes, key, sizeof(key));
+
+    for(seq=0; seq < 3; seq++){
+
+        /* reference: nonce = iv XOR seq, aad = record header */
+        memcpy(nonce, iv, sizeof(nonce));
+        nonce[sizeof(nonce) - 1] ^= seq;
+
+        memcpy(inner, content, sizeof(content));
+        inner[sizeof(content)] = 22;
+        memset(inner + sizeof(content) + 1, 0, 7);
+
+        memcpy(rec[0] + AES_TLS_HEADER, content, sizeof(content));
+
+        if((len = aes_tls_seal(&client, rec[0], sizeof(content), 22, 7)) != (int)(sizeof(content) + 7 + AES_TLS_OVERHEAD)){
+
+            fprintf(stderr, "FAIL aes_tls_seal() length\n");
+            fail++;
+            continue;
+        }
+
+        aes_gcm_encipher(&aes, nonce, sizeof(nonce), expected, inner, sizeof(inner), rec[0], AES_TLS_HEADER, T, sizeof(T));
+
+        if((rec[0][0] != 23) || (rec[0][1] != 3) || (rec[0][2] != 3) || (((rec[0][3] << 8) | rec[0][4]) != (len - AES_TLS_HEADER))
+            || memcmp(rec[0] + AES_TLS_HEADER, expected, sizeof(expected)) || memcmp(rec[0] + AES_TLS_HEADER + sizeof(inner), T, sizeof(T))){
+
+            fprintf(stderr, "FAIL aes_tls_seal() record %u\n", seq);
+            fail++;
+        }
+
+        if((aes_tls_open(&server, rec[0], len, &type) != sizeof(content)) || (type != 22) || memcmp(rec[0] + AES_TLS_HEADER, content, sizeof(content))){
+
+            fprintf(stderr, "FAIL aes_tls_open() record %u\n", seq);
+            fail++;
+        }
+    }
+
+    /* batches keep the sequence going */
+    for(i=0; i < 4; i++){
+
+        memcpy(rec[i] + AES_TLS_HEADER, content, 10 * i);
+
+        r[i].rec = rec[i];
+        r[i].size = 10 * i;
+        r[i].pad = i;
+        r[i].type = 23;
+    }
+
+    if(aes_tls_seal_records(&client, r, 4) != 4){
+
+        fprintf(stderr, "FAIL aes_tls_seal_records()\n");
+        fail++;
+    }
+
+    for(i=0; i < 4; i++)
+        r[i].size = r[i].ret;
+
+    /* record 2 altered: it and those after it are not opened */
+    rec[2][AES_TLS_HEADER] ^= 1;
+
+    if(aes_tls_open_records(&server, r, 4) != 2){
+
+        fprintf(stderr, "FAIL aes_tls_open_records() did not stop at the bad record\n");
+        fail++;
+    }
+
+    for(i=0; i < 2; i++){
+
+        if((r[i].ret != (int)(10 * i)) || (r[i].type != 23) || memcmp(rec[i] + AES_TLS_HEADER, content, 10 * i)){
+
+            fprintf(stderr, "FAIL aes_tls_open_records() record %u\n", i);
+            fail++;
+        }
+    }
+
+    if((r[2].ret != -1) || (r[3].ret != -1)){
+
+        fprintf(stderr, "FAIL aes_tls_open_records() result after the bad record\n");
+        fail++;
+    }
+
+    /* a record out of sequence does not open */
+    if(aes_tls_open(&server, rec[3], r[3].size, &type) != -1){
+
+        fprintf(stderr, "FAIL aes_tls_open() accepted a record out of sequence\n");
+        fail++;
+    }
+
+    if(aes_tls_seal(&client, rec[0], AES_TLS_MAX_PLAINTEXT, 23, 1) != -1){
+
+        fprintf(stderr, "FAIL aes_tls_seal() accepted an oversized record\n");
+        fail++;
+    }
+
+    return fail;
+}
+
+int test__gmac(void)
+{
+    /* NIST GCM test case 1 (no plaintext) */
+    static const uint8_t tc1[] = {
+        0x58, 0xe2, 0xfc, 0xce, 0xfa, 0x7e, 0x30, 0x61,
+        0x36, 0x7f, 0x1d, 0x57, 0xa4, 0xe7, 0x45, 0x5a
+    };
+    static const int key_size[] = {AES128_KEY_SIZE, AES192_KEY_SIZE, AES256_KEY_SIZE};
+    static const uint32_t iv_size[] = {GCM_IV_SIZE, 8, 60};
+
+    uint8_t key[AES256_KEY_SIZE] = {0};
+    uint8_t iv[60] = {0};
+    uint8_t msg[300];
+    uint8_t T[GCM_TAG_SIZE], expected[GCM_TAG_SIZE];
+    aes_gmac_ctxt gmac;
+    aes_ctxt aes;
+    uint32_t i, j, size;
+    int k, fail = 0;
+
+    if(aes_gmac_init(&gmac, key, 17) != -1){
+
+        fprintf(stderr, "FAIL aes_gmac_init() accepted an invalid key size\n");
+        fail++;
+    }
+
+    aes_gmac_init(&gmac, key, AES128_KEY_SIZE);
+    aes_gmac_tag(&gmac, iv, GCM_IV_SIZE, NULL, 0, T, sizeof(T));
+
+    if(memcmp(T, tc1, sizeof(T))){
+
+        fprintf(stderr, "FAIL aes_gmac_tag() test case 1\n");
+        fail++;
+    }
+
+    for(i=0; i < sizeof(key); i++)
+        key[i] = i * 7;
+
+    for(i=0; i < sizeof(iv); i++)
+        iv[i] = i * 13;
+
+    for(i=0; i < sizeof(msg); i++)
+        msg[i] = i * 3;
+
+    /* same tag as GCM with the data as aad */
+    for(k=0; k < 3; k++){
+
+        aes_gmac_init(&gmac, key, key_size[k]);
+        aes_gcm_init(&aes, key, key_size[k]);
+
+        for(j=0; j < 3; j++){
+
+            for(size=0; size <= sizeof(msg); size += 23){
+
+                aes_gcm_encipher(&aes, iv, iv_size[j], NULL, NULL, 0, msg, size, expected, sizeof(expected));
+                aes_gmac_tag(&gmac, iv, iv_size[j], msg, size, T, sizeof(T));
+
+                if(memcmp(T, expected, sizeof(T))){
+
+                    fprintf(stderr, "FAIL aes_gmac_tag() key %i IV %u size %u\n", key_size[k] * 8, iv_size[j], size);
+                    fail++;
+                }
+
+                if(aes_gmac_verify(&gmac, iv, iv_size[j], msg, size, T, 12)){
+
+                    fprintf(stderr, "FAIL aes_gmac_verify() rejected a valid tag\n");
+                    fail++;
+                }
+
+                T[size % sizeof(T)] ^= 1;
+
+                if(!aes_gmac_verify(&gmac, iv, iv_size[j], msg, size, T, sizeof(T))){
+
+                    fprintf(stderr, "FAIL aes_gmac_verify() accepted a bad tag\n");
+                    fail++;
+                }
+            }
+        }
+    }
+
+    if(aes_gmac_verify(&gmac, iv, GCM_IV_SIZE, msg, sizeof(msg), T, GCM_TAG_SIZE + 1) != -1){
+
+        fprintf(stderr, "FAIL aes_gmac_verify() accepted an invalid T_size\n");
+        fail++;
+    }
+
+    return fail;
+}
+
+int test__otf(void)
+{
+    static const int key_size[] = {AES128_KEY_SIZE, AES192_KEY_SIZE, AES256_KEY_SIZE};
+
+    aes_ctxt aes;
+    aes_otf_ctxt otf;
+    uint8_t k[AES256_KEY_SIZE] = {0};
+    uint8_t s[AES_BLOCK_SIZE], x[AES_BLOCK_SIZE], pt[AES_BLOCK_SIZE];
+    int i, j, ks, fail = 0;
+
+    if(!aes_otf_init(&otf, k, 20)){
+
+        fprintf(stderr, "FAIL aes_otf_init() accepted k_size 20\n");
+        fail++;
+    }
+
+    for(ks=0; ks < 3; ks++){
+
+        for(i=0; i < 16; i++){
+
+            for(j=0; j < sizeof(k); j++)
+                k[j] = (i * 29) + (j * 7) + ks;
+
+            for(j=0; j < sizeof(pt); j++)
+                pt[j] = (i * 5) + j;
+
+            aes_init(&aes, k, key_size[ks]);
+            aes_otf_init(&otf, k, key_size[ks]);
+
+            memcpy(s, pt, sizeof(s));
+            memcpy(x, pt, sizeof(x));
+
+            aes_encr(&aes, x);
+            aes_otf_encr(&otf, s);
+
+            if(memcmp(s, x, sizeof(s))){
+
+                fprintf(stderr, "FAIL aes_otf_encr() k_size %i key %i\n", key_size[ks], i);
+                fail++;
+            }
+
+            aes_otf_decr(&otf, s);
+
+            if(memcmp(s, pt, sizeof(s))){
+
+                fprintf(stderr, "FAIL aes_otf_decr() k_size %i key %i\n", key_size[ks], i);
+                fail++;
+            }
+        }
+    }
+
+    return fail;
+}
+
+int test__unaligned(void)
+{
+    const uint8_t key[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F};
+    const uint8_t iv[] = {0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88};
+
+    uint8_t pt[300 + 16];
+    uint8_t ct[300];
+    uint8_t in[300 + 16];
+    uint8_t out[300 + 16];
+    uint8_t tag[GCM_TAG_SIZE];
+    uint8_t T[GCM_TAG_SIZE + 8];
+    aes_ctxt aes;
+    int i, j, fail = 0;
+
+    aes_gcm_init(&aes, key, sizeof(key));
+
+    for(i=0; i < sizeof(pt); i++)
+        pt[i] = i;
+
+    aes_gcm_encipher(&aes, iv, sizeof(iv), ct, pt, sizeof(ct), pt, 33, tag, sizeof(tag));
+
+    /* every combination of input, output and tag alignment within a word */
+    for(i=0; i < 8; i++){
+
+        for(j=0; j < 8; j++){
+
+            memcpy(in + i, pt, sizeof(ct));
+            memset(T, 0, sizeof(T));
+
+            aes_gcm_encipher(&aes, iv, sizeof(iv), out + j, in + i, sizeof(ct), in + i, 33, T + j, sizeof(tag));
+
+            if(memcmp(out + j, ct, sizeof(ct)) || memcmp(T + j, tag, sizeof(tag))){
+
+                fprintf(stderr, "FAIL aes_gcm_encipher() in + %i out + %i\n", i, j);
+                fail++;
+            }
+
+            memset(in, 0, sizeof(in));
+
+            if(aes_gcm_decipher(&aes, iv, sizeof(iv), in + i, out + j, sizeof(ct), pt, 33, T + j, sizeof(tag)) || memcmp(in + i, pt, sizeof(ct))){
+
+                fprintf(stderr, "FAIL aes_gcm_decipher() in + %i out + %i\n", j, i);
+                fail++;
+            }
+        }
+    }
+
+    if(!aes_gcm_decipher(&aes, iv, sizeof(iv), out, ct, sizeof(ct), pt, 33, tag, -1)){
+
+        fprintf(stderr, "FAIL aes_gcm_decipher() T_size = -1\n");
+        fail++;
+    }
+
+    return fail;
+}
+
+int test__pool(void)
+{
+    /* several units of work plus an incomplete block */
+    const uint32_t size = (5 * AES_POOL_GRAIN * AES_BLOCK_SIZE) + (3 * AES_BLOCK_SIZE) + 7;
+    const uint8_t key[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F};
+    const uint8_t iv[] = {0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88, 0x01, 0x02, 0x03, 0x04};
+    const uint8_t aad[] = {0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xfe, 0xed, 0xfa, 0xce, 0xde, 0xad, 0xbe, 0xef, 0xab, 0xad, 0xda, 0xd2};
+
+    uint8_t *pt, *ct, *buf;
+    uint8_t tag[GCM_TAG_SIZE];
+    uint8_t tagbuf[GCM_TAG_SIZE];
+    uint32_t i, ivlen;
+    aes_pool *pool;
+    aes_ctxt aes;
+    int fail = 0;
+
+    pt = malloc(size);
+    ct = malloc(size);
+    buf = malloc(size);
+
+    if(!pt || !ct || !buf || !(pool = aes_pool_create(4, AES_POOL_AFFINITY))){
+
+        fprintf(stderr, "test__pool() setup\n");
+        free(pt);
+        free(ct);
+        free(buf);
+        return -1;
+    }
+
+    aes_gcm_init(&aes, key, sizeof(key));
+
+    for(i=0; i < size; i++)
+        pt[i] = i * 13;
+
+    aes_ecb_encipher(&aes, ct, pt, size);
+    aes_ecb_encipher_par(pool, &aes, buf, pt, size);
+
+    if(memcmp(buf, ct, size)){
+
+        fprintf(stderr, "FAIL aes_ecb_encipher_par()\n");
+        fail++;
+    }
+
+    aes_ecb_decipher_par(pool, &aes, buf, buf, size - 7);
+
+    if(memcmp(buf, pt, size - 7)){
+
+        fprintf(stderr, "FAIL aes_ecb_decipher_par()\n");
+        fail++;
+    }
+
+    /* nominal and non-nominal IV size */
+    for(ivlen = GCM_IV_SIZE; ivlen <= sizeof(iv); ivlen += (sizeof(iv) - GCM_IV_SIZE)){
+
+        aes_gcm_encipher(&aes, iv, ivlen, ct, pt, size, aad, sizeof(aad), tag, sizeof(tag));
+        aes_gcm_encipher_par(pool, &aes, iv, ivlen, buf, pt, size, aad, sizeof(aad), tagbuf, sizeof(tagbuf));
+
+        if(memcmp(buf, ct, size) || memcmp(tagbuf, tag, sizeof(tag))){
+
+            fprintf(stderr, "FAIL aes_gcm_encipher_par() IV_size = %u\n", ivlen);
+            fail++;
+        }
+
+        if(aes_gcm_decipher_par(pool, &aes, iv, ivlen, buf, buf, size, aad, sizeof(aad), tag, sizeof(tag)) || memcmp(buf, pt, size)){
+
+            fprintf(stderr, "FAIL aes_gcm_decipher_par() IV_size = %u\n", ivlen);
+            fail++;
+        }
+
+        tag[0] ^= 0x1;
+
+        if(!aes_gcm_decipher_par(pool, &aes, iv, ivlen, buf, ct, size, aad, sizeof(aad), tag, sizeof(tag))){
+
+            fprintf(stderr, "FAIL aes_gcm_decipher_par() IV_size = %u corrupted\n", ivlen);
+            fail++;
+        }
+    }
+
+    aes_pool_destroy(pool);
+
+    free(pt);
+    free(ct);
+    free(buf);
+
+    return fail;
+}
+
+static void test__async_cb(aes_job *job)
+{
+    __atomic_add_fetch((int *)job->user, 1, __ATOMIC_RELEASE);
+}
+
+int test__async(void)
+{
+    const uint8_t key[] = {0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F};
+    const uint8_t iv[] = {0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88};
+
+    uint8_t pt[8][256];
+    uint8_t ct[8][256];
+    uint8_t out[8][256 + 8];
+    uint8_t tag[8][GCM_TAG_SIZE];
+
+    aes_job job[8];
+    aes_job *done[8];
+    aes_async *async;
+    aes_ctxt aes;
+    struct pollfd pfd;
+    uint8_t T[GCM_TAG_SIZE];
+    int i, j, n, callbacks = 0, fail = 0;
+
+    if(!(async = aes_async_create(4, 2))){
+
+        fprintf(stderr, "test__async() aes_async_create()\n");
+        return -1;
+    }
+
+    aes_gcm_init(&aes, key, sizeof(key));
+
+    memset(job, 0, sizeof(job));
+
+    for(i=0; i < 8; i++){
+
+        for(j=0; j < sizeof(pt[i]); j++)
+            pt[i][j] = i + j;
+
+        job[i].aes = &aes;
+        job[i].out = out[i];
+        job[i].in = pt[i];
+        job[i].size = 16 * (i + 1);
+
+        switch(i % 3){
+        case 0:
+            job[i].op = AES_JOB_GCM_ENCIPHER;
+            job[i].IV = iv;
+            job[i].IV_size = sizeof(iv);
+            job[i].aad = pt[i];
+            job[i].aad_size = i;
+            job[i].T = tag[i];
+            job[i].T_size = sizeof(tag[i]);
+            aes_gcm_encipher(&aes, iv, sizeof(iv), ct[i], pt[i], job[i].size, pt[i], i, T, sizeof(T));
+            break;
+        case 1:
+            job[i].op = AES_JOB_ECB_ENCIPHER;
+            aes_ecb_encipher(&aes, ct[i], pt[i], job[i].size);
+            break;
+        default:
+            job[i].op = AES_JOB_WRAP_ENCIPHER;
+            aes_wrap_encipher(&aes, ct[i], pt[i], job[i].size, NULL);
+            break;
+        }
+
+        /* half complete by callback */
+        if(i & 1){
+
+            job[i].cb = test__async_cb;
+            job[i].user = &callbacks;
+        }
+
+        /* ring is smaller than the number of jobs */
+        while(aes_async_submit(async, &job[i]));
+    }
+
+    /* collect polled jobs */
+    for(n=0; n < 4; ){
+
+        pfd.fd = aes_async_fd(async);
+        pfd.events = POLLIN;
+
+        if(poll(&pfd, 1, 1000) != 1){
+
+            fprintf(stderr, "FAIL aes_async_fd() timeout\n");
+            fail++;
+            break;
+        }
+
+        n += aes_async_poll(async, done + n, 8 - n);
+    }
+
+    for(i=0; i < n; i++){
+
+        if(done[i]->cb){
+
+            fprintf(stderr, "FAIL aes_async_poll() returned callback job\n");
+            fail++;
+        }
+    }
+
+    while(__atomic_load_n(&callbacks, __ATOMIC_ACQUIRE) < 4);
+
+    for(i=0; i < 8; i++){
+
+        if(job[i].ret || memcmp(out[i], ct[i], job[i].size + ((job[i].op == AES_JOB_WRAP_ENCIPHER) ? 8 : 0))){
+
+            fprintf(stderr, "FAIL aes_async_submit() job %i\n", i);
+            fail++;
+        }
+
+        /* same result as the synchronous call */
+        if(job[i].op == AES_JOB_GCM_ENCIPHER){
+
+            aes_gcm_encipher(&aes, iv, sizeof(iv), ct[i], pt[i], job[i].size, pt[i], i, T, sizeof(T));
+
+            if(memcmp(tag[i], T, sizeof(T))){
+
+                fprintf(stderr, "FAIL aes_async_submit() job %i tag\n", i);
+                fail++;
+            }
+        }
+    }
+
+    aes_async_destroy(async);
+
+    return fail;
+}
+
+int test__multi(void)
+{
+    const uint8_t key[] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F
+    };
+    const uint8_t iv[] = {0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88, 0x01, 0x02, 0x03, 0x04};
+
+    aes_ctxt aes[3];
+    const aes_ctxt *k[19];
+    aes_gcm_req req[19];
+
+    uint8_t s[19][AES_BLOCK_SIZE];
+    uint8_t pt[19][80];
+    uint8_t ct[19][80];
+    uint8_t out[19][80];
+    uint8_t tag[19][GCM_TAG_SIZE];
+    uint8_t T[GCM_TAG_SIZE];
+    int i, j, fail = 0;
+
+    /* mixed key sizes */
+    for(i=0; i < 3; i++)
+        aes_gcm_init(&aes[i], key, AES128_KEY_SIZE + (i * 8));
+
+    for(i=0; i < 19; i++){
+
+        k[i] = &aes[i % 3];
+
+        for(j=0; j < sizeof(pt[i]); j++)
+            pt[i][j] = (i * 7) + j;
+
+        memcpy(s[i], pt[i], sizeof(s[i]));
+    }
+
+    aes_encr_multi(k, (uint8_t *)s, 19);
+
+    for(i=0; i < 19; i++){
+
+        memcpy(T, pt[i], sizeof(T));
+        aes_encr(k[i], T);
+
+        if(memcmp(s[i], T, sizeof(T))){
+
+            fprintf(stderr, "FAIL aes_encr_multi() state %i\n", i);
+            fail++;
+        }
+    }
+
+    /* more requests than lanes with a mix of sizes, IV sizes and tags */
+    memset(req, 0, sizeof(req));
+
+    for(i=0; i < 19; i++){
+
+        req[i].aes = k[i];
+        req[i].IV = iv;
+        req[i].IV_size = (i & 1) ? sizeof(iv) : GCM_IV_SIZE;
+        req[i].out = out[i];
+        req[i].in = pt[i];
+        req[i].size = (i * 13) % sizeof(pt[i]);
+        req[i].aad = pt[i];
+        req[i].aad_size = i % 20;
+        req[i].T = tag[i];
+        req[i].T_size = GCM_TAG_SIZE - (i % 5);
+    }
+
+    aes_gcm_encipher_multi(req, 19);
+
+    for(i=0; i < 19; i++){
+
+        memset(T, 0, sizeof(T));
+        aes_gcm_encipher(k[i], iv, req[i].IV_size, ct[i], pt[i], req[i].size, pt[i], req[i].aad_size, T, req[i].T_size);
+
+        if(req[i].ret || memcmp(out[i], ct[i], req[i].size) || memcmp(tag[i], T, req[i].T_size)){
+
+            fprintf(stderr, "FAIL aes_gcm_encipher_multi() request %i\n", i);
+            fail++;
+        }
+
+        req[i].in = ct[i];
+    }
+
+    tag[5][0] ^= 0x1;
+
+    if(!aes_gcm_decipher_multi(req, 19)){
+
+        fprintf(stderr, "FAIL aes_gcm_decipher_multi() corrupted\n");
+        fail++;
+    }
+
+    for(i=0; i < 19; i++){
+
+        if((i == 5) ? !req[i].ret : (req[i].ret || memcmp(out[i], pt[i], req[i].size))){
+
+            fprintf(stderr, "FAIL aes_gcm_decipher_multi() request %i\n", i);
+            fail++;
+        }
+    }
+
+    return fail;
+}
+
+typedef struct {
+
+    aes_coalesce *co;
+    const aes_ctxt *aes;
+    int id;
+    int fail;
+
+} test__coalesce_arg;
+
+static void *test__coalesce_thread(void *arg)
+{
+    test__coalesce_arg *a = (test__coalesce_arg *)arg;
+    const uint8_t iv[GCM_IV_SIZE] = {0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88};
+
+    uint8_t s[AES_BLOCK_SIZE], x[AES_BLOCK_SIZE];
+    uint8_t pt[64], ct[64], out[64];
+    uint8_t tag[GCM_TAG_SIZE], T[GCM_TAG_SIZE];
+    int i, j;
+
+    for(i=0; i < 100; i++){
+
+        for(j=0; j < sizeof(pt); j++)
+            pt[j] = (a->id * 31) + i + j;
+
+        memcpy(s, pt, sizeof(s));
+        memcpy(x, pt, sizeof(x));
+
+        aes_coalesce_encr(a->co, a->aes, s);
+        aes_encr(a->aes, x);
+
+        if(memcmp(s, x, sizeof(s)))
+            a->fail++;
+
+        aes_coalesce_gcm_encipher(a->co, a->aes, iv, sizeof(iv), out, pt, i % sizeof(pt), pt, a->id, tag, sizeof(tag));
+        aes_gcm_encipher(a->aes, iv, sizeof(iv), ct, pt, i % sizeof(pt), pt, a->id, T, sizeof(T));
+
+        if(memcmp(out, ct, i % sizeof(pt)) || memcmp(tag, T, sizeof(T)))
+            a->fail++;
+
+        if(aes_coalesce_gcm_decipher(a->co, a->aes, iv, sizeof(iv), out, ct, i % sizeof(pt), pt, a->id, tag, sizeof(tag)) || memcmp(out, pt, i % sizeof(pt)))
+            a->fail++;
+    }
+
+    return NULL;
+}
+
+int test__coalesce(void)
+{
+    const uint8_t key[] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F
+    };
+
+    test__coalesce_arg arg[4];
+    pthread_t thread[4];
+    uint64_t hist[AES_COALESCE_MAX + 1];
+    uint64_t requests = 0;
+    aes_coalesce *co;
+    aes_ctxt aes[2];
+    int i, fail = 0;
+
+    if(!(co = aes_coalesce_create(4, 200))){
+
+        fprintf(stderr, "test__coalesce() aes_coalesce_create()\n");
+        return -1;
+    }
+
+    /* batches mix keys of different sizes */
+    aes_gcm_init(&aes[0], key, AES128_KEY_SIZE);
+    aes_gcm_init(&aes[1], key, AES256_KEY_SIZE);
+
+    for(i=0; i < 4; i++){
+
+        arg[i].co = co;
+        arg[i].aes = &aes[i & 1];
+        arg[i].id = i;
+        arg[i].fail = 0;
+
+        pthread_create(&thread[i], NULL, test__coalesce_thread, &arg[i]);
+    }
+
+    for(i=0; i < 4; i++){
+
+        pthread_join(thread[i], NULL);
+
+        if(arg[i].fail){
+
+            fprintf(stderr, "FAIL aes_coalesce_*() thread %i\n", i);
+            fail++;
+        }
+    }
+
+    aes_coalesce_histogram(co, hist, 1);
+
+    /* every request is in exactly one batch of at most max requests */
+    for(i=0; i <= AES_COALESCE_MAX; i++){
+
+        if(hist[i] && ((i == 0) || (i > 4))){
+
+            fprintf(stderr, "FAIL aes_coalesce_histogram() %i requests\n", i);
+            fail++;
+        }
+
+        requests += hist[i] * i;
+    }
+
+    if(requests != (4 * 100 * 3)){
+
+        fprintf(stderr, "FAIL aes_coalesce_histogram() total %llu\n", (unsigned long long)requests);
+        fail++;
+    }
+
+    aes_coalesce_histogram(co, hist, 0);
+
+    for(i=0; i <= AES_COALESCE_MAX; i++){
+
+        if(hist[i]){
+
+            fprintf(stderr, "FAIL aes_coalesce_histogram() reset\n");
+            fail++;
+            break;
+        }
+    }
+
+    aes_coalesce_destroy(co);
+
+    return fail;
+}
+
+#ifdef AES_STATS
+static void *test__stats_thread(void *arg)
+{
+    const aes_ctxt *aes = (const aes_ctxt *)arg;
+    uint8_t s[AES_BLOCK_SIZE] = {0};
+    int i;
+
+    for(i=0; i < 10; i++)
+        aes_encr(aes, s);
+
+    return NULL;
+}
+
+int test__stats(void)
+{
+    const uint8_t key[AES128_KEY_SIZE] = {0};
+    const uint8_t iv[GCM_IV_SIZE] = {0};
+
+    uint8_t buf[64] = {0};
+    uint8_t tag[GCM_TAG_SIZE];
+    char text[2048];
+    aes_stats st;
+    aes_ctxt aes;
+    pthread_t thread;
+    size_t len;
+    int fail = 0;
+
+    aes_stats_snapshot(&st, 1);
+
+    aes_gcm_init(&aes, key, sizeof(key));
+
+    /* H, the tag mask and four counter blocks; four data blocks and the lengths */
+    aes_gcm_encipher(&aes, iv, sizeof(iv), buf, buf, sizeof(buf), NULL, 0, tag, sizeof(tag));
+
+    tag[0] ^= 0x1;
+
+    if(!aes_gcm_decipher(&aes, iv, sizeof(iv), buf, buf, sizeof(buf), NULL, 0, tag, sizeof(tag))){
+
+        fprintf(stderr, "FAIL aes_gcm_decipher() accepted a bad tag\n");
+        fail++;
+    }
+
+    aes_ecb_encipher(&aes, buf, buf, 48);
+
+    /* counters of a thread which has exited are kept */
+    pthread_create(&thread, NULL, test__stats_thread, &aes);
+    pthread_join(thread, NULL);
+
+    aes_stats_snapshot(&st, 1);
+
+    if((st.key_expansions != 1) ||
+        (st.blocks_enciphered != (6 + 6 + 3 + 10)) ||
+        (st.ghash_multiplications != (5 + 5)) ||
+        (st.gcm_tag_failures != 1) ||
+        (st.gcm_bytes != (64 + 64)) ||
+        (st.ecb_bytes != 48) ||
+        st.blocks_deciphered || st.wrap_bytes || st.wrap_failures){
+
+        fprintf(stderr, "FAIL aes_stats_snapshot() counters\n");
+        fail++;
+    }
+
+    len = aes_stats_prometheus(&st, text, sizeof(text));
+
+    if((len >= sizeof(text)) ||
+        !strstr(text, "# TYPE aes_gcm_tag_failures_total counter\naes_gcm_tag_failures_total 1\n") ||
+        !strstr(text, "aes_bytes_total{mode=\"ecb\"} 48\n") ||
+        (aes_stats_prometheus(&st, NULL, 0) != len)){
+
+        fprintf(stderr, "FAIL aes_stats_prometheus()\n");
+        fail++;
+    }
+
+    aes_stats_snapshot(&st, 0);
+
+    if(st.blocks_enciphered || st.gcm_tag_failures){
+
+        fprintf(stderr, "FAIL aes_stats_snapshot() reset\n");
+        fail++;
+    }
+
+    return fail;
+}
+#endif
+
+#ifdef AES_TUNE
+int test__tune(void)
+{
+    const uint8_t key[AES256_KEY_SIZE] = {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F
+    };
+    const uint8_t iv[GCM_IV_SIZE] = {0xca, 0xfe, 0xba, 0xbe, 0xfa, 0xce, 0xdb, 0xad, 0xde, 0xca, 0xf8, 0x88};
+    const char *encr[] = {"byte", "table"};
+    const char *ghash[] = {"shift", "ctmul"};
+
+    aes_tune_result res[4];
+    uint8_t pt[100], ct[100], out[100];
+    uint8_t tag[GCM_TAG_SIZE], T[GCM_TAG_SIZE];
+    aes_ctxt aes;
+    uint32_t n, i, selected;
+    int op, j, k, ks, fail = 0;
+
+    for(i=0; i < sizeof(pt); i++)
+        pt[i] = i * 7;
+
+    /* every binding gives the result of the defaults */
+    for(ks=AES128_KEY_SIZE; ks <= AES256_KEY_SIZE; ks += 8){
+
+        aes_gcm_init(&aes, key, ks);
+        aes_gcm_encipher(&aes, iv, sizeof(iv), ct, pt, sizeof(pt), pt, 20, T, sizeof(T));
+
+        for(j=0; j < 2; j++){
+
+            for(k=0; k < 2; k++){
+
+                if(aes_tune_select(AES_TUNE_ENCR, encr[j]) || aes_tune_select(AES_TUNE_GHASH, ghash[k])){
+
+                    fprintf(stderr, "FAIL aes_tune_select() %s %s\n", encr[j], ghash[k]);
+                    fail++;
+                    continue;
+                }
+
+                aes_gcm_encipher(&aes, iv, sizeof(iv), out, pt, sizeof(pt), pt, 20, tag, sizeof(tag));
+
+                if(memcmp(out, ct, sizeof(ct)) || memcmp(tag, T, sizeof(T))){
+
+                    fprintf(stderr, "FAIL aes_gcm_encipher() with %s %s k_size %i\n", encr[j], ghash[k], ks);
+                    fail++;
+                }
+            }
+        }
+    }
+
+    if(!aes_tune_select(AES_TUNE_ENCR, "tabl") || !aes_tune_select(AES_TUNE_GHASH, "byte")){
+
+        fprintf(stderr, "FAIL aes_tune_select() accepted an unknown backend\n");
+        fail++;
+    }
+
+    aes_tune(30);
+
+    for(op = AES_TUNE_ENCR; op <= AES_TUNE_GHASH; op++){
+
+        n = aes_tune_results(op, res, sizeof(res) / sizeof(*res));
+
+        /* one bound backend and a rate for each */
+        for(i=0, selected=0; i < n; i++)
+            selected += res[i].rate ? (res[i].selected ? 1 : 0) : 2;
+
+        if(!n || (selected != 1)){
+
+            fprintf(stderr, "FAIL aes_tune_results() op %i\n", op);
+            fail++;
+        }
+
+#ifndef AES_TUNE_VARTIME
+        /* only aes_tune_select() binds a variable time backend */
+        for(i=0; i < n; i++){
+
+            if(res[i].selected && res[i].vartime){
+
+                fprintf(stderr, "FAIL aes_tune() bound variable time %s\n", res[i].name);
+                fail++;
+            }
+        }
+#endif
+    }
+
+    aes_tune_select(AES_TUNE_ENCR, "byte");
+    aes_tune_select(AES_TUNE_GHASH, "shift");
+
+    return fail;
+}
+#endif
+
+static void *test__arena_thread(void *arg)
+{
+    aes_arena *arena = (aes_arena *)arg;
+    void **slot = calloc(3, sizeof(void *));
+    int i;
+
+    for(i=0; slot && (i < 3); i++)
+        slot[i] = aes_arena_alloc(arena);
+
+    /* freed to the arena when this thread exits */
+    aes_arena_free(arena, aes_arena_alloc(arena));
+
+    return slot;
+}
+
+int test__arena(void)
+{
+    const uint8_t key[AES128_KEY_SIZE] = {0};
+
+    aes_arena *arena;
+    aes_ctxt *aes[10];
+    void **slot;
+    pthread_t thread;
+    uint32_t i, j;
+    int fail = 0;
+
+    if(!(arena = aes_arena_create(0, 4)))
+        return -1;
+
+    for(i=0; i < 10; i++){
+
+        if(!(aes[i] = (aes_ctxt *)aes_arena_alloc(arena))){
+
+            fprintf(stderr, "FAIL aes_arena_alloc()\n");
+            aes_arena_destroy(arena);
+            return -1;
+        }
+
+        if((uintptr_t)aes[i] % AES_ARENA_LINE){
+
+            fprintf(stderr, "FAIL aes_arena_alloc() alignment\n");
+            fail++;
+        }
+
+        for(j=0; (j < sizeof(aes_ctxt)) && !((uint8_t *)aes[i])[j]; j++);
+
+        if(j != sizeof(aes_ctxt)){
+
+            fprintf(stderr, "FAIL aes_arena_alloc() not zero\n");
+            fail++;
+        }
+
+        aes_init(aes[i], key, sizeof(key));
+    }
+
+    /* no slot shares a line with another */
+    for(i=0; i < 10; i++){
+
+        for(j=0; j < 10; j++){
+
+            if((aes[i] < aes[j]) && (((uintptr_t)aes[j] - (uintptr_t)aes[i]) < (((sizeof(aes_ctxt) + AES_ARENA_LINE - 1) / AES_ARENA_LINE) * AES_ARENA_LINE))){
+
+                fprintf(stderr, "FAIL aes_arena_alloc() slots %u and %u overlap\n", i, j);
+                fail++;
+            }
+        }
+    }
+
+    aes_arena_free(arena, aes[3]);
+
+    if((aes_ctxt *)aes_arena_alloc(arena) != aes[3]){
+
+        fprintf(stderr, "FAIL aes_arena_alloc() did not reuse the freed slot\n");
+        fail++;
+    }
+
+    for(j=0; (j < sizeof(aes_ctxt)) && !((uint8_t *)aes[3])[j]; j++);
+
+    if(j != sizeof(aes_ctxt)){
+
+        fprintf(stderr, "FAIL aes_arena_free() did not clear the slot\n");
+        fail++;
+    }
+
+    /* slots allocated by another thread are freed here */
+    pthread_create(&thread, NULL, test__arena_thread, arena);
+    pthread_join(thread, (void **)&slot);
+
+    for(i=0; slot && (i < 3); i++){
+
+        if(!slot[i] || ((uintptr_t)slot[i] % AES_ARENA_LINE)){
+
+            fprintf(stderr, "FAIL aes_arena_alloc() in thread\n");
+            fail++;
+        }
+
+        aes_arena_free(arena, slot[i]);
+    }
+
+    free(slot);
+
+    for(i=0; i < 10; i++)
+        aes_arena_free(arena, aes[i]);
+
+    aes_arena_destroy(arena);
+
+    return fail;
+}
+
+int test__store(void)
+{
+    const char *path = "test_store.bin";
+    const uint8_t pt[AES_BLOCK_SIZE] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+
+    aes_store_key keys[50];
+    uint8_t k[50][AES256_KEY_SIZE];
+    uint8_t s[AES_BLOCK_SIZE], x[AES_BLOCK_SIZE];
+    const aes_ctxt *ctx;
+    aes_store *store;
+    aes_ctxt aes;
+    struct stat st;
+    FILE *f;
+    int i, j, fail = 0;
+
+    /* ids in no particular order */
+    for(i=0; i < 50; i++){
+
+        for(j=0; j < AES256_KEY_SIZE; j++)
+            k[i][j] = (i * 3) + j;
+
+        keys[i].id = ((uint64_t)(i * 37) % 50) << 33;
+        keys[i].k = k[i];
+        keys[i].k_size = AES128_KEY_SIZE + ((i % 3) * 8);
+    }
+
+    if(aes_store_write(path, keys, 50) || !(store = aes_store_open(path, AES_STORE_VERIFY))){
+
+        fprintf(stderr, "FAIL aes_store_write() or aes_store_open()\n");
+        remove(path);
+        return -1;
+    }
+
+    /* expanded keys are readable by the owner only */
+    if(stat(path, &st) || (st.st_mode & (S_IRWXG | S_IRWXO))){
+
+        fprintf(stderr, "FAIL aes_store_write() file mode\n");
+        fail++;
+    }
+
+    if(aes_store_count(store) != 50){
+
+        fprintf(stderr, "FAIL aes_store_count()\n");
+        fail++;
+    }
+
+    for(i=0; i < 50; i++){
+
+        if(!(ctx = aes_store_get(store, keys[i].id))){
+
+            fprintf(stderr, "FAIL aes_store_get() id %i\n", i);
+            fail++;
+            continue;
+        }
+
+        aes_init(&aes, keys[i].k, keys[i].k_size);
+
+        memcpy(s, pt, sizeof(s));
+        memcpy(x, pt, sizeof(x));
+
+        aes_encr(ctx, s);
+        aes_encr(&aes, x);
+
+        if(memcmp(s, x, sizeof(s))){
+
+            fprintf(stderr, "FAIL aes_store_get() context of id %i\n", i);
+            fail++;
+        }
+    }
+
+    if(aes_store_get(store, 1)){
+
+        fprintf(stderr, "FAIL aes_store_get() found a missing id\n");
+        fail++;
+    }
+
+    aes_store_close(store);
+
+    /* corrupt a round key of the tenth record */
+    if((f = fopen(path, "r+b"))){
+
+        fseek(f, 64 + (9 * 256) + 100, SEEK_SET);
+        j = fgetc(f);
+        fseek(f, 64 + (9 * 256) + 100, SEEK_SET);
+        fputc(j ^ 0x5a, f);
+        fclose(f);
+    }
+
+    if(aes_store_open(path, AES_STORE_VERIFY)){
+
+        fprintf(stderr, "FAIL aes_store_open() accepted a corrupt record\n");
+        fail++;
+    }
+
+    if((store = aes_store_open(path, 0))){
+
+        for(i=0, j=0; i < 50; i++)
+            j += aes_store_get(store, keys[i].id) ? 1 : 0;
+
+        if(j != 49){
+
+            fprintf(stderr, "FAIL aes_store_get() returned a corrupt record\n");
+            fail++;
+        }
+
+        aes_store_close(store);
+    }
+    else{
+
+        fprintf(stderr, "FAIL aes_store_open() rejected a file with a corrupt record\n");
+        fail++;
+    }
+
+    keys[7].id = keys[8].id;
+
+    if(!aes_store_write(path, keys, 50)){
+
+        fprintf(stderr, "FAIL aes_store_write() accepted a repeated id\n");
+        fail++;
+    }
+
+    remove(path);
+
+    return fail;
+}
+
+typedef struct {
+
+    aes_rotate *rot;
+    const uint8_t (*expect)[AES_BLOCK_SIZE];   /* zero block under each key */
+    int keys;
+    int stop;
+    int fail;
+    int reads;
+
+} test__rotate_arg;
+
+static void *test__rotate_thread(void *arg)
+{
+    test__rotate_arg *a = (test__rotate_arg *)arg;
+    const aes_ctxt *aes;
+    uint8_t out[AES_BLOCK_SIZE];
+    int i;
+
+    while(!__atomic_load_n(&a->stop, __ATOMIC_ACQUIRE)){
+
+        aes = aes_rotate_enter(a->rot);
+
+        memset(out, 0, sizeof(out));
+        aes_encr(aes, out);
+
+        aes_rotate_exit(a->rot);
+
+        for(i=0; (i < a->keys) && memcmp(out, a->expect[i], sizeof(out)); i++);
+
+        if(i == a->keys)
+            a->fail++;
+
+        a->reads++;
+    }
+
+    return NULL;
+}
+
+int test__rotate(void)
+{
+    uint8_t key[4][AES256_KEY_SIZE];
+    uint8_t expect[4][AES_BLOCK_SIZE];
+    uint8_t out[AES_BLOCK_SIZE];
+    const aes_ctxt *aes, *nested;
+    aes_ctxt ref;
+    aes_rotate *rot;
+    test__rotate_arg arg;
+    pthread_t thread;
+    int i, fail = 0;
+
+    for(i=0; i < 4; i++){
+
+        memset(key[i], i + 1, sizeof(key[i]));
+        memset(expect[i], 0, sizeof(expect[i]));
+        aes_init(&ref, key[i], (i & 1) ? AES128_KEY_SIZE : AES256_KEY_SIZE);
+        aes_encr(&ref, expect[i]);
+    }
+
+    if(aes_rotate_create(key[0], 17)){
+
+        fprintf(stderr, "FAIL aes_rotate_create() accepted an invalid key size\n");
+        return -1;
+    }
+
+    if(!(rot = aes_rotate_create(key[0], AES256_KEY_SIZE)))
+        return -1;
+
+    /* a reader keeps its context across a rotation */
+    aes = aes_rotate_enter(rot);
+
+    if(aes_rotate_key(rot, key[1], AES128_KEY_SIZE, AES_ROTATE_NOWAIT)){
+
+        fprintf(stderr, "FAIL aes_rotate_key()\n");
+        fail++;
+    }
+
+    nested = aes_rotate_enter(rot);
+
+    memset(out, 0, sizeof(out));
+    aes_encr(aes, out);
+
+    if(memcmp(out, expect[0], sizeof(out))){
+
+        fprintf(stderr, "FAIL context changed under a reader\n");
+        fail++;
+    }
+
+    memset(out, 0, sizeof(out));
+    aes_encr(nested, out);
+
+    if(memcmp(out, expect[1], sizeof(out))){
+
+        fprintf(stderr, "FAIL aes_rotate_enter() did not return the new context\n");
+        fail++;
+    }
+
+    /* the first context is still in use so there is no spare */
+    if(!aes_rotate_key(rot, key[2], AES256_KEY_SIZE, AES_ROTATE_NOWAIT)){
+
+        fprintf(stderr, "FAIL aes_rotate_key() reused a context with readers\n");
+        fail++;
+    }
+
+    aes_rotate_exit(rot);
+    aes_rotate_exit(rot);
+
+    if(aes_rotate_key(rot, key[2], AES256_KEY_SIZE, AES_ROTATE_NOWAIT)){
+
+        fprintf(stderr, "FAIL aes_rotate_key() after readers left\n");
+        fail++;
+    }
+
+    if(aes_rotate_key(rot, key[3], 17, 0) != -1){
+
+        fprintf(stderr, "FAIL aes_rotate_key() accepted an invalid key size\n");
+        fail++;
+    }
+
+    memset(out, 0, sizeof(out));
+    aes_encr(aes_rotate_enter(rot), out);
+    aes_rotate_exit(rot);
+
+    if(memcmp(out, expect[2], sizeof(out))){
+
+        fprintf(stderr, "FAIL aes_rotate_key() new key not used\n");
+        fail++;
+    }
+
+    /* readers never see a partly expanded key */
+    memset(&arg, 0, sizeof(arg));
+    arg.rot = rot;
+    arg.expect = (const uint8_t (*)[AES_BLOCK_SIZE])expect;
+    arg.keys = 4;
+
+    pthread_create(&thread, NULL, test__rotate_thread, &arg);
+
+    for(i=0; i < 1000; i++){
+
+        if(aes_rotate_key(rot, key[i & 3], (i & 1) ? AES128_KEY_SIZE : AES256_KEY_SIZE, 0)){
+
+            fprintf(stderr, "FAIL aes_rotate_key() with a reader thread\n");
+            fail++;
+            break;
+        }
+    }
+
+    __atomic_store_n(&arg.stop, 1, __ATOMIC_RELEASE);
+    pthread_join(thread, NULL);
+
+    if(arg.fail){
+
+        fprintf(stderr, "FAIL %i of %i reads used an inconsistent context\n", arg.fail, arg.reads);
+        fail++;
+    }
+
+    aes_rotate_destroy(rot);
+
+    return fail;
+}
+
+int test__keycache(void)
+{
+    const uint8_t pt[AES_BLOCK_SIZE] = {0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77, 0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff};
+
+    aes_keycache *kc;
+    aes_keycache_stats st;
+    aes_key key[20];
+    const aes_ctxt *ctx[3];
+    aes_ctxt aes;
+    uint8_t k[AES256_KEY_SIZE];
+    uint8_t s[AES_BLOCK_SIZE], x[AES_BLOCK_SIZE];
+    int i, j, fail = 0;
+
+    for(i=0; i < 20; i++){
+
+        for(j=0; j < sizeof(k); j++)
+            k[j] = (i * 13) + j;
+
+        aes_key_init(&key[i], k, AES128_KEY_SIZE + ((i % 3) * 8));
+    }
+
+    if(!aes_key_init(&key[0], k, 20)){
+
+        fprintf(stderr, "FAIL aes_key_init() accepted k_size 20\n");
+        fail++;
+    }
+
+    if(!(kc = aes_keycache_create(8, 2)))
+        return -1;
+
+    /* twice round more keys than fit */
+    for(j=0; j < 2; j++){
+
+        for(i=0; i < 20; i++){
+
+            if(!(ctx[0] = aes_keycache_get(kc, &key[i]))){
+
+                fprintf(stderr, "FAIL aes_keycache_get() key %i\n", i);
+                fail++;
+                continue;
+            }
+
+            aes_init(&aes, key[i].k, key[i].k_size);
+
+            memcpy(s, pt, sizeof(s));
+            memcpy(x, pt, sizeof(x));
+
+            aes_encr(ctx[0], s);
+            aes_encr(&aes, x);
+
+            if(memcmp(s, x, sizeof(s))){
+
+                fprintf(stderr, "FAIL aes_keycache_get() schedule of key %i\n", i);
+                fail++;
+            }
+
+            /* a repeat is a hit */
+            aes_keycache_put(kc, aes_keycache_get(kc, &key[i]));
+            aes_keycache_put(kc, ctx[0]);
+        }
+    }
+
+    aes_keycache_stats_get(kc, &st, 1);
+
+    if((st.hits != 40) || (st.misses != 40) || (st.evictions != 32) || (st.entries != 8) || (st.capacity != 8) || st.full){
+
+        fprintf(stderr, "FAIL aes_keycache_stats_get()\n");
+        fail++;
+    }
+
+    aes_keycache_destroy(kc);
+
+    /* pinned schedules are not evicted */
+    if(!(kc = aes_keycache_create(2, 1)))
+        return -1;
+
+    ctx[0] = aes_keycache_get(kc, &key[0]);
+    ctx[1] = aes_keycache_get(kc, &key[1]);
+
+    if(aes_keycache_get(kc, &key[2])){
+
+        fprintf(stderr, "FAIL aes_keycache_get() evicted a pinned schedule\n");
+        fail++;
+    }
+
+    aes_keycache_put(kc, ctx[0]);
+
+    if(!(ctx[2] = aes_keycache_get(kc, &key[2])) || (ctx[2] != ctx[0]) || (aes_keycache_get(kc, &key[1]) != ctx[1])){
+
+        fprintf(stderr, "FAIL aes_keycache_get() least recently used\n");
+        fail++;
+    }
+
+    aes_keycache_stats_get(kc, &st, 0);
+
+    if((st.hits != 1) || (st.misses != 3) || (st.evictions != 1) || (st.full != 1)){
+
+        fprintf(stderr, "FAIL aes_keycache_stats_get() pinned\n");
+        fail++;
+    }
+
+    aes_keycache_destroy(kc);
+
+    return fail;
+}
+
 int test__wrap(void)
 {
     struct {
@@ -614,10 +2481,199 @@ int test__wrap(void)
         }
     }
 
+    /* batch of different sizes under the same 256bit KEK */
+    aes_wrap_req req[sizeof(nist) / sizeof(*nist)];
+    uint8_t batch[sizeof(nist) / sizeof(*nist)][32+8];
+    int vec[sizeof(nist) / sizeof(*nist)];
+    int n = 0;
+
+    aes_wrap_init(&aes, nist[2].kek, nist[2].keklen);
+
+    for(i=0; i < (sizeof(nist) / sizeof(*nist)); i++){
+
+        if(memcmp(nist[i].kek, nist[2].kek, nist[2].keklen))
+            continue;
+
+        req[n].out = batch[n];
+        req[n].in = nist[i].in;
+        req[n].in_size = nist[i].inlen;
+        vec[n++] = i;
+    }
+
+    if(aes_wrap_encipher_batch(&aes, req, n, NULL)){
+
+        fprintf(stderr, "FAIL aes_wrap_encipher_batch()\n");
+        fail++;
+    }
+
+    for(i=0; i < n; i++){
+
+        if(req[i].ret || (req[i].out_size != (req[i].in_size + 8)) || memcmp(batch[i], nist[vec[i]].out, req[i].out_size)){
+
+            fprintf(stderr, "FAIL aes_wrap_encipher_batch() request %i\n", i);
+            fail++;
+        }
+
+        req[i].in = batch[i];
+        req[i].in_size = req[i].out_size;
+    }
+
+    if(aes_wrap_decipher_batch(&aes, req, n, NULL)){
+
+        fprintf(stderr, "FAIL aes_wrap_decipher_batch()\n");
+        fail++;
+    }
+
+    for(i=0; i < n; i++){
+
+        if(req[i].ret || memcmp(batch[i], nist[vec[i]].in, req[i].out_size)){
+
+            fprintf(stderr, "FAIL aes_wrap_decipher_batch() request %i\n", i);
+            fail++;
+        }
+    }
+
 
     return fail;        
 }
 
+int test__kwp(void)
+{
+    /* RFC 5649 section 6 */
+    struct {
+
+        int keklen;
+        int inlen;
+        int outlen;
+
+        uint8_t kek[24];
+        uint8_t in[20];
+        uint8_t out[32];
+
+    } rfc[] = {
+
+        /* 192bit KEK, 20 octet key */
+        {
+            24,
+            20,
+            32,
+
+            {0x58, 0x40, 0xdf, 0x6e, 0x29, 0xb0, 0x2a, 0xf1, 0xab, 0x49, 0x3b, 0x70, 0x5b, 0xf1, 0x6e, 0xa1, 0xae, 0x83, 0x38, 0xf4, 0xdc, 0xc1, 0x76, 0xa8},
+            {0xc3, 0x7b, 0x7e, 0x64, 0x92, 0x58, 0x43, 0x40, 0xbe, 0xd1, 0x22, 0x07, 0x80, 0x89, 0x41, 0x15, 0x50, 0x68, 0xf7, 0x38},
+            {0x13, 0x8b, 0xde, 0xaa, 0x9b, 0x8f, 0xa7, 0xfc, 0x61, 0xf9, 0x77, 0x42, 0xe7, 0x22, 0x48, 0xee, 0x5a, 0xe6, 0xae, 0x53, 0x60, 0xd1, 0xae, 0x6a, 0x5f, 0x54, 0xf3, 0x73, 0xfa, 0x54, 0x3b, 0x6a}
+        },
+        /* 192bit KEK, 7 octet key */
+        {
+            24,
+            7,
+            16,
+
+            {0x58, 0x40, 0xdf, 0x6e, 0x29, 0xb0, 0x2a, 0xf1, 0xab, 0x49, 0x3b, 0x70, 0x5b, 0xf1, 0x6e, 0xa1, 0xae, 0x83, 0x38, 0xf4, 0xdc, 0xc1, 0x76, 0xa8},
+            {0x46, 0x6f, 0x72, 0x50, 0x61, 0x73, 0x69},
+            {0xaf, 0xbe, 0xb0, 0xf0, 0x7d, 0xfb, 0xf5, 0x41, 0x92, 0x00, 0xf2, 0xcc, 0xb5, 0x0b, 0xb2, 0x4f}
+        }
+    };
+
+    uint8_t in[1024];
+    uint8_t out[1024];
+    uint32_t size;
+    int i;
+    aes_ctxt aes;
+    int fail = 0;
+
+    aes_wrap_req req[sizeof(rfc) / sizeof(*rfc)];
+    uint8_t batch[sizeof(rfc) / sizeof(*rfc)][32];
+
+    for(i=0; i < (sizeof(rfc) / sizeof(*rfc)); i++){
+
+        aes_wrap_init(&aes, rfc[i].kek, rfc[i].keklen);
+
+        //non-overlap
+        memcpy(in, rfc[i].in, rfc[i].inlen);
+
+        if(aes_kwp_encipher(&aes, out, in, rfc[i].inlen) || memcmp(out, rfc[i].out, rfc[i].outlen)){
+
+            fprintf(stderr, "FAIL aes_kwp_encipher() non-overlap\n");
+            fail++;
+        }
+
+        memcpy(in, rfc[i].out, rfc[i].outlen);
+
+        if(aes_kwp_decipher(&aes, out, in, rfc[i].outlen, &size) || (size != rfc[i].inlen) || memcmp(out, rfc[i].in, rfc[i].inlen)){
+
+            fprintf(stderr, "FAIL aes_kwp_decipher() non-overlap\n");
+            fail++;
+        }
+
+        //overlap
+        memcpy(in, rfc[i].in, rfc[i].inlen);
+
+        if(aes_kwp_encipher(&aes, in, in, rfc[i].inlen) || memcmp(in, rfc[i].out, rfc[i].outlen)){
+
+            fprintf(stderr, "FAIL aes_kwp_encipher() overlap\n");
+            fail++;
+        }
+
+        memcpy(in, rfc[i].out, rfc[i].outlen);
+
+        if(aes_kwp_decipher(&aes, in, in, rfc[i].outlen, &size) || (size != rfc[i].inlen) || memcmp(in, rfc[i].in, rfc[i].inlen)){
+
+            fprintf(stderr, "FAIL aes_kwp_decipher() overlap\n");
+            fail++;
+        }
+
+        //corrupted
+        memcpy(in, rfc[i].out, rfc[i].outlen);
+        in[rfc[i].outlen - 1] ^= 0x1;
+
+        if(!aes_kwp_decipher(&aes, out, in, rfc[i].outlen, &size)){
+
+            fprintf(stderr, "FAIL aes_kwp_decipher() corrupted\n");
+            fail++;
+        }
+
+        req[i].out = batch[i];
+        req[i].in = rfc[i].in;
+        req[i].in_size = rfc[i].inlen;
+    }
+
+    /* both vectors share the same KEK */
+    if(aes_kwp_encipher_batch(&aes, req, i)){
+
+        fprintf(stderr, "FAIL aes_kwp_encipher_batch()\n");
+        fail++;
+    }
+
+    for(i=0; i < (sizeof(rfc) / sizeof(*rfc)); i++){
+
+        if(req[i].ret || (req[i].out_size != rfc[i].outlen) || memcmp(batch[i], rfc[i].out, rfc[i].outlen)){
+
+            fprintf(stderr, "FAIL aes_kwp_encipher_batch() request %i\n", i);
+            fail++;
+        }
+
+        req[i].in = batch[i];
+        req[i].in_size = req[i].out_size;
+    }
+
+    if(aes_kwp_decipher_batch(&aes, req, i)){
+
+        fprintf(stderr, "FAIL aes_kwp_decipher_batch()\n");
+        fail++;
+    }
+
+    for(i=0; i < (sizeof(rfc) / sizeof(*rfc)); i++){
+
+        if(req[i].ret || (req[i].out_size != rfc[i].inlen) || memcmp(batch[i], rfc[i].in, rfc[i].inlen)){
+
+            fprintf(stderr, "FAIL aes_kwp_decipher_batch() request %i\n", i);
+            fail++;
+        }
+    }
+
+    return fail;
+}
+
 int main(int argc, char **argv)
 {
     int i, ret = 0, fail = 0;
@@ -659,6 +2715,11 @@ int main(int argc, char **argv)
         }
     }
 
+    if(!(ret = test__ecb_bulk()))
+        fprintf(stdout, "test__ecb_bulk() PASS\n");
+
+    fail += ret;
+
     const char *gcm_enc_vectors[] = {
         "vectors/gcmEncryptExtIV128.rsp",
         "vectors/gcmEncryptExtIV192.rsp",
@@ -684,11 +2745,114 @@ int main(int argc, char **argv)
         }
     }
 
-    if(!test__wrap()){
+    if(!(ret = test__hp_masks()))
+        fprintf(stdout, "test__hp_masks() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__gcm_prefix()))
+        fprintf(stdout, "test__gcm_prefix() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__gcm_update()))
+        fprintf(stdout, "test__gcm_update() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__gcm_verified()))
+        fprintf(stdout, "test__gcm_verified() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__gcm_iov()))
+        fprintf(stdout, "test__gcm_iov() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__tls()))
+        fprintf(stdout, "test__tls() PASS\n");
 
+    fail += ret;
+
+    if(!(ret = test__gmac()))
+        fprintf(stdout, "test__gmac() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__otf()))
+        fprintf(stdout, "test__otf() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__unaligned()))
+        fprintf(stdout, "test__unaligned() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__pool()))
+        fprintf(stdout, "test__pool() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__async()))
+        fprintf(stdout, "test__async() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__multi()))
+        fprintf(stdout, "test__multi() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__coalesce()))
+        fprintf(stdout, "test__coalesce() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__arena()))
+        fprintf(stdout, "test__arena() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__store()))
+        fprintf(stdout, "test__store() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__rotate()))
+        fprintf(stdout, "test__rotate() PASS\n");
+
+    fail += ret;
+
+    if(!(ret = test__keycache()))
+        fprintf(stdout, "test__keycache() PASS\n");
+
+    fail += ret;
+
+#ifdef AES_STATS
+    if(!(ret = test__stats()))
+        fprintf(stdout, "test__stats() PASS\n");
+
+    fail += ret;
+#endif
+
+#ifdef AES_TUNE
+    if(!(ret = test__tune()))
+        fprintf(stdout, "test__tune() PASS\n");
+
+    fail += ret;
+#endif
+
+    if(!(ret = test__wrap()))
         fprintf(stdout, "test__wrap() PASS\n");
-        fail++;
-    }
+
+    fail += ret;
+
+    if(!(ret = test__kwp()))
+        fprintf(stdout, "test__kwp() PASS\n");
+
+    fail += ret;
     
     if(fail)
         exit(EXIT_FAILURE);